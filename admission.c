@@ -0,0 +1,142 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file admission.c
+*
+* \brief Implements the admission control declared in admission.h.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdlib.h>         /* For exit() */
+#include <string.h>
+#include "utils.h"
+#include "common.h"
+#include "admission.h"
+
+static uint64_t get_age_ns(time_t req_time, time_t current_time);
+
+/* How long ago req_time surely was, 0 for a time not in the past. */
+static uint64_t get_age_ns(time_t req_time, time_t current_time)
+{
+    if (req_time <= 0 || current_time - req_time < 2)
+    {
+        return 0;
+    }
+    /* Sent at the end of second req_time at the latest, and now is at
+     * least the start of current_time. */
+    return (uint64_t)(current_time - req_time - 1) * 1000000000ull;
+}
+
+void admission_init(admission_t *admission, unsigned int deadline_ms, unsigned int depth_high)
+{
+    memset(admission, 0, sizeof(*admission));
+    admission->deadline_ns = deadline_ms * 1000000ull;
+    admission->depth_high = depth_high;
+    atomic_init(&admission->depth, 0);
+    atomic_init(&admission->depth_max, 0);
+    atomic_init(&admission->service_ns, 0);
+    atomic_init(&admission->samples, 0);
+    atomic_init(&admission->full_samples, 0);
+    atomic_init(&admission->late, 0);
+    atomic_init(&admission->shed, 0);
+}
+
+bool admission_sample(admission_t *admission, mqd_t mq, uint64_t now_ns)
+{
+    struct mq_attr attr;
+
+    if (now_ns - admission->sampled_ns < ADMISSION_SAMPLE_MS * 1000000ull)
+    {
+        return atomic_load_explicit(&admission->depth, memory_order_relaxed) >=
+            admission->depth_high;
+    }
+    admission->sampled_ns = now_ns;
+    int rc = mq_getattr(mq, &attr);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    unsigned int depth = attr.mq_curmsgs;
+    atomic_store_explicit(&admission->depth, depth, memory_order_relaxed);
+    if (depth > atomic_load_explicit(&admission->depth_max, memory_order_relaxed))
+    {
+        atomic_store_explicit(&admission->depth_max, depth, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&admission->samples, 1, memory_order_relaxed);
+    if (depth < admission->depth_high)
+    {
+        return false;
+    }
+    atomic_fetch_add_explicit(&admission->full_samples, 1, memory_order_relaxed);
+    return true;
+}
+
+bool admission_late(admission_t *admission, time_t req_time, time_t current_time,
+        uint64_t waited_ns)
+{
+    if (0 == admission->deadline_ns)
+    {
+        return false;
+    }
+    uint64_t age_ns = get_age_ns(req_time, current_time);
+    if (waited_ns > age_ns)
+    {
+        age_ns = waited_ns;
+    }
+    if (age_ns <= admission->deadline_ns)
+    {
+        return false;
+    }
+    atomic_fetch_add_explicit(&admission->late, 1, memory_order_relaxed);
+    return true;
+}
+
+bool admission_shed(admission_t *admission, time_t req_time, time_t current_time,
+        unsigned int backlog, unsigned int workers_no)
+{
+    if (0 == admission->deadline_ns)
+    {
+        return false;
+    }
+    uint64_t service_ns = atomic_load_explicit(&admission->service_ns, memory_order_relaxed);
+    uint64_t wait_ns = (backlog + 1) * service_ns / workers_no;
+    if (get_age_ns(req_time, current_time) + wait_ns <= admission->deadline_ns)
+    {
+        return false;
+    }
+    atomic_fetch_add_explicit(&admission->shed, 1, memory_order_relaxed);
+    return true;
+}
+
+void admission_served(admission_t *admission, uint64_t service_ns)
+{
+    uint64_t average = atomic_load_explicit(&admission->service_ns, memory_order_relaxed);
+
+    if (0 == average)
+    {
+        average = service_ns;
+    }
+    else
+    {
+        average = average - (average >> ADMISSION_EWMA_SHIFT) +
+            (service_ns >> ADMISSION_EWMA_SHIFT);
+    }
+    atomic_store_explicit(&admission->service_ns, average, memory_order_relaxed);
+}
+
+void admission_print_stats(const admission_t *admission, FILE *out)
+{
+    fprintf(out, "Admission: deadline %llu ms; late %llu; shed %llu; queue samples %llu;"
+            " found full %llu; max depth %u; mean service %.1f us\n",
+            (unsigned long long)admission->deadline_ns / 1000000,
+            (unsigned long long)atomic_load(&admission->late),
+            (unsigned long long)atomic_load(&admission->shed),
+            (unsigned long long)atomic_load(&admission->samples),
+            (unsigned long long)atomic_load(&admission->full_samples),
+            atomic_load(&admission->depth_max),
+            atomic_load(&admission->service_ns) / 1e3);
+}
@@ -0,0 +1,173 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file admission.h
+*
+* \brief Admission control. A request whose answer would come later than a
+*        deadline gets BUSY instead, without touching the database, so an
+*        overloaded server spends its time on requests that can still be
+*        answered in time. How long a request waited is known from its
+*        req_time, to the second, and from when the server received it.
+*        The depth of the request queue is sampled with mq_getattr: while
+*        the queue is full, clients block sending, and requests predicted
+*        to miss the deadline in the work queue are refused as they arrive.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <mqueue.h>
+
+#define ADMISSION_SAMPLE_MS 1   /**< Between two mq_getattr of the queue. */
+#define ADMISSION_EWMA_SHIFT 4  /**< A new service time weighs 1/16. */
+
+/*
+*******************************************************************************
+*   admission_t
+*******************************************************************************
+*
+*  \brief           <b> admission_t </b>\n
+*                   Shared by the threads receiving and serving requests.
+*                   Treat the members as private.
+*
+*  \var             depth_high                        Messages in the queue
+*                                                     from which it counts as
+*                                                     full.
+*
+*  \var             service_ns                        Moving average of the
+*                                                     time to serve one
+*                                                     request.
+*
+*  \var             late                              Requests found late
+*                                                     when served.
+*
+*  \var             shed                              Requests refused as
+*                                                     they arrived.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    uint64_t deadline_ns;   /**< 0 admits everything. */
+    unsigned int depth_high;
+    uint64_t sampled_ns;    /**< Only the receiving thread samples. */
+    atomic_uint depth;
+    atomic_uint depth_max;
+    _Atomic uint64_t service_ns;
+    _Atomic uint64_t samples;
+    _Atomic uint64_t full_samples;
+    _Atomic uint64_t late;
+    _Atomic uint64_t shed;
+} admission_t;
+
+/*
+*******************************************************************************
+*   admission_init
+*******************************************************************************
+*
+*  \brief           <b> admission_init </b>\n
+*                   Answers BUSY to requests older than deadline_ms, none
+*                   if it is 0. The queue counts as full from depth_high
+*                   messages on.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void admission_init(admission_t *admission, unsigned int deadline_ms, unsigned int depth_high);
+
+/*
+*******************************************************************************
+*   admission_sample
+*******************************************************************************
+*
+*  \brief           <b> admission_sample </b>\n
+*                   Reads the depth of mq, at most every ADMISSION_SAMPLE_MS.
+*                   Only one thread may call it.
+*
+*  \return          true                   The queue was full at the last
+*                                          sample.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+bool admission_sample(admission_t *admission, mqd_t mq, uint64_t now_ns);
+
+/*
+*******************************************************************************
+*   admission_late
+*******************************************************************************
+*
+*  \brief           <b> admission_late </b>\n
+*                   Whether a request sent at req_time, seen by the server
+*                   waited_ns ago, is past the deadline before being served.
+*                   req_time is whole seconds, so only the seconds surely
+*                   gone by count. Counts the late ones.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+bool admission_late(admission_t *admission, time_t req_time, time_t current_time,
+        uint64_t waited_ns);
+
+/*
+*******************************************************************************
+*   admission_shed
+*******************************************************************************
+*
+*  \brief           <b> admission_shed </b>\n
+*                   For a request arriving while the queue is full, whether
+*                   it would miss the deadline waiting behind backlog
+*                   requests for one of workers_no workers, at the average
+*                   service time. Counts the ones refused.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+bool admission_shed(admission_t *admission, time_t req_time, time_t current_time,
+        unsigned int backlog, unsigned int workers_no);
+
+/*
+*******************************************************************************
+*   admission_served
+*******************************************************************************
+*
+*  \brief           <b> admission_served </b>\n
+*                   Adds the time a request took to serve to the average.
+*                   Lock-free; concurrent updates may lose one.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void admission_served(admission_t *admission, uint64_t service_ns);
+
+/*
+*******************************************************************************
+*   admission_print_stats
+*******************************************************************************
+*
+*  \brief           <b> admission_print_stats </b>\n
+*                   Prints the deadline, the requests refused and the
+*                   queue depth seen to out.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void admission_print_stats(const admission_t *admission, FILE *out);
+
+#endif /* ADMISSION_H */
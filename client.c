@@ -10,6 +10,7 @@
 *
 * \version 1.0 16.01.2023 Mihnea SERBAN created
 * \version 1.1 23.01.2023 Mihnea SERBAN modified
+* \version 1.2 17.10.2026 Mihnea SERBAN modified
 *
 *//**************************** FILE HEADER *********************************/
 
@@ -28,34 +29,92 @@
 #include "utils.h"
 #include "constants.h"
 #include "common.h"
+#include "tokclient.h"
 
 static void do_work(uint8_t pseudo_port);
+static void wait_completion(tok_session_t *session, tok_completion_t *completion);
+static void print_completion(const tok_completion_t *completion);
 static void send_close_server_msg();
 
+static void wait_completion(tok_session_t *session, tok_completion_t *completion)
+{
+    if (0 == tok_wait(session, completion, -1))
+    {
+        handle_error_en(EINVAL); /* Nothing was in flight. */
+    }
+    print_completion(completion);
+}
+
+static void print_completion(const tok_completion_t *completion)
+{
+    pid_t pid = getpid();
+
+    switch (completion->req_type)
+    {
+        case TOKEN:
+        case TOKEN_ANY:
+            if (ACK == completion->resp_type)
+            {
+                printf("%5d_client: #%llu received token %3u.\n", pid,
+                        (unsigned long long)completion->req_id, completion->token);
+            }
+            else
+            {
+                printf("%5d_client: #%llu token %3u not available.\n", pid,
+                        (unsigned long long)completion->req_id, completion->token);
+            }
+        break;
+        case RELEASE:
+            if (ACK == completion->resp_type)
+            {
+                printf("%5d_client: #%llu released token %3u.\n", pid,
+                        (unsigned long long)completion->req_id, completion->token);
+            }
+            else
+            {
+                printf("%5d_client: #%llu token %3u was not ours any more.\n", pid,
+                        (unsigned long long)completion->req_id, completion->token);
+            }
+        break;
+        case TOKEN_BULK:
+        case RENEW:
+            printf("%5d_client: #%llu %s %3d of %3d tokens from %3u.\n", pid,
+                    (unsigned long long)completion->req_id,
+                    RENEW == completion->req_type ? "renewed" : "received",
+                    completion->reserved_no, completion->tokens_no,
+                    completion->results[0].token);
+        break;
+        case QUERY:
+            if (QUERY_RESULT == completion->resp_type)
+            {
+                const query_response_msg_t *query = completion->query;
+                printf("%5d_client: #%llu holds %3u tokens, %u of %u are held by %u pids.\n",
+                        pid, (unsigned long long)completion->req_id, query->held_no,
+                        query->used_no, query->db_tokens_no, query->owners_no);
+            }
+            else
+            {
+                printf("%5d_client: #%llu query not answered.\n", pid,
+                        (unsigned long long)completion->req_id);
+            }
+        break;
+        default:
+            printf("%5d_client: Received unkown response.\n", pid);
+    }
+}
+
 void do_work(uint8_t pseudo_port)
 {
-    int rc = 0;
     pid_t pid = getpid();
-    char client_mq_name[MAX_MQUEUE_NAME] = {0};
-    mqd_t client_mq;
-    mqd_t server_mq;
-    struct mq_attr qattr = {0};
-    qattr.mq_maxmsg = MQ_MAXMSG;
-    qattr.mq_msgsize = MQ_MSGSIZE;
     unsigned int seed = (unsigned int)pid; /**< Detailes of the conversion does not matter. */
-    unsigned int msg_prio = MQ_DEFAULT_PRIO;
+    tok_session_t session;
+    tok_completion_t completion;
 
     printf("%5d_client: Starting.\n", pid);
     int wait_max = CLIENT_CONSUME_WAIT_MAX;
     int wait_min = CLIENT_CONSUME_WAIT_MIN;
 
-    rc = get_client_mq_name(client_mq_name, sizeof(client_mq_name), pseudo_port);
-    if (rc < 0 || (unsigned int)rc > sizeof(client_mq_name))
-    {
-        handle_error();
-    }
-    client_mq = mq_open(client_mq_name, O_RDONLY | O_CREAT, MQ_MODE, &qattr);
-    if (-1 == client_mq)
+    if (-1 == tok_session_open(&session, pseudo_port, 0))
     {
         handle_error();
     }
@@ -63,73 +122,48 @@ void do_work(uint8_t pseudo_port)
     {
         printf("%5d_client: Run %d.\n", pid, i);
         sleep(rand_r(&seed) % (wait_max - wait_min) + wait_min);
-
-        request_msg_t request = {0};
-        request.req_type = TOKEN;
-        request.token_requested = rand_r(&seed) % (CLIENT_MAX_TOK+1);
-        request.pid = pid;
-        request.pseudo_port = pseudo_port;
-        request.req_time = time(NULL);
-        response_msg_t response;
-        char buf[MQ_MSGSIZE + 1];
-        unsigned int resp_prio = 0;
-        bool discard_msg;
-        if (-1 == request.req_time)
-        {
-            handle_error();
-        }
-        server_mq = mq_open(MQ_REQ_NAME, O_WRONLY | O_CREAT, MQ_MODE, &qattr);
-        if (-1 == server_mq)
+        if (i % 2 == 1)
         {
-            handle_error();
-        }
-        printf("%5d_client: Requesting %3d.\n", pid, request.token_requested);
-        rc = mq_send(server_mq, (char*)&request, sizeof(request), msg_prio);
-        if (-1 == rc)
-        {
-            handle_error();
+            /* Let the server pick instead of guessing, use the token for a
+             * while and give it back early. */
+            printf("%5d_client: Requesting any token in %3d-%3d.\n", pid, 0, CLIENT_MAX_TOK);
+            tok_submit_any(&session, 0, CLIENT_MAX_TOK);
+            wait_completion(&session, &completion);
+            if (ACK == completion.resp_type)
+            {
+                sleep(rand_r(&seed) % (wait_max - wait_min) + wait_min);
+                tok_submit_release(&session, completion.token);
+                wait_completion(&session, &completion);
+            }
+            continue;
         }
-        rc = mq_close(server_mq);
-        if (-1 == rc)
+
+        /* Ask for several tokens at once and take the answers in the order
+         * the server gives them. */
+        for (int j = 0; j < CLIENT_PIPELINE_NO; j++)
         {
-            handle_error();
+            uint32_t token = rand_r(&seed) % (CLIENT_MAX_TOK+1);
+            uint64_t req_id = tok_submit_token(&session, token);
+            printf("%5d_client: #%llu requesting %3u.\n", pid, (unsigned long long)req_id, token);
         }
-        do
-        {
-            discard_msg = false;
-            rc = mq_receive(client_mq, buf, sizeof(buf), &resp_prio);
-            if (-1 == rc)
-            {
-                handle_error();
-            }
-            if (rc != sizeof(response)){
-                discard_msg = true;
-                continue;
-            }
-            memcpy(&response, buf, sizeof(response));
-            if (response.pid != pid || response.token_requested != request.token_requested)
-            {
-                printf("%5d_client: Discarding a message.\n", pid);
-                discard_msg = true;
-            }
-        } while(discard_msg == true);
-        switch(response.resp_type)
+        while (tok_inflight_no(&session) > 0)
         {
-            case ACK:
-                printf("%5d_client: Received token %3d.\n", pid, response.token_requested);
-            break;
-            case TOKEN_NOT_AVAILABLE:
-                printf("%5d_client: Token %3d not available.\n", pid, response.token_requested);
-            break;
-            default:
-                printf("%5d_client: Received unkown response.\n", pid);
+            wait_completion(&session, &completion);
         }
     }
-    rc = mq_unlink(client_mq_name);
-    if (-1 == rc)
-    {
-        handle_error();
-    }
+    /* Finish with a block of tokens no other client asks for, kept past
+     * DB_ENTRY_TTL by renewing it. */
+    uint32_t first_bulk_tok = CLIENT_MAX_TOK + 1 + pseudo_port * CLIENT_BULK_TOK;
+    printf("%5d_client: Requesting %3d tokens from %3u.\n", pid, CLIENT_BULK_TOK, first_bulk_tok);
+    tok_submit_bulk(&session, TOKEN_BULK, first_bulk_tok, CLIENT_BULK_TOK, BULK_ALL_OR_NOTHING);
+    wait_completion(&session, &completion);
+    sleep(wait_max);
+    printf("%5d_client: Renewing %3d tokens from %3u.\n", pid, CLIENT_BULK_TOK, first_bulk_tok);
+    tok_submit_bulk(&session, RENEW, first_bulk_tok, CLIENT_BULK_TOK, 0);
+    wait_completion(&session, &completion);
+    tok_submit_query(&session, pid, 0);
+    wait_completion(&session, &completion);
+    tok_session_close(&session);
     printf("%5d_client: Closing.\n", pid);
 }
 
@@ -172,6 +206,7 @@ int main()
 {
     int first_pseudo_port = 100;
     pid_t children[CLIENT_CONSUME_RUN_NO];
+
     for (int i = 0; i < CLIENT_CONSUME_WORKERS_NO; i++)
     {
         children[i] = fork();
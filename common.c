@@ -8,12 +8,23 @@
 *
 * \version 1.0 20.01.2023 Mihnea SERBAN created
 * \version 1.1 23.01.2023 Mihnea SERBAN modified
+* \version 1.2 17.10.2026 Mihnea SERBAN modified
 *
 *//**************************** FILE HEADER *********************************/
 
 
 #include "common.h"
 #include <stdio.h>
+#include <stdlib.h>         /* For exit() */
+#include <string.h>
+#include <endian.h>
+#include <fcntl.h>          /* For O_* constants */
+#include <mqueue.h>
+#include "utils.h"
+#include "constants.h"
+
+const char *const g_lane_names[LANES_NO] = {"normal", "interactive", "batch"};
+const LANE g_lane_order[LANES_NO] = {LANE_INTERACTIVE, LANE_NORMAL, LANE_BATCH};
 
 int get_client_mq_name(char *buf, size_t buf_len, uint8_t pseudo_port)
 {
@@ -24,3 +35,162 @@ int get_client_mq_name(char *buf, size_t buf_len, uint8_t pseudo_port)
     }
     return rc;
 }
+
+unsigned int get_token_shard(uint32_t token, unsigned int shards_no)
+{
+    return token / SHARD_BLOCK_TOK % shards_no;
+}
+
+int get_request_mq_name(char *buf, size_t buf_len, uint32_t token, unsigned int shards_no)
+{
+    int rc;
+
+    if (0 == shards_no)
+    {
+        rc = snprintf(buf, buf_len, "%s", MQ_REQ_NAME);
+    }
+    else
+    {
+        rc = snprintf(buf, buf_len, MQ_SHARD_NAME_FMT, get_token_shard(token, shards_no));
+    }
+    if (rc >= 0 && (unsigned int)rc >= buf_len)
+    {
+        buf[buf_len-1] = '\0';
+    }
+    return rc;
+}
+
+unsigned int get_shards_no(void)
+{
+    char name[MAX_MQUEUE_NAME];
+    unsigned int shards_no = 0;
+
+    while (shards_no < SHARDS_MAX)
+    {
+        snprintf(name, sizeof(name), MQ_SHARD_NAME_FMT, shards_no);
+        mqd_t mq = mq_open(name, O_WRONLY);
+        if (-1 == mq)
+        {
+            break;
+        }
+        mq_close(mq);
+        shards_no++;
+    }
+    return shards_no;
+}
+
+unsigned int get_lane_prio(unsigned int lane)
+{
+    switch (lane)
+    {
+        case LANE_INTERACTIVE:
+            return MQ_INTERACTIVE_PRIO;
+        case LANE_BATCH:
+            return MQ_BATCH_PRIO;
+        default:
+            return MQ_DEFAULT_PRIO;
+    }
+}
+
+LANE get_prio_lane(unsigned int prio)
+{
+    if (prio > MQ_DEFAULT_PRIO)
+    {
+        return LANE_INTERACTIVE;
+    }
+    if (prio < MQ_DEFAULT_PRIO)
+    {
+        return LANE_BATCH;
+    }
+    return LANE_NORMAL;
+}
+
+int parse_lane(const char *name, LANE *lane)
+{
+    for (unsigned int i = 0; i < LANES_NO; i++)
+    {
+        if (0 == strcmp(name, g_lane_names[i]))
+        {
+            *lane = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+uint64_t get_monotonic_ns(void)
+{
+    struct timespec ts;
+    int rc = clock_gettime(CLOCK_MONOTONIC, &ts);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+size_t bulk_request_len(uint16_t tokens_no, uint8_t flags)
+{
+    if (flags & BULK_RANGE)
+    {
+        tokens_no = 1;
+    }
+    return offsetof(bulk_request_msg_t, tokens) + tokens_no * sizeof(uint32_t);
+}
+
+size_t bulk_response_len(uint16_t tokens_no)
+{
+    return offsetof(bulk_response_msg_t, results) + tokens_no * sizeof(bulk_result_t);
+}
+
+_Static_assert(offsetof(bulk_response_msg_t, results) + BULK_MAX_TOK * sizeof(bulk_result_t)
+        <= MQ_MSGSIZE, "a full bulk_response_msg_t does not fit in a message");
+
+size_t query_response_len(uint16_t tokens_no)
+{
+    return offsetof(query_response_msg_t, tokens) + tokens_no * sizeof(uint32_t);
+}
+
+_Static_assert(sizeof(query_response_msg_t) <= MQ_MSGSIZE,
+        "a full query_response_msg_t does not fit in a message");
+
+size_t wire_request_len(uint16_t count)
+{
+    return sizeof(wire_header_t) + count * sizeof(wire_request_t);
+}
+
+size_t wire_response_len(uint16_t count)
+{
+    return sizeof(wire_header_t) + count * sizeof(wire_response_t);
+}
+
+void wire_put_header(void *buf, uint16_t count, pid_t pid, uint8_t pseudo_port,
+        uint64_t batch_id)
+{
+    wire_header_t header = {
+        .magic = htole32(WIRE_MAGIC),
+        .version = WIRE_VERSION,
+        .pseudo_port = pseudo_port,
+        .count = htole16(count),
+        .pid = htole32(pid),
+        .batch_id = htole64(batch_id)
+    };
+    memcpy(buf, &header, sizeof(header));
+}
+
+bool wire_get_header(const void *buf, size_t len, size_t record_len, wire_header_t *header)
+{
+    if (len < sizeof(*header))
+    {
+        return false;
+    }
+    memcpy(header, buf, sizeof(*header));
+    header->magic = le32toh(header->magic);
+    header->count = le16toh(header->count);
+    header->pid = le32toh(header->pid);
+    header->batch_id = le64toh(header->batch_id);
+    return WIRE_MAGIC == header->magic && header->version >= WIRE_VERSION_MIN &&
+        header->version <= WIRE_VERSION && header->count >= 1 &&
+        header->count <= WIRE_BATCH_MAX &&
+        len == sizeof(*header) + header->count * record_len;
+}
@@ -8,6 +8,7 @@
 *
 * \version 1.0 13.01.2023 Mihnea SERBAN created
 * \version 1.1 25.01.2023 Mihnea SERBAN modified
+* \version 1.2 17.10.2026 Mihnea SERBAN modified
 *
 *//**************************** FILE HEADER *********************************/
 
@@ -15,6 +16,8 @@
 #define COMMON_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>         /* For size_t and offsetof */
 #include <time.h>
 #include <sys/types.h>  /* For pid_t */
 
@@ -33,7 +36,13 @@
 *******************************************************************************/
 typedef enum {
     ACK,
-    TOKEN_NOT_AVAILABLE
+    TOKEN_NOT_AVAILABLE,
+    ROLLED_BACK,            /**< Free, but its all-or-nothing batch failed. */
+    BULK_RESULT,            /**< The message is a bulk_response_msg_t. */
+    NOT_OWNER,              /**< The token is not held by the sender. */
+    BUSY,                   /**< Not served, the server would have answered
+                                 past its deadline, see admission.h. */
+    QUERY_RESULT            /**< The message is a query_response_msg_t. */
 } RESP_TYPE;
 
 /*
@@ -50,9 +59,50 @@ typedef enum {
 *******************************************************************************/
 typedef enum {
     TOKEN,
-    CLOSE
+    CLOSE,
+    TOKEN_BULK,             /**< The message is a bulk_request_msg_t. */
+    TOKEN_ANY,              /**< The message is an any_request_msg_t. */
+    RELEASE,                /**< request_msg_t giving token_requested back. */
+    RENEW,                  /**< bulk_request_msg_t extending held tokens. */
+    HELLO,                  /**< request_msg_t, see wire_header_t. */
+    WIRE_BATCH,             /**< A wire_batch_t in the server, never sent. */
+    HANDOFF,                /**< request_msg_t the server sends itself once a
+                                 new server takes over, see handoff.h.
+                                 Ignored otherwise. */
+    QUERY                   /**< The message is a query_request_msg_t. */
 } REQ_TYPE;
 
+/*
+*******************************************************************************
+*   LANE
+*******************************************************************************
+*
+*  \brief           <b> LANE </b>\n
+*                   Priority class of a request. It is carried in the
+*                   mq_send priority, see get_lane_prio, and in the lane
+*                   field of the request for the shared memory ring, which
+*                   has no priorities. Each lane waits for the workers in a
+*                   queue of its own, see work_pool.h.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef enum {
+    LANE_NORMAL,            /**< Every client not asking otherwise. */
+    LANE_INTERACTIVE,       /**< Someone waits for the answer. */
+    LANE_BATCH,             /**< Background jobs, served last. */
+    LANES_NO
+} LANE;
+
+extern const char *const g_lane_names[LANES_NO]; /**< "normal", "interactive", "batch". */
+extern const LANE g_lane_order[LANES_NO];       /**< By priority, interactive first. */
+
+#define BULK_MAX_TOK 256            /**< Most tokens in one bulk request. */
+#define BULK_ALL_OR_NOTHING 0x01    /**< Reserve every token or none. */
+#define BULK_RANGE 0x02             /**< tokens_no tokens from tokens[0]. */
+#define QUERY_MAX_TOK 256           /**< Most tokens in one query answer. */
+
 /*
 *******************************************************************************
 *   request_msg_t
@@ -73,6 +123,17 @@ typedef enum {
 *                                                     name of the message queue
 *                                                     for the response.
 *
+*  \var             req_id                            Chosen by the client and
+*                                                     echoed in the response,
+*                                                     to match them up. Every
+*                                                     request type carries it.
+*
+*  \var             lane                              From enum LANE. Only read
+*                                                     for the shared memory
+*                                                     ring; every request
+*                                                     type carries it, where
+*                                                     it was padding.
+*
 *  \author          <Mihnea SERBAN>
 *
 *  \date            <25.01.2023>
@@ -80,10 +141,12 @@ typedef enum {
 typedef struct
 {
     int req_type;
-    uint16_t token_requested;
+    uint32_t token_requested;
     pid_t pid;
     uint8_t pseudo_port;
+    uint8_t lane;
     time_t req_time;
+    uint64_t req_id;
 } request_msg_t;
 
 /*
@@ -104,6 +167,7 @@ typedef struct
 *  \var             pdi_t pid                         Pid of the client that
 *                                                     requested the token.
 *
+*  \var             req_id                            req_id of the request.
 *
 *  \author          <Mihnea SERBAN>
 *
@@ -112,12 +176,400 @@ typedef struct
 typedef struct
 {
     int resp_type;
-    uint16_t token_requested;
+    uint32_t token_requested;
     pid_t pid;
-
+    uint64_t req_id;
 } response_msg_t;
 
 
+/*
+*******************************************************************************
+*   any_request_msg_t
+*******************************************************************************
+*
+*  \brief           <b> any_request_msg_t </b>\n
+*                   Asks the server for any free token between token_min and
+*                   token_max, both included. The server answers with a
+*                   response_msg_t whose token_requested is the token it
+*                   reserved.
+*
+*  \var             req_type                          Must be TOKEN_ANY.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct
+{
+    int req_type;
+    pid_t pid;
+    time_t req_time;
+    uint8_t pseudo_port;
+    uint8_t lane;
+    uint32_t token_min;
+    uint32_t token_max;
+    uint64_t req_id;
+} any_request_msg_t;
+
+/*
+*******************************************************************************
+*   bulk_request_msg_t
+*******************************************************************************
+*
+*  \brief           <b> bulk_request_msg_t </b>\n
+*                   Asks the server to reserve several tokens at once, or with
+*                   RENEW to move the aq_time of tokens the sender holds to
+*                   req_time. Only the used part of tokens is sent, see
+*                   bulk_request_len.
+*
+*  \var             req_type                          TOKEN_BULK or RENEW.
+*
+*  \var             pseudo_port                       As in request_msg_t.
+*
+*  \var             flags                             BULK_ALL_OR_NOTHING, not
+*                                                     used by RENEW, and
+*                                                     BULK_RANGE.
+*
+*  \var             tokens_no                         Tokens in the request,
+*                                                     1 to BULK_MAX_TOK.
+*
+*  \var             tokens                            The tokens. With
+*                                                     BULK_RANGE only tokens[0]
+*                                                     is sent, the first of
+*                                                     tokens_no consecutive
+*                                                     tokens.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct
+{
+    int req_type;
+    pid_t pid;
+    time_t req_time;
+    uint8_t pseudo_port;
+    uint8_t flags;
+    uint16_t tokens_no;
+    uint8_t lane;
+    uint64_t req_id;
+    uint32_t tokens[BULK_MAX_TOK];
+} bulk_request_msg_t;
+
+/*
+*******************************************************************************
+*   bulk_response_msg_t
+*******************************************************************************
+*
+*  \brief           <b> bulk_response_msg_t </b>\n
+*                   Answer to a bulk_request_msg_t, one result for every
+*                   requested token, in request order. Only the used part of
+*                   results is sent, see bulk_response_len.
+*
+*  \var             resp_type                         Always BULK_RESULT.
+*
+*  \var             reserved_no                       Tokens reserved, or
+*                                                     renewed.
+*
+*  \var             results                           Token and RESP_TYPE.
+*                                                     RENEW results are ACK or
+*                                                     NOT_OWNER. Packed, so
+*                                                     BULK_MAX_TOK of them
+*                                                     fit in MQ_MSGSIZE.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct __attribute__((packed))
+{
+    uint32_t token;
+    uint8_t result;
+    uint8_t reserved;
+} bulk_result_t;
+
+typedef struct
+{
+    int resp_type;
+    pid_t pid;
+    uint16_t tokens_no;
+    uint16_t reserved_no;
+    uint64_t req_id;
+    bulk_result_t results[BULK_MAX_TOK];
+} bulk_response_msg_t;
+
+/*
+*******************************************************************************
+*   query_request_msg_t
+*******************************************************************************
+*
+*  \brief           <b> query_request_msg_t </b>\n
+*                   Asks the server which tokens owner holds, and how many
+*                   tokens are held overall. Every request queue accepts it,
+*                   the tokens of every shard are in the answer.
+*
+*  \var             req_type                          Must be QUERY.
+*
+*  \var             pid                               Of the sender, owner
+*                                                     may be another pid.
+*
+*  \var             owner                             0 only asks for the
+*                                                     counts.
+*
+*  \var             token_min                         Lowest token to list.
+*                                                     One past the last one
+*                                                     listed asks for the
+*                                                     next page.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct
+{
+    int req_type;
+    pid_t pid;
+    time_t req_time;
+    uint8_t pseudo_port;
+    uint8_t lane;
+    pid_t owner;
+    uint32_t token_min;
+    uint64_t req_id;
+} query_request_msg_t;
+
+/*
+*******************************************************************************
+*   query_response_msg_t
+*******************************************************************************
+*
+*  \brief           <b> query_response_msg_t </b>\n
+*                   Answer to a query_request_msg_t. Only the used part of
+*                   tokens is sent, see query_response_len.
+*
+*  \var             resp_type                         Always QUERY_RESULT.
+*
+*  \var             tokens_no                         Tokens listed, at most
+*                                                     QUERY_MAX_TOK.
+*
+*  \var             held_no                           Tokens owner holds,
+*                                                     listed or not.
+*
+*  \var             used_no                           Tokens held by anyone.
+*
+*  \var             owners_no                         Pids holding any.
+*
+*  \var             db_tokens_no                      Tokens in the database.
+*
+*  \var             tokens                            The lowest tokens owner
+*                                                     holds from token_min
+*                                                     on, in increasing
+*                                                     order.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct
+{
+    int resp_type;
+    pid_t pid;
+    pid_t owner;
+    uint16_t tokens_no;
+    uint32_t held_no;
+    uint32_t used_no;
+    uint32_t owners_no;
+    uint32_t db_tokens_no;
+    uint64_t req_id;
+    uint32_t tokens[QUERY_MAX_TOK];
+} query_response_msg_t;
+
+/*
+*******************************************************************************
+*   bulk_request_len / bulk_response_len
+*******************************************************************************
+*
+*  \brief           <b> bulk_request_len / bulk_response_len </b>\n
+*                   Number of bytes of a bulk message that are sent, given
+*                   its tokens_no and flags.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+size_t bulk_request_len(uint16_t tokens_no, uint8_t flags);
+size_t bulk_response_len(uint16_t tokens_no);
+
+/*
+*******************************************************************************
+*   query_response_len
+*******************************************************************************
+*
+*  \brief           <b> query_response_len </b>\n
+*                   Number of bytes of a query answer listing tokens_no
+*                   tokens.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+size_t query_response_len(uint16_t tokens_no);
+
+#define WIRE_MAGIC 0x57544F4Bu      /**< "KOTW", above any req_type or resp_type. */
+#define WIRE_VERSION 2              /**< Newest version of the wire format. */
+#define WIRE_VERSION_MIN 2          /**< Oldest one still spoken, 1 had 16 bit
+                                         tokens. */
+#define WIRE_BATCH_MAX 64           /**< Most records in one wire message. */
+
+/*
+*******************************************************************************
+*   wire_header_t
+*******************************************************************************
+*
+*  \brief           <b> wire_header_t </b>\n
+*                   Start of a message in the compact wire format, followed
+*                   by count wire_request_t or wire_response_t records. Every
+*                   field is little-endian and nothing is padded, so the
+*                   layout does not depend on the compiler. One message
+*                   carries up to WIRE_BATCH_MAX TOKEN, TOKEN_ANY and RELEASE
+*                   requests of one client, and the server answers all of
+*                   them with one message, in the same order.
+*
+*                   A client sends HELLO in a request_msg_t whose
+*                   token_requested is the newest version it speaks. The
+*                   server answers ACK with the version to use in
+*                   token_requested, 0 if it speaks none that old. Without
+*                   an answer the client keeps to the request_msg_t family
+*                   of messages, which every server accepts. Bulk requests
+*                   are always sent that way.
+*
+*  \var             magic                             WIRE_MAGIC.
+*
+*  \var             pid                               Of the client, for
+*                                                     every record.
+*
+*  \var             pseudo_port                       As in request_msg_t.
+*
+*  \var             batch_id                          Chosen by the client,
+*                                                     echoed in the answer.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t pseudo_port;
+    uint16_t count;
+    int32_t pid;
+    uint64_t batch_id;
+} wire_header_t;
+
+/*
+*******************************************************************************
+*   wire_request_t / wire_response_t
+*******************************************************************************
+*
+*  \brief           <b> wire_request_t / wire_response_t </b>\n
+*                   One request of a wire message and its answer, the
+*                   fields of request_msg_t / any_request_msg_t and
+*                   response_msg_t that are not in wire_header_t.
+*
+*  \var             token                             token_requested, or
+*                                                     token_min for
+*                                                     TOKEN_ANY.
+*
+*  \var             lane                              As in request_msg_t.
+*                                                     The message is served
+*                                                     in the lane of its
+*                                                     first record.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct __attribute__((packed))
+{
+    uint8_t req_type;
+    uint8_t lane;
+    uint32_t token;
+    uint32_t token_max;
+    int64_t req_time;
+    uint64_t req_id;
+} wire_request_t;
+
+typedef struct __attribute__((packed))
+{
+    uint8_t resp_type;
+    uint8_t reserved;
+    uint32_t token;
+    uint64_t req_id;
+} wire_response_t;
+
+/*
+*******************************************************************************
+*   wire_batch_t
+*******************************************************************************
+*
+*  \brief           <b> wire_batch_t </b>\n
+*                   A wire request message as the server passes it around,
+*                   the header in host order and the records as received.
+*
+*  \var             req_type                          WIRE_BATCH, like the
+*                                                     other request structs
+*                                                     it starts with it.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct
+{
+    int req_type;
+    wire_header_t header;
+    wire_request_t records[WIRE_BATCH_MAX];
+} wire_batch_t;
+
+/*
+*******************************************************************************
+*   wire_request_len / wire_response_len
+*******************************************************************************
+*
+*  \brief           <b> wire_request_len / wire_response_len </b>\n
+*                   Number of bytes of a wire message with count records.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+size_t wire_request_len(uint16_t count);
+size_t wire_response_len(uint16_t count);
+
+/*
+*******************************************************************************
+*   wire_put_header / wire_get_header
+*******************************************************************************
+*
+*  \brief           <b> wire_put_header / wire_get_header </b>\n
+*                   Write the header of a wire message at the start of buf,
+*                   and read it back in host order.
+*
+*  \param[in]       size_t record_len      sizeof(wire_request_t) or
+*                                          sizeof(wire_response_t).
+*
+*  \return          wire_get_header returns false if the len bytes of buf
+*                   are not a wire message of a version this side speaks,
+*                   with 1 to WIRE_BATCH_MAX records of record_len bytes.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void wire_put_header(void *buf, uint16_t count, pid_t pid, uint8_t pseudo_port,
+        uint64_t batch_id);
+bool wire_get_header(const void *buf, size_t len, size_t record_len, wire_header_t *header);
+
 /*
 *******************************************************************************
 *   get_clinet_mq_name
@@ -154,4 +606,114 @@ typedef struct
 *******************************************************************************/
 int get_client_mq_name(char *buf, size_t buf_len, uint8_t pseudo_port);
 
+/*
+*******************************************************************************
+*   get_token_shard
+*******************************************************************************
+*
+*  \brief           <b> get_token_shard </b>\n
+*                   Shard serving token when the server splits the tokens in
+*                   shards_no shards. Blocks of SHARD_BLOCK_TOK tokens are
+*                   dealt to the shards in turn, so routing works without
+*                   knowing how many tokens the database holds.
+*
+*  \param[in]       unsigned int shards_no   A power of two, at most
+*                                            SHARDS_MAX.
+*
+*  \return          The shard, from 0.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+unsigned int get_token_shard(uint32_t token, unsigned int shards_no);
+
+/*
+*******************************************************************************
+*   get_request_mq_name
+*******************************************************************************
+*
+*  \brief           <b> get_request_mq_name </b>\n
+*                   Name of the queue a request for token should be sent to:
+*                   its shard's, or MQ_REQ_NAME when shards_no is 0. Every
+*                   queue accepts every request, routing only avoids sharing
+*                   locks between shards.
+*
+*  \return          Like get_client_mq_name.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int get_request_mq_name(char *buf, size_t buf_len, uint32_t token, unsigned int shards_no);
+
+/*
+*******************************************************************************
+*   get_shards_no
+*******************************************************************************
+*
+*  \brief           <b> get_shards_no </b>\n
+*                   Finds how many shards the running server has by looking
+*                   for their request queues.
+*
+*  \return          The number of shards, 0 for a server without shards.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+unsigned int get_shards_no(void);
+
+/*
+*******************************************************************************
+*   get_lane_prio / get_prio_lane
+*******************************************************************************
+*
+*  \brief           <b> get_lane_prio / get_prio_lane </b>\n
+*                   The mq_send priority of a lane, and the lane of a
+*                   priority received: above MQ_DEFAULT_PRIO is interactive,
+*                   below it batch. A lane out of range is LANE_NORMAL.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+unsigned int get_lane_prio(unsigned int lane);
+LANE get_prio_lane(unsigned int prio);
+
+/*
+*******************************************************************************
+*   parse_lane
+*******************************************************************************
+*
+*  \brief           <b> parse_lane </b>\n
+*                   Finds the lane named name, one of g_lane_names.
+*
+*  \return          0                      Success.
+*
+*  \return          -1                     Unknown name.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int parse_lane(const char *name, LANE *lane);
+
+/*
+*******************************************************************************
+*   get_monotonic_ns
+*******************************************************************************
+*
+*  \brief           <b> get_monotonic_ns </b>\n
+*                   Reads CLOCK_MONOTONIC. Used for measuring intervals.
+*
+*  \return          Nanoseconds since an unspecified starting point. A failing
+*                   clock is a fatal error.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+uint64_t get_monotonic_ns(void);
+
 #endif /* COMMON_H */
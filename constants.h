@@ -8,6 +8,7 @@
 *
 * \version 1.0 13.01.2023 Mihnea SERBAN created
 * \version 1.1 23.01.2023 Mihnea SERBAN modified
+* \version 1.2 17.10.2026 Mihnea SERBAN modified
 *
 *//**************************** FILE HEADER *********************************/
 
@@ -16,7 +17,10 @@
 #define CONSTANTS_H
 
 #define MQ_REQ_NAME "/server_requests"
+#define MQ_SHARD_NAME_FMT MQ_REQ_NAME "_%u" /**< Request queue of a shard. */
+#define SHARDS_MAX 16 /**< A power of two dividing DB_STRIPES_NO. */
 #define DATABASE_NAME "db"
+#define HANDOFF_SOCKET_NAME "server.sock" /**< Next to "db", see handoff.h. */
 #define MAX_MQUEUE_NAME 64 /**< It includes the NULL charater */
 #define MQ_MAXMSG 10
 #define MQ_MSGSIZE 2048
@@ -29,15 +33,22 @@
 #define SERVER_PROD_RUN_NO 10
 #define SERVER_PROD_WORKERS_NO 12
 #define MQ_DEFAULT_PRIO 10
+#define MQ_INTERACTIVE_PRIO 20 /**< Read before MQ_DEFAULT_PRIO, see LANE. */
+#define MQ_BATCH_PRIO 5
 
 #define CLIENT_MAX_TOK 20
+#define CLIENT_BULK_TOK 4
+#define CLIENT_PIPELINE_NO 4 /**< TOKEN requests a client has in flight at once. */
 
 #define CLIENT_CONSUME_RUN_NO 20
 #define CLIENT_CONSUME_WORKERS_NO 6
 #define CLIENT_CONSUME_WAIT_MIN 0
 #define CLIENT_CONSUME_WAIT_MAX 3
 
-#define DB_MAX_TOK 65535
+#define DB_DEFAULT_TOK 65536    /**< Tokens of a new "db" unless asked otherwise. */
+#define DB_TOKENS_MIN 1024
+#define DB_TOKENS_MAX (1u << 30)
+#define SHARD_BLOCK_TOK 1024    /**< Tokens in a row served by the same shard. */
 #define DB_ENTRY_TTL 10 /**< This is in seconds */
 
 #endif /* CONSTANTS_H */
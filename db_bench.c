@@ -0,0 +1,260 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file db_bench.c
+*
+* \brief Contention benchmark for the token database. Runs db_reserve from
+*        1, 2, 4, ... threads for a fixed time each and prints how many
+*        reservations per second every thread count achieved, and how long
+*        they took. Every reservation succeeds and is written, so the whole
+*        path is measured. With -f all every flush policy is run in turn on
+*        the same file, to compare what durability costs on its disk.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>         /* For rand_r() and exit() */
+#include <string.h>
+#include <unistd.h>         /* For getopt and sleep */
+#include <pthread.h>
+#include <stdatomic.h>
+#include <limits.h>
+#include "utils.h"
+#include "constants.h"
+#include "common.h"
+#include "tok_db.h"
+#include "histogram.h"
+
+#define BENCH_DB_NAME "db_bench.db"
+#define BENCH_MAX_THREADS 8
+#define BENCH_SECONDS 2
+#define BENCH_FLUSH_ALL "all"
+
+/* Cheapest first. */
+static const char *const k_flush_names[] = {"none", "periodic", "group", "dsync", "each"};
+
+typedef struct {
+    tok_db_t *db;
+    pid_t owner;
+    unsigned int tokens_no;
+    atomic_bool *stop;
+    uint64_t done;
+    hist_t latency;         /**< Nanoseconds per reservation. */
+} bench_th_t;
+
+static void *bench_f(void *args);
+static void run_policy(const db_config_t *cfg, const char *flush_name,
+        unsigned int tokens_no, unsigned int max_threads, unsigned int seconds);
+static unsigned int parse_count_arg(const char *arg, char opt);
+static void print_usage(const char *prog);
+
+static void *bench_f(void *args)
+{
+    bench_th_t *th = args;
+    unsigned int seed = (unsigned int)th->owner;
+    /* aq_time 0 is always expired, so no reservation is refused. */
+    db_entry_t entry = {.owner = th->owner, .aq_time = 0};
+
+    while (!atomic_load_explicit(th->stop, memory_order_relaxed))
+    {
+        uint32_t token = rand_r(&seed) % th->tokens_no;
+        uint64_t start = get_monotonic_ns();
+        if (db_reserve(th->db, token, entry) != ACK)
+        {
+            handle_error_en(EAGAIN);
+        }
+        hist_record(&th->latency, get_monotonic_ns() - start);
+        th->done++;
+    }
+    return NULL;
+}
+
+/* Opens the database with the flush policy named flush_name and measures
+ * every thread count with it. */
+static void run_policy(const db_config_t *cfg, const char *flush_name,
+        unsigned int tokens_no, unsigned int max_threads, unsigned int seconds)
+{
+    static hist_t latency;
+    db_config_t policy_cfg = *cfg;
+    tok_db_t db;
+    const double us = 1000.0;
+    int rc;
+
+    if (db_parse_flush(flush_name, &policy_cfg.flush) != 0)
+    {
+        handle_error_en(EINVAL);
+    }
+    uint64_t open_ns = get_monotonic_ns();
+    rc = db_open(&db, &policy_cfg);
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
+    /* On stderr, stdout is CSV. */
+    fprintf(stderr, "Opened %u tokens with -f %s in %.3f s\n", db.tokens_no, flush_name,
+            (get_monotonic_ns() - open_ns) / 1e9);
+    if (0 == tokens_no || tokens_no > db.tokens_no)
+    {
+        tokens_no = db.tokens_no;
+    }
+
+    for (unsigned int threads_no = 1; threads_no <= max_threads; threads_no *= 2)
+    {
+        pthread_t th_ids[threads_no];
+        bench_th_t ths[threads_no];
+        atomic_bool stop;
+        uint64_t total = 0;
+
+        atomic_init(&stop, false);
+        memset(ths, 0, sizeof(ths));
+        memset(&latency, 0, sizeof(latency));
+        uint64_t start = get_monotonic_ns();
+        for (unsigned int i = 0; i < threads_no; i++)
+        {
+            ths[i].db = &db;
+            ths[i].owner = (pid_t)(i + 1);
+            ths[i].tokens_no = tokens_no;
+            ths[i].stop = &stop;
+            rc = pthread_create(&th_ids[i], NULL, bench_f, &ths[i]);
+            if (rc != 0)
+            {
+                handle_error_en(rc);
+            }
+        }
+        sleep(seconds);
+        atomic_store(&stop, true);
+        for (unsigned int i = 0; i < threads_no; i++)
+        {
+            rc = pthread_join(th_ids[i], NULL);
+            if (rc != 0)
+            {
+                handle_error_en(rc);
+            }
+            total += ths[i].done;
+            hist_merge(&latency, &ths[i].latency);
+        }
+        double elapsed = (get_monotonic_ns() - start) / 1e9;
+        printf("%s,%u,%llu,%.3f,%.0f,%.1f,%.1f,%.1f,%.1f,%.1f\n", flush_name, threads_no,
+                (unsigned long long)total, elapsed, total / elapsed,
+                hist_mean(&latency) / us, hist_percentile(&latency, 0.5) / us,
+                hist_percentile(&latency, 0.99) / us, hist_percentile(&latency, 0.999) / us,
+                atomic_load(&latency.max) / us);
+        fflush(stdout);
+    }
+
+    db_print_stats(&db, stderr);
+    rc = db_close(&db);
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
+}
+
+static unsigned int parse_count_arg(const char *arg, char opt)
+{
+    char *end = NULL;
+    errno = 0;
+    unsigned long val = strtoul(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || 0 == val || val > UINT_MAX)
+    {
+        fprintf(stderr, "Invalid value \"%s\" for -%c\n", arg, opt);
+        exit(1);
+    }
+    return (unsigned int)val;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-t max_threads] [-d seconds] [-k tokens]"
+            " [-b file|mmap|memory] [-f each|periodic|none|group|dsync|all]"
+            " [-p path] [-n db_tokens]\n"
+            "  -t  largest thread count tried (default %d)\n"
+            "  -d  seconds spent on every thread count (default %d)\n"
+            "  -k  tokens used, from 0 (default all of the database)\n"
+            "  -b  storage backend (default mmap)\n"
+            "  -f  flush policy, all runs every one in turn (default none)\n"
+            "  -p  database file (default " BENCH_DB_NAME ")\n"
+            "  -n  tokens in the database (default its size, %d if new)\n",
+            prog, BENCH_MAX_THREADS, BENCH_SECONDS, DB_DEFAULT_TOK);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int max_threads = BENCH_MAX_THREADS;
+    unsigned int seconds = BENCH_SECONDS;
+    unsigned int tokens_no = 0;
+    db_config_t cfg = {
+        .path = BENCH_DB_NAME,
+        .backend = DB_BACKEND_MMAP,
+        .flush_interval_ms = 100
+    };
+    const char *flush_name = "none";
+    DB_FLUSH flush;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:d:k:b:f:p:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 't':
+                max_threads = parse_count_arg(optarg, opt);
+            break;
+            case 'd':
+                seconds = parse_count_arg(optarg, opt);
+            break;
+            case 'k':
+                tokens_no = parse_count_arg(optarg, opt);
+            break;
+            case 'n':
+                cfg.tokens_no = parse_count_arg(optarg, opt);
+                if (cfg.tokens_no < DB_TOKENS_MIN || cfg.tokens_no > DB_TOKENS_MAX)
+                {
+                    fprintf(stderr, "The number of tokens must be between %u and %u\n",
+                            DB_TOKENS_MIN, DB_TOKENS_MAX);
+                    exit(1);
+                }
+            break;
+            case 'b':
+                if (db_parse_backend(optarg, &cfg.backend) != 0)
+                {
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+            break;
+            case 'f':
+                flush_name = optarg;
+                if (strcmp(flush_name, BENCH_FLUSH_ALL) != 0 &&
+                    db_parse_flush(flush_name, &flush) != 0)
+                {
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+            break;
+            case 'p':
+                cfg.path = optarg;
+            break;
+            default:
+                print_usage(argv[0]);
+                exit(1);
+        }
+    }
+
+    const char *const *policies = &flush_name;
+    size_t policies_no = 1;
+    if (0 == strcmp(flush_name, BENCH_FLUSH_ALL))
+    {
+        policies = k_flush_names;
+        policies_no = ARRAY_LEN(k_flush_names);
+    }
+    printf("flush,threads,reservations,seconds,reservations_per_sec,"
+            "mean_us,p50_us,p99_us,p999_us,max_us\n");
+    for (size_t i = 0; i < policies_no; i++)
+    {
+        run_policy(&cfg, policies[i], tokens_no, max_threads, seconds);
+    }
+    return 0;
+}
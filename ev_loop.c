@@ -0,0 +1,410 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file ev_loop.c
+*
+* \brief Implements the event loop declared in ev_loop.h. The request queue
+*        and the timerfd are always watched; a client queue is watched for
+*        EPOLLOUT only while replies wait for it.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdlib.h>         /* For malloc() */
+#include <string.h>
+#include <fcntl.h>          /* For O_* constants */
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "utils.h"
+#include "constants.h"
+#include "common.h"
+#include "ev_loop.h"
+
+#define EV_TAG_REQUEST EV_PORTS_NO      /**< epoll data of req_mq. */
+#define EV_TAG_TIMER (EV_PORTS_NO + 1)  /**< epoll data of timer_fd, ports use theirs. */
+
+static void watch_port(ev_loop_t *loop, uint8_t pseudo_port, bool watch);
+static void close_port(ev_loop_t *loop, uint8_t pseudo_port);
+static void flush_port(ev_loop_t *loop, uint8_t pseudo_port);
+static bool read_requests(ev_loop_t *loop);
+static void tick(ev_loop_t *loop);
+
+static void watch_port(ev_loop_t *loop, uint8_t pseudo_port, bool watch)
+{
+    ev_port_t *port = &loop->ports[pseudo_port];
+    struct epoll_event event = {.events = EPOLLOUT, .data.u64 = pseudo_port};
+    int rc;
+
+    if (port->watched == watch)
+    {
+        return;
+    }
+    rc = epoll_ctl(loop->epoll_fd, watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, port->mqd, &event);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    port->watched = watch;
+}
+
+static void close_port(ev_loop_t *loop, uint8_t pseudo_port)
+{
+    ev_port_t *port = &loop->ports[pseudo_port];
+
+    if (!port->open)
+    {
+        return;
+    }
+    watch_port(loop, pseudo_port, false);
+    while (port->head != NULL)
+    {
+        ev_reply_t *reply = port->head;
+        port->head = reply->next;
+        free(reply);
+        loop->dropped++;
+    }
+    port->tail = NULL;
+    port->pending_no = 0;
+    int rc = mq_close(port->mqd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    port->open = false;
+    loop->open_no--;
+}
+
+/* Sends the replies waiting for pseudo_port, as many as fit. */
+static void flush_port(ev_loop_t *loop, uint8_t pseudo_port)
+{
+    ev_port_t *port = &loop->ports[pseudo_port];
+
+    while (port->head != NULL)
+    {
+        ev_reply_t *reply = port->head;
+        int rc = mq_send(port->mqd, reply->msg, reply->len, MQ_DEFAULT_PRIO);
+        if (-1 == rc)
+        {
+            if (EAGAIN == errno)
+            {
+                return;
+            }
+            handle_error();
+        }
+        port->head = reply->next;
+        port->pending_no--;
+        free(reply);
+    }
+    port->tail = NULL;
+    watch_port(loop, pseudo_port, false);
+}
+
+/* Reads up to EV_BATCH_MAX requests, so waiting replies get their turn.
+ * The queue stays readable if more are left. True stops the loop. */
+static bool read_requests(ev_loop_t *loop)
+{
+    char buf[MQ_MSGSIZE + 1];
+    unsigned int prio;
+
+    for (unsigned int i = 0; i < EV_BATCH_MAX; i++)
+    {
+        ssize_t len = mq_receive(loop->req_mq, buf, sizeof(buf), &prio);
+        if (-1 == len)
+        {
+            if (EAGAIN == errno)
+            {
+                break;
+            }
+            handle_error();
+        }
+        loop->requests++;
+        if (loop->on_request(buf, len, prio, loop->ctx))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void tick(ev_loop_t *loop)
+{
+    uint64_t now = get_monotonic_ns();
+    uint64_t ttl_ns = DB_ENTRY_TTL * 1000000000ull;
+
+    for (unsigned int i = 0; i < EV_PORTS_NO; i++)
+    {
+        ev_port_t *port = &loop->ports[i];
+        if (!port->open)
+        {
+            continue;
+        }
+        while (port->head != NULL && now - port->head->queued_ns > ttl_ns)
+        {
+            ev_reply_t *reply = port->head;
+            port->head = reply->next;
+            port->pending_no--;
+            free(reply);
+            loop->expired++;
+        }
+        if (NULL == port->head)
+        {
+            port->tail = NULL;
+            watch_port(loop, i, false);
+            if (now - port->last_used_ns > loop->idle_ns)
+            {
+                close_port(loop, i);
+            }
+        }
+    }
+}
+
+int ev_loop_init(ev_loop_t *loop, mqd_t req_mq, ev_request_f on_request, void *ctx,
+        unsigned int idle_sec)
+{
+    struct mq_attr attr = {.mq_flags = O_NONBLOCK};
+    struct epoll_event event = {.events = EPOLLIN};
+    struct itimerspec period = {
+        .it_interval = {.tv_sec = EV_TICK_MS / 1000, .tv_nsec = EV_TICK_MS % 1000 * 1000000},
+        .it_value = {.tv_sec = EV_TICK_MS / 1000, .tv_nsec = EV_TICK_MS % 1000 * 1000000}
+    };
+    int rc;
+
+    memset(loop, 0, sizeof(*loop));
+    loop->req_mq = req_mq;
+    loop->on_request = on_request;
+    loop->ctx = ctx;
+    loop->idle_ns = idle_sec * 1000000000ull;
+
+    rc = mq_setattr(req_mq, &attr, NULL);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (-1 == loop->epoll_fd)
+    {
+        handle_error();
+    }
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (-1 == loop->timer_fd)
+    {
+        handle_error();
+    }
+    rc = timerfd_settime(loop->timer_fd, 0, &period, NULL);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    event.data.u64 = EV_TAG_REQUEST;
+    rc = epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, req_mq, &event);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    event.data.u64 = EV_TAG_TIMER;
+    rc = epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->timer_fd, &event);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    return 0;
+}
+
+void ev_loop_run(ev_loop_t *loop)
+{
+    struct epoll_event events[EV_EVENTS_MAX];
+
+    for (;;)
+    {
+        int events_no = epoll_wait(loop->epoll_fd, events, EV_EVENTS_MAX, -1);
+        if (-1 == events_no)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            handle_error();
+        }
+        for (int i = 0; i < events_no; i++)
+        {
+            uint64_t tag = events[i].data.u64;
+            if (EV_TAG_REQUEST == tag)
+            {
+                if (read_requests(loop))
+                {
+                    return;
+                }
+            }
+            else if (EV_TAG_TIMER == tag)
+            {
+                uint64_t expirations;
+                ssize_t chr_no = read(loop->timer_fd, &expirations, sizeof(expirations));
+                if (-1 == chr_no && errno != EAGAIN)
+                {
+                    handle_error();
+                }
+                tick(loop);
+            }
+            else if (loop->ports[tag].watched)
+            {
+                /* Not closed by an earlier event of this batch. */
+                flush_port(loop, tag);
+            }
+        }
+    }
+}
+
+bool ev_loop_reply(ev_loop_t *loop, uint8_t pseudo_port, pid_t pid,
+        const void *msg, size_t len)
+{
+    ev_port_t *port = &loop->ports[pseudo_port];
+    int rc;
+
+    if (port->open && port->pid != pid)
+    {
+        /* A new client on the same pseudo_port, with a new queue. */
+        close_port(loop, pseudo_port);
+    }
+    if (!port->open)
+    {
+        char client_mq_name[MAX_MQUEUE_NAME] = {0};
+        rc = get_client_mq_name(client_mq_name, sizeof(client_mq_name), pseudo_port);
+        if (rc < 0 || (unsigned int)rc > sizeof(client_mq_name))
+        {
+            handle_error();
+        }
+        port->mqd = mq_open(client_mq_name, O_WRONLY | O_NONBLOCK);
+        if (-1 == port->mqd)
+        {
+            loop->dropped++;
+            return false;
+        }
+        port->pid = pid;
+        port->open = true;
+        loop->open_no++;
+    }
+    port->last_used_ns = get_monotonic_ns();
+
+    if (NULL == port->head)
+    {
+        rc = mq_send(port->mqd, msg, len, MQ_DEFAULT_PRIO);
+        if (0 == rc)
+        {
+            loop->sent++;
+            return true;
+        }
+        if (errno != EAGAIN)
+        {
+            handle_error();
+        }
+    }
+    if (port->pending_no >= EV_PENDING_MAX)
+    {
+        loop->dropped++;
+        return false;
+    }
+    ev_reply_t *reply = malloc(sizeof(*reply) + len);
+    if (NULL == reply)
+    {
+        handle_error_en(ENOMEM);
+    }
+    reply->next = NULL;
+    reply->queued_ns = port->last_used_ns;
+    reply->len = len;
+    memcpy(reply->msg, msg, len);
+    if (NULL == port->tail)
+    {
+        port->head = reply;
+    }
+    else
+    {
+        port->tail->next = reply;
+    }
+    port->tail = reply;
+    port->pending_no++;
+    loop->deferred++;
+    watch_port(loop, pseudo_port, true);
+    return true;
+}
+
+void ev_loop_drain(ev_loop_t *loop, unsigned int timeout_ms)
+{
+    struct epoll_event events[EV_EVENTS_MAX];
+    uint64_t deadline = get_monotonic_ns() + timeout_ms * 1000000ull;
+    int rc;
+
+    /* Both would stay ready, requests are left for whoever reads req_mq
+     * now. Closing req_mq already removed it. */
+    rc = epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, loop->req_mq, NULL);
+    if (-1 == rc && errno != EBADF)
+    {
+        handle_error();
+    }
+    rc = epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, loop->timer_fd, NULL);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    for (;;)
+    {
+        unsigned int watched_no = 0;
+        for (unsigned int i = 0; i < EV_PORTS_NO; i++)
+        {
+            watched_no += loop->ports[i].watched;
+        }
+        uint64_t now = get_monotonic_ns();
+        if (0 == watched_no || now >= deadline)
+        {
+            return;
+        }
+        int events_no = epoll_wait(loop->epoll_fd, events, EV_EVENTS_MAX,
+                (deadline - now + 999999) / 1000000);
+        if (-1 == events_no)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            handle_error();
+        }
+        for (int i = 0; i < events_no; i++)
+        {
+            uint64_t tag = events[i].data.u64;
+            if (loop->ports[tag].watched)
+            {
+                flush_port(loop, tag);
+            }
+        }
+    }
+}
+
+void ev_loop_destroy(ev_loop_t *loop)
+{
+    for (unsigned int i = 0; i < EV_PORTS_NO; i++)
+    {
+        close_port(loop, i);
+    }
+    int rc = close(loop->timer_fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    rc = close(loop->epoll_fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
+
+void ev_loop_print_stats(const ev_loop_t *loop, FILE *out)
+{
+    fprintf(out, "Event loop: requests %llu; replies sent %llu; deferred %llu;"
+            " expired %llu; dropped %llu; client queues open %u\n",
+            (unsigned long long)loop->requests, (unsigned long long)loop->sent,
+            (unsigned long long)loop->deferred, (unsigned long long)loop->expired,
+            (unsigned long long)loop->dropped, loop->open_no);
+}
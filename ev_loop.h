@@ -0,0 +1,204 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file ev_loop.h
+*
+* \brief Single threaded event loop serving one request queue with epoll.
+*        Requests are read without blocking and handed to a callback, which
+*        answers through ev_loop_reply. Replies go out on non-blocking client
+*        queues; a reply that finds its queue full waits in the loop until
+*        the queue becomes writable, instead of blocking a thread in
+*        mq_timedsend. A timerfd ticks once a second to drop replies waiting
+*        longer than DB_ENTRY_TTL and to close idle client queues.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef EV_LOOP_H
+#define EV_LOOP_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <mqueue.h>
+#include <sys/types.h>  /* For pid_t and ssize_t */
+
+#define EV_PORTS_NO (UINT8_MAX + 1) /**< One client queue for every pseudo_port. */
+#define EV_PENDING_MAX 64   /**< Replies waiting for one client, at most. */
+#define EV_EVENTS_MAX 64    /**< Events taken from one epoll_wait. */
+#define EV_BATCH_MAX 64     /**< Requests read for one readiness event. */
+#define EV_TICK_MS 1000
+
+/*
+*******************************************************************************
+*   ev_request_f
+*******************************************************************************
+*
+*  \brief           <b> ev_request_f </b>\n
+*                   Called by the loop for every request read, with its
+*                   mq priority. The queue hands out the highest priority
+*                   first, the loop keeps that order.
+*
+*  \return          true stops the loop.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef bool (*ev_request_f)(const char *buf, ssize_t len, unsigned int prio, void *ctx);
+
+/*
+*******************************************************************************
+*   ev_reply_t / ev_port_t
+*******************************************************************************
+*
+*  \brief           <b> ev_reply_t / ev_port_t </b>\n
+*                   A reply waiting for room in its client queue, and the
+*                   queue of one pseudo_port with the replies waiting for
+*                   it, oldest first. Private to ev_loop.c.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct ev_reply {
+    struct ev_reply *next;
+    uint64_t queued_ns;
+    size_t len;
+    char msg[];
+} ev_reply_t;
+
+typedef struct {
+    mqd_t mqd;
+    pid_t pid;
+    bool open;
+    bool watched;           /**< Registered for EPOLLOUT. */
+    uint64_t last_used_ns;
+    ev_reply_t *head;
+    ev_reply_t *tail;
+    unsigned int pending_no;
+} ev_port_t;
+
+/*
+*******************************************************************************
+*   ev_loop_t
+*******************************************************************************
+*
+*  \brief           <b> ev_loop_t </b>\n
+*                   The loop. Treat the members as private. Only the thread
+*                   running it may use it.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    int epoll_fd;
+    int timer_fd;
+    mqd_t req_mq;
+    ev_request_f on_request;
+    void *ctx;
+    uint64_t idle_ns;
+    unsigned int open_no;
+    ev_port_t ports[EV_PORTS_NO];
+
+    /* Statistics. */
+    uint64_t requests;
+    uint64_t sent;          /**< Replies sent at once. */
+    uint64_t deferred;      /**< Replies that had to wait for room. */
+    uint64_t expired;       /**< Waited longer than DB_ENTRY_TTL. */
+    uint64_t dropped;       /**< Over EV_PENDING_MAX, or the client left. */
+} ev_loop_t;
+
+/*
+*******************************************************************************
+*   ev_loop_init
+*******************************************************************************
+*
+*  \brief           <b> ev_loop_init </b>\n
+*                   Prepares a loop reading req_mq, which it switches to
+*                   non-blocking mode.
+*
+*  \param[in]       unsigned int idle_sec  Client queues unused this long
+*                                          are closed.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int ev_loop_init(ev_loop_t *loop, mqd_t req_mq, ev_request_f on_request, void *ctx,
+        unsigned int idle_sec);
+
+/*
+*******************************************************************************
+*   ev_loop_run
+*******************************************************************************
+*
+*  \brief           <b> ev_loop_run </b>\n
+*                   Runs the loop in the calling thread until on_request
+*                   returns true.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void ev_loop_run(ev_loop_t *loop);
+
+/*
+*******************************************************************************
+*   ev_loop_reply
+*******************************************************************************
+*
+*  \brief           <b> ev_loop_reply </b>\n
+*                   Sends msg to the queue of pseudo_port, never blocking. If
+*                   the queue is full the reply waits in the loop, behind any
+*                   earlier one for the same client. Called from on_request.
+*
+*  \return          false if the reply was dropped: the client queue could
+*                   not be opened or too many replies wait for it.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+bool ev_loop_reply(ev_loop_t *loop, uint8_t pseudo_port, pid_t pid,
+        const void *msg, size_t len);
+
+/*
+*******************************************************************************
+*   ev_loop_drain
+*******************************************************************************
+*
+*  \brief           <b> ev_loop_drain </b>\n
+*                   Once the loop stopped, sends the replies still waiting
+*                   as their client queues get room, for up to timeout_ms.
+*                   Requests are not read any more.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void ev_loop_drain(ev_loop_t *loop, unsigned int timeout_ms);
+
+/*
+*******************************************************************************
+*   ev_loop_destroy / ev_loop_print_stats
+*******************************************************************************
+*
+*  \brief           <b> ev_loop_destroy / ev_loop_print_stats </b>\n
+*                   Close the client queues, dropping the replies still
+*                   waiting, and the loop's descriptors; print the counters.
+*                   req_mq is left open.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void ev_loop_destroy(ev_loop_t *loop);
+void ev_loop_print_stats(const ev_loop_t *loop, FILE *out);
+
+#endif /* EV_LOOP_H */
@@ -0,0 +1,344 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file handoff.c
+*
+* \brief Implements the hot restart handoff declared in handoff.h over a
+*        SOCK_SEQPACKET socket, so the request, and the reply with its
+*        descriptors, each arrive as one message.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#define _GNU_SOURCE         /* For accept4 */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "utils.h"
+#include "handoff.h"
+
+static void get_address(struct sockaddr_un *addr);
+static void send_status(int conn_fd, int status);
+static int recv_request(handoff_t *handoff, int conn_fd, handoff_request_t *request);
+static void *listen_f(void *arg);
+
+static void get_address(struct sockaddr_un *addr)
+{
+    static_assert(sizeof(HANDOFF_SOCKET_NAME) <= sizeof(addr->sun_path),
+            "HANDOFF_SOCKET_NAME is too long\n");
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    memcpy(addr->sun_path, HANDOFF_SOCKET_NAME, sizeof(HANDOFF_SOCKET_NAME));
+}
+
+/* Refuses. Never blocks, and a peer that left or does not read does not
+ * matter: the reply is only a courtesy. */
+static void send_status(int conn_fd, int status)
+{
+    handoff_reply_t reply = {.status = status};
+
+    (void)send(conn_fd, &reply, sizeof(reply), MSG_NOSIGNAL | MSG_DONTWAIT);
+    int rc = close(conn_fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
+
+/* Any local process can connect: one that stays silent, sends garbage or
+ * vanishes is dropped, never waited on past HANDOFF_RECV_MS or the close.
+ * Returns 0 with the request, ETIMEDOUT or EPROTO for a bad peer and
+ * ECANCELED when closing. */
+static int recv_request(handoff_t *handoff, int conn_fd, handoff_request_t *request)
+{
+    struct pollfd fds[2] = {
+        {.fd = conn_fd, .events = POLLIN},
+        {.fd = handoff->wake_fd, .events = POLLIN}
+    };
+
+    int rc = poll(fds, 2, HANDOFF_RECV_MS);
+    if (-1 == rc && errno != EINTR)
+    {
+        handle_error();
+    }
+    if (fds[1].revents != 0)
+    {
+        return ECANCELED;
+    }
+    if (rc <= 0)
+    {
+        return ETIMEDOUT;
+    }
+    ssize_t chr_no = recv(conn_fd, request, sizeof(*request), MSG_DONTWAIT);
+    if (chr_no != sizeof(*request) || request->magic != HANDOFF_MAGIC)
+    {
+        return EPROTO;
+    }
+    return 0;
+}
+
+static void *listen_f(void *arg)
+{
+    handoff_t *handoff = arg;
+    handoff_request_t request;
+
+    for (;;)
+    {
+        int conn_fd = accept4(handoff->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (-1 == conn_fd)
+        {
+            if (atomic_load(&handoff->closing))
+            {
+                return NULL;
+            }
+            if (EINTR == errno || ECONNABORTED == errno)
+            {
+                continue;
+            }
+            handle_error();
+        }
+        int status = recv_request(handoff, conn_fd, &request);
+        if (ECANCELED == status)
+        {
+            send_status(conn_fd, status);
+            return NULL;
+        }
+        if (0 == status)
+        {
+            status = handoff->check(&request, handoff->ctx);
+        }
+        if (status != 0)
+        {
+            send_status(conn_fd, status);
+            continue;
+        }
+        handoff->conn_fd = conn_fd;
+        atomic_store(&handoff->accepted, true);
+        handoff->stop(handoff->ctx);
+        return NULL;
+    }
+}
+
+int handoff_listen(handoff_t *handoff, handoff_check_f check, handoff_stop_f stop,
+        void *ctx)
+{
+    struct sockaddr_un addr;
+    int rc;
+
+    memset(handoff, 0, sizeof(*handoff));
+    handoff->conn_fd = -1;
+    handoff->check = check;
+    handoff->stop = stop;
+    handoff->ctx = ctx;
+    atomic_init(&handoff->accepted, false);
+    atomic_init(&handoff->closing, false);
+
+    handoff->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (-1 == handoff->wake_fd)
+    {
+        handle_error();
+    }
+    get_address(&addr);
+    handoff->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (-1 == handoff->listen_fd)
+    {
+        handle_error();
+    }
+    rc = unlink(HANDOFF_SOCKET_NAME);
+    if (-1 == rc && errno != ENOENT)
+    {
+        handle_error();
+    }
+    rc = bind(handoff->listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    rc = listen(handoff->listen_fd, 1);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    rc = pthread_create(&handoff->thread, NULL, listen_f, handoff);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    return 0;
+}
+
+bool handoff_accepted(handoff_t *handoff)
+{
+    return atomic_load(&handoff->accepted);
+}
+
+int handoff_send(handoff_t *handoff, uint32_t tokens_no, const int *fds, unsigned int fds_no)
+{
+    handoff_reply_t reply = {.status = 0, .tokens_no = tokens_no, .fds_no = fds_no};
+    struct iovec iov = {.iov_base = &reply, .iov_len = sizeof(reply)};
+    union {
+        char buf[CMSG_SPACE(HANDOFF_FDS_MAX * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = CMSG_SPACE(fds_no * sizeof(int))
+    };
+    int rc;
+
+    if (fds_no > HANDOFF_FDS_MAX)
+    {
+        handle_error_en(EINVAL);
+    }
+    memset(&control, 0, sizeof(control));
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fds_no * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, fds_no * sizeof(int));
+
+    ssize_t chr_no = sendmsg(handoff->conn_fd, &msg, MSG_NOSIGNAL);
+    if (-1 == chr_no && errno != EPIPE && errno != ECONNRESET)
+    {
+        handle_error();
+    }
+    for (unsigned int i = 0; i < fds_no; i++)
+    {
+        rc = close(fds[i]);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+    }
+    rc = close(handoff->conn_fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    handoff->conn_fd = -1;
+    return -1 == chr_no ? -1 : 0;
+}
+
+void handoff_close(handoff_t *handoff)
+{
+    int rc;
+
+    if (!handoff_accepted(handoff))
+    {
+        /* Wakes the thread in accept, or waiting for a request. */
+        atomic_store(&handoff->closing, true);
+        rc = shutdown(handoff->listen_fd, SHUT_RDWR);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+        uint64_t one = 1;
+        ssize_t chr_no = write(handoff->wake_fd, &one, sizeof(one));
+        if (-1 == chr_no)
+        {
+            handle_error();
+        }
+    }
+    rc = pthread_join(handoff->thread, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = close(handoff->listen_fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    rc = close(handoff->wake_fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    if (!handoff_accepted(handoff))
+    {
+        rc = unlink(HANDOFF_SOCKET_NAME);
+        if (-1 == rc && errno != ENOENT)
+        {
+            handle_error();
+        }
+    }
+}
+
+int handoff_take(const handoff_request_t *request, handoff_reply_t *reply, int *fds)
+{
+    struct sockaddr_un addr;
+    struct iovec iov = {.iov_base = reply, .iov_len = sizeof(*reply)};
+    union {
+        char buf[CMSG_SPACE(HANDOFF_FDS_MAX * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buf,
+        .msg_controllen = sizeof(control.buf)
+    };
+    int rc;
+
+    get_address(&addr);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (-1 == fd)
+    {
+        handle_error();
+    }
+    rc = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (-1 == rc)
+    {
+        if (ENOENT == errno || ECONNREFUSED == errno)
+        {
+            int en = errno;
+            close(fd);
+            errno = en;
+            return -1;
+        }
+        handle_error();
+    }
+    ssize_t chr_no = send(fd, request, sizeof(*request), MSG_NOSIGNAL);
+    if (-1 == chr_no)
+    {
+        handle_error();
+    }
+    /* As long as the running server takes to drain. */
+    chr_no = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (-1 == chr_no)
+    {
+        handle_error();
+    }
+    if ((size_t)chr_no != sizeof(*reply))
+    {
+        /* The running server died before answering. */
+        handle_error_en(ECONNRESET);
+    }
+    unsigned int fds_no = 0;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && SOL_SOCKET == cmsg->cmsg_level && SCM_RIGHTS == cmsg->cmsg_type)
+    {
+        fds_no = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cmsg), fds_no * sizeof(int));
+    }
+    if ((msg.msg_flags & MSG_CTRUNC) || (0 == reply->status && fds_no != reply->fds_no))
+    {
+        handle_error_en(EPROTO);
+    }
+    rc = close(fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    return 0;
+}
@@ -0,0 +1,209 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file handoff.h
+*
+* \brief Hot restart of the server. A running server listens on the Unix
+*        socket HANDOFF_SOCKET_NAME; a new server started to replace it
+*        connects, says how it is configured and, once the running server
+*        agreed and stopped serving, receives its request queue descriptors
+*        and its database state as file descriptors (SCM_RIGHTS). Requests
+*        sent meanwhile wait in the queues, which are never removed.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "constants.h"
+
+#define HANDOFF_MAGIC 0x544F4B48u  /**< "TOKH", first word of a request. */
+#define HANDOFF_FDS_MAX (SHARDS_MAX + 2) /**< Queues of every shard, the main
+                                              one and the database state. */
+#define HANDOFF_RECV_MS 1000       /**< A new server sends its request at once,
+                                        a silent peer is dropped after this. */
+
+/*
+*******************************************************************************
+*   handoff_request_t / handoff_reply_t
+*******************************************************************************
+*
+*  \brief           <b> handoff_request_t / handoff_reply_t </b>\n
+*                   What the new server asks with and what it gets back,
+*                   with fds_no descriptors when status is 0.
+*
+*  \var             tokens_no                         In the request, 0 takes
+*                                                     the running server's.
+*
+*  \var             status                            0, or the errno why the
+*                                                     running server refused.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    uint32_t magic;
+    uint32_t backend;
+    uint32_t tokens_no;
+    uint32_t shards_no;
+    uint32_t use_ring;
+} handoff_request_t;
+
+typedef struct {
+    int32_t status;
+    uint32_t tokens_no;
+    uint32_t fds_no;
+} handoff_reply_t;
+
+/*
+*******************************************************************************
+*   handoff_check_f / handoff_stop_f
+*******************************************************************************
+*
+*  \brief           <b> handoff_check_f / handoff_stop_f </b>\n
+*                   Called by the listening thread for every new server
+*                   asking, and once one is accepted, after
+*                   handoff_accepted turned true. stop has to make the
+*                   server stop serving and call handoff_send.
+*
+*  \return          check returns 0 to accept, or the errno sent back to
+*                   refuse.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef int (*handoff_check_f)(const handoff_request_t *request, void *ctx);
+typedef void (*handoff_stop_f)(void *ctx);
+
+/*
+*******************************************************************************
+*   handoff_t
+*******************************************************************************
+*
+*  \brief           <b> handoff_t </b>\n
+*                   The listening side. Treat the members as private.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    int listen_fd;
+    int wake_fd;            /**< eventfd waking the thread out of a recv. */
+    int conn_fd;            /**< The accepted new server, -1 before. */
+    handoff_check_f check;
+    handoff_stop_f stop;
+    void *ctx;
+    pthread_t thread;
+    atomic_bool accepted;
+    atomic_bool closing;
+} handoff_t;
+
+/*
+*******************************************************************************
+*   handoff_listen
+*******************************************************************************
+*
+*  \brief           <b> handoff_listen </b>\n
+*                   Binds HANDOFF_SOCKET_NAME, replacing the socket of a
+*                   previous server, and starts a thread waiting for a new
+*                   server. The thread stops once one is accepted.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int handoff_listen(handoff_t *handoff, handoff_check_f check, handoff_stop_f stop,
+        void *ctx);
+
+/*
+*******************************************************************************
+*   handoff_accepted
+*******************************************************************************
+*
+*  \brief           <b> handoff_accepted </b>\n
+*                   True once a new server was accepted.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+bool handoff_accepted(handoff_t *handoff);
+
+/*
+*******************************************************************************
+*   handoff_send
+*******************************************************************************
+*
+*  \brief           <b> handoff_send </b>\n
+*                   Sends the descriptors to the accepted new server and
+*                   closes them, and the connection. From then on the new
+*                   server owns what they refer to.
+*
+*  \return          0                      Success.
+*
+*  \return          -1                     The new server is gone. Other
+*                                          errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int handoff_send(handoff_t *handoff, uint32_t tokens_no, const int *fds, unsigned int fds_no);
+
+/*
+*******************************************************************************
+*   handoff_close
+*******************************************************************************
+*
+*  \brief           <b> handoff_close </b>\n
+*                   Stops the listening thread and closes its socket, so
+*                   handoff_accepted does not change any more. The socket
+*                   name is removed unless a new server was accepted: it is
+*                   the new server's then, and handoff_send is still due.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void handoff_close(handoff_t *handoff);
+
+/*
+*******************************************************************************
+*   handoff_take
+*******************************************************************************
+*
+*  \brief           <b> handoff_take </b>\n
+*                   For the new server: asks the running one to hand over
+*                   and waits until it has stopped serving and sent its
+*                   descriptors.
+*
+*  \param[out]      int *fds               reply->fds_no descriptors, at
+*                                          most HANDOFF_FDS_MAX.
+*
+*  \return          0                      reply is filled; the handoff
+*                                          was refused unless its status
+*                                          is 0.
+*
+*  \return          -1                     errno ENOENT or ECONNREFUSED, no
+*                                          server is listening. Other
+*                                          errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int handoff_take(const handoff_request_t *request, handoff_reply_t *reply, int *fds);
+
+#endif /* HANDOFF_H */
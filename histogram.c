@@ -0,0 +1,114 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file histogram.c
+*
+* \brief Implements the histogram declared in histogram.h. Values below
+*        HIST_SUB_NO have a bucket each; above that a value with its highest
+*        bit at position b lands in one of the HIST_SUB_NO buckets of width
+*        2^(b - HIST_SUB_BITS) covering its power of two.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include "histogram.h"
+
+static unsigned int get_bucket(uint64_t value);
+static uint64_t get_bucket_high(unsigned int bucket);
+
+static unsigned int get_bucket(uint64_t value)
+{
+    if (value < HIST_SUB_NO)
+    {
+        return (unsigned int)value;
+    }
+    unsigned int shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_NO + (unsigned int)(value >> shift) - HIST_SUB_NO;
+}
+
+/* Largest value that lands in bucket. */
+static uint64_t get_bucket_high(unsigned int bucket)
+{
+    if (bucket < HIST_SUB_NO)
+    {
+        return bucket;
+    }
+    unsigned int shift = bucket / HIST_SUB_NO - 1;
+    uint64_t mantissa = bucket % HIST_SUB_NO + HIST_SUB_NO;
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void hist_record(hist_t *hist, uint64_t value)
+{
+    atomic_fetch_add_explicit(&hist->counts[get_bucket(value)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->total, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->sum, value, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&hist->max, memory_order_relaxed);
+    while (value > max &&
+           !atomic_compare_exchange_weak_explicit(&hist->max, &max, value,
+               memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+void hist_merge(hist_t *dst, const hist_t *src)
+{
+    for (unsigned int i = 0; i < HIST_BUCKETS_NO; i++)
+    {
+        uint64_t count = atomic_load_explicit(&src->counts[i], memory_order_relaxed);
+        if (count != 0)
+        {
+            atomic_fetch_add_explicit(&dst->counts[i], count, memory_order_relaxed);
+        }
+    }
+    atomic_fetch_add_explicit(&dst->total, atomic_load(&src->total), memory_order_relaxed);
+    atomic_fetch_add_explicit(&dst->sum, atomic_load(&src->sum), memory_order_relaxed);
+    uint64_t src_max = atomic_load(&src->max);
+    uint64_t max = atomic_load_explicit(&dst->max, memory_order_relaxed);
+    while (src_max > max &&
+           !atomic_compare_exchange_weak_explicit(&dst->max, &max, src_max,
+               memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+uint64_t hist_percentile(const hist_t *hist, double q)
+{
+    uint64_t total = atomic_load(&hist->total);
+    uint64_t max = atomic_load(&hist->max);
+    uint64_t seen = 0;
+
+    if (0 == total)
+    {
+        return 0;
+    }
+    /* Rank of the value asked for, from 1. */
+    uint64_t rank = (uint64_t)(q * total);
+    if ((double)rank < q * total)
+    {
+        rank++;
+    }
+    if (0 == rank)
+    {
+        rank = 1;
+    }
+    for (unsigned int i = 0; i < HIST_BUCKETS_NO; i++)
+    {
+        seen += atomic_load_explicit(&hist->counts[i], memory_order_relaxed);
+        if (seen >= rank)
+        {
+            uint64_t high = get_bucket_high(i);
+            return high < max ? high : max;
+        }
+    }
+    return max;
+}
+
+double hist_mean(const hist_t *hist)
+{
+    uint64_t total = atomic_load(&hist->total);
+    return total ? (double)atomic_load(&hist->sum) / total : 0.0;
+}
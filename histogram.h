@@ -0,0 +1,105 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file histogram.h
+*
+* \brief Log-linear latency histogram. Every power of two is split into
+*        HIST_SUB_NO buckets, so any value is known within about 3%. Recording
+*        is one relaxed atomic increment, so several threads, or processes
+*        sharing the memory, may record into the same histogram.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB_NO (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS_NO ((64 - HIST_SUB_BITS + 1) * HIST_SUB_NO) /**< All of uint64_t. */
+
+/*
+*******************************************************************************
+*   hist_t
+*******************************************************************************
+*
+*  \brief           <b> hist_t </b>\n
+*                   The histogram. All zeroes is an empty histogram.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    _Atomic uint64_t counts[HIST_BUCKETS_NO];
+    _Atomic uint64_t total;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+} hist_t;
+
+/*
+*******************************************************************************
+*   hist_record
+*******************************************************************************
+*
+*  \brief           <b> hist_record </b>\n
+*                   Adds one value.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void hist_record(hist_t *hist, uint64_t value);
+
+/*
+*******************************************************************************
+*   hist_merge
+*******************************************************************************
+*
+*  \brief           <b> hist_merge </b>\n
+*                   Adds every value of src to dst.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void hist_merge(hist_t *dst, const hist_t *src);
+
+/*
+*******************************************************************************
+*   hist_percentile
+*******************************************************************************
+*
+*  \brief           <b> hist_percentile </b>\n
+*                   Value below which a fraction q, 0 to 1, of the values
+*                   fall. It is the upper end of the bucket holding it, and
+*                   never more than the largest value recorded.
+*
+*  \return          The value, 0 for an empty histogram.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+uint64_t hist_percentile(const hist_t *hist, double q);
+
+/*
+*******************************************************************************
+*   hist_mean
+*******************************************************************************
+*
+*  \brief           <b> hist_mean </b>\n
+*                   Exact mean of the values recorded, 0 if none.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+double hist_mean(const hist_t *hist);
+
+#endif /* HISTOGRAM_H */
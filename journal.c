@@ -0,0 +1,369 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file journal.c
+*
+* \brief Implements the group commit journal declared in journal.h.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdlib.h>         /* For malloc() and exit() */
+#include <string.h>
+#include <fcntl.h>          /* For O_* constants */
+#include <sys/stat.h>       /* For struct stat */
+#include <unistd.h>
+#include <assert.h>
+#include "utils.h"
+#include "constants.h"
+#include "journal.h"
+
+#define JOURNAL_INIT_CAP 64
+#define JOURNAL_READ_RECS 256
+
+static uint32_t rec_check(const journal_rec_t *rec);
+static void write_all(int fd, const void *buf, size_t len, off_t off);
+static void flush_pending(journal_t *j);
+static int open_journal(journal_t *j, const char *path, bool keep,
+        journal_checkpoint_t checkpoint, void *ctx);
+
+static uint32_t rec_check(const journal_rec_t *rec)
+{
+    /* FNV-1a over every field but check. */
+    static_assert(offsetof(journal_rec_t, check) + sizeof(uint32_t) == sizeof(journal_rec_t),
+            "check must be the last field of journal_rec_t\n");
+    const unsigned char *bytes = (const unsigned char *)rec;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < offsetof(journal_rec_t, check); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void write_all(int fd, const void *buf, size_t len, off_t off)
+{
+    const char *pos = buf;
+    while (len > 0)
+    {
+        ssize_t chr_no = pwrite(fd, pos, len, off);
+        if (-1 == chr_no)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            handle_error();
+        }
+        pos += chr_no;
+        off += chr_no;
+        len -= chr_no;
+    }
+}
+
+/* Called with lock held and flushing not set. Returns with lock held. */
+static void flush_pending(journal_t *j)
+{
+    journal_rec_t *recs = j->pending;
+    unsigned int recs_no = j->pending_no;
+    unsigned int cap = j->pending_cap;
+    uint64_t upto = j->appended_seq;
+    int rc;
+
+    j->flushing = true;
+    j->pending = j->spare;
+    j->pending_cap = j->spare_cap;
+    j->pending_no = 0;
+    j->spare = recs;
+    j->spare_cap = cap;
+    rc = pthread_mutex_unlock(&j->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+
+    size_t len = recs_no * sizeof(*recs);
+    write_all(j->fd, recs, len, j->file_off);
+    j->file_off += len;
+    rc = fdatasync(j->fd);
+    if (rc != 0)
+    {
+        handle_error();
+    }
+    bool checkpointed = false;
+    if (j->file_off >= JOURNAL_CHECKPOINT_BYTES)
+    {
+        j->checkpoint(j->ctx);
+        rc = ftruncate(j->fd, 0);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+        /* Old records must not come back after a crash. */
+        rc = fsync(j->fd);
+        if (rc != 0)
+        {
+            handle_error();
+        }
+        j->file_off = 0;
+        checkpointed = true;
+    }
+
+    rc = pthread_mutex_lock(&j->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    j->durable_seq = upto;
+    j->syncs++;
+    if (checkpointed)
+    {
+        j->checkpoints++;
+    }
+    j->flushing = false;
+    rc = pthread_cond_broadcast(&j->durable_cond);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+}
+
+uint64_t journal_replay(const char *path, journal_replay_t replay, void *ctx)
+{
+    journal_rec_t recs[JOURNAL_READ_RECS];
+    uint64_t replayed = 0;
+    bool torn = false;
+    int fd;
+    int rc;
+
+    fd = open(path, O_RDONLY | O_NOFOLLOW);
+    if (-1 == fd)
+    {
+        if (ENOENT == errno)
+        {
+            return 0;
+        }
+        handle_error();
+    }
+    while (!torn)
+    {
+        ssize_t chr_no = read(fd, recs, sizeof(recs));
+        if (-1 == chr_no)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            handle_error();
+        }
+        if (0 == chr_no)
+        {
+            break;
+        }
+        /* A short read only happens at the end of the file. */
+        size_t recs_no = chr_no / sizeof(recs[0]);
+        torn = recs_no * sizeof(recs[0]) != (size_t)chr_no;
+        for (size_t i = 0; i < recs_no; i++)
+        {
+            if (rec_check(&recs[i]) != recs[i].check)
+            {
+                torn = true;
+                break;
+            }
+            replay(&recs[i], ctx);
+            replayed++;
+        }
+    }
+    rc = close(fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    return replayed;
+}
+
+int journal_open(journal_t *j, const char *path,
+        journal_checkpoint_t checkpoint, void *ctx)
+{
+    return open_journal(j, path, false, checkpoint, ctx);
+}
+
+int journal_resume(journal_t *j, const char *path,
+        journal_checkpoint_t checkpoint, void *ctx)
+{
+    return open_journal(j, path, true, checkpoint, ctx);
+}
+
+/* With keep, the records already in the file stay and new ones follow. */
+static int open_journal(journal_t *j, const char *path, bool keep,
+        journal_checkpoint_t checkpoint, void *ctx)
+{
+    struct stat st;
+    int rc;
+
+    *j = (journal_t){0};
+    j->checkpoint = checkpoint;
+    j->ctx = ctx;
+    j->fd = open(path, O_CREAT | (keep ? 0 : O_TRUNC) | O_NOFOLLOW | O_WRONLY, MQ_MODE);
+    if (-1 == j->fd)
+    {
+        handle_error();
+    }
+    if (keep)
+    {
+        rc = fstat(j->fd, &st);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+        /* A torn record at the end is written over. */
+        j->file_off = st.st_size - st.st_size % sizeof(journal_rec_t);
+    }
+    j->pending_cap = JOURNAL_INIT_CAP;
+    j->spare_cap = JOURNAL_INIT_CAP;
+    j->pending = malloc(j->pending_cap * sizeof(*j->pending));
+    j->spare = malloc(j->spare_cap * sizeof(*j->spare));
+    if (NULL == j->pending || NULL == j->spare)
+    {
+        handle_error();
+    }
+    rc = pthread_mutex_init(&j->lock, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_cond_init(&j->durable_cond, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    return 0;
+}
+
+uint64_t journal_append(journal_t *j, uint32_t token, int32_t owner, int64_t aq_time)
+{
+    journal_rec_t rec = {
+        .token = token,
+        .owner = owner,
+        .aq_time = aq_time,
+        .reserved = 0
+    };
+    uint64_t seq;
+    int rc;
+
+    rec.check = rec_check(&rec);
+    rc = pthread_mutex_lock(&j->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    if (j->pending_no == j->pending_cap)
+    {
+        journal_rec_t *grown = realloc(j->pending, 2 * j->pending_cap * sizeof(*grown));
+        if (NULL == grown)
+        {
+            handle_error();
+        }
+        j->pending = grown;
+        j->pending_cap *= 2;
+    }
+    j->pending[j->pending_no++] = rec;
+    seq = ++j->appended_seq;
+    rc = pthread_mutex_unlock(&j->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    return seq;
+}
+
+void journal_wait(journal_t *j, uint64_t seq)
+{
+    int rc;
+
+    rc = pthread_mutex_lock(&j->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    while (j->durable_seq < seq)
+    {
+        if (!j->flushing)
+        {
+            flush_pending(j);
+        }
+        else
+        {
+            rc = pthread_cond_wait(&j->durable_cond, &j->lock);
+            if (rc != 0)
+            {
+                handle_error_en(rc);
+            }
+        }
+    }
+    rc = pthread_mutex_unlock(&j->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+}
+
+void journal_flush(journal_t *j)
+{
+    int rc;
+
+    rc = pthread_mutex_lock(&j->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    uint64_t last = j->appended_seq;
+    rc = pthread_mutex_unlock(&j->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    journal_wait(j, last);
+}
+
+int journal_close(journal_t *j)
+{
+    int rc;
+
+    journal_flush(j);
+    rc = close(j->fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    pthread_cond_destroy(&j->durable_cond);
+    pthread_mutex_destroy(&j->lock);
+    free(j->spare);
+    free(j->pending);
+    return 0;
+}
+
+void journal_print_stats(journal_t *j, FILE *out)
+{
+    int rc;
+
+    rc = pthread_mutex_lock(&j->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    fprintf(out, "Journal: records %llu; fdatasync calls %llu; records per call %.2f;"
+            " checkpoints %llu\n",
+            (unsigned long long)j->durable_seq, (unsigned long long)j->syncs,
+            j->syncs ? (double)j->durable_seq / j->syncs : 0.0,
+            (unsigned long long)j->checkpoints);
+    rc = pthread_mutex_unlock(&j->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+}
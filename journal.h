@@ -0,0 +1,229 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file journal.h
+*
+* \brief Append-only journal of token changes with group commit. Records
+*        appended by concurrent threads are written and made durable together
+*        by one fdatasync, done by whichever waiting thread comes first.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdio.h>
+#include <stddef.h>         /* For offsetof */
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/types.h>  /* For off_t */
+
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_CHECKPOINT_BYTES (4u << 20) /**< Truncate past this size. */
+
+/*
+*******************************************************************************
+*   journal_rec_t
+*******************************************************************************
+*
+*  \brief           <b> journal_rec_t </b>\n
+*                   On-disk record. Sets token to owner and aq_time.
+*
+*  \var             check                             Checksum of the other
+*                                                     fields. A torn record at
+*                                                     the end of the file
+*                                                     fails it.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    uint32_t token;
+    int32_t owner;
+    int64_t aq_time;
+    uint32_t reserved;
+    uint32_t check;
+} journal_rec_t;
+
+typedef void (*journal_replay_t)(const journal_rec_t *rec, void *ctx);
+typedef void (*journal_checkpoint_t)(void *ctx);
+
+/*
+*******************************************************************************
+*   journal_t
+*******************************************************************************
+*
+*  \brief           <b> journal_t </b>\n
+*                   An open journal. Treat the members as private.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    int fd;
+    off_t file_off;
+    journal_checkpoint_t checkpoint;
+    void *ctx;
+
+    pthread_mutex_t lock;
+    pthread_cond_t durable_cond;
+    journal_rec_t *pending;     /**< Appended, not written yet. */
+    journal_rec_t *spare;       /**< Swapped with pending by the leader. */
+    unsigned int pending_no;
+    unsigned int pending_cap;
+    unsigned int spare_cap;
+    uint64_t appended_seq;      /**< Sequence of the last appended record. */
+    uint64_t durable_seq;       /**< Every record up to this one is durable. */
+    bool flushing;              /**< A leader is writing right now. */
+
+    /* Statistics, protected by lock. */
+    uint64_t syncs;
+    uint64_t checkpoints;
+} journal_t;
+
+/*
+*******************************************************************************
+*   journal_replay
+*******************************************************************************
+*
+*  \brief           <b> journal_replay </b>\n
+*                   Calls replay for every valid record of the journal at
+*                   path, in order, stopping at the first torn one. A missing
+*                   journal has no records.
+*
+*  \return          Number of records replayed. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+uint64_t journal_replay(const char *path, journal_replay_t replay, void *ctx);
+
+/*
+*******************************************************************************
+*   journal_open
+*******************************************************************************
+*
+*  \brief           <b> journal_open </b>\n
+*                   Creates an empty journal at path, discarding any old
+*                   content. Replay it first. When the journal grows past
+*                   JOURNAL_CHECKPOINT_BYTES checkpoint(ctx) is called, with
+*                   no write in progress, and must make every record already
+*                   in the journal durable elsewhere; the journal is then
+*                   truncated.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int journal_open(journal_t *j, const char *path,
+        journal_checkpoint_t checkpoint, void *ctx);
+
+/*
+*******************************************************************************
+*   journal_resume
+*******************************************************************************
+*
+*  \brief           <b> journal_resume </b>\n
+*                   Like journal_open, but keeps the records of the journal
+*                   at path, closed by another process, and appends after
+*                   them. For a process that took over the state they
+*                   describe, without replaying them.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int journal_resume(journal_t *j, const char *path,
+        journal_checkpoint_t checkpoint, void *ctx);
+
+/*
+*******************************************************************************
+*   journal_append
+*******************************************************************************
+*
+*  \brief           <b> journal_append </b>\n
+*                   Queues a record. It is not durable until journal_wait
+*                   returns for the sequence number given back.
+*
+*  \return          Sequence number of the record.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+uint64_t journal_append(journal_t *j, uint32_t token, int32_t owner, int64_t aq_time);
+
+/*
+*******************************************************************************
+*   journal_wait
+*******************************************************************************
+*
+*  \brief           <b> journal_wait </b>\n
+*                   Returns once record seq is durable. The first waiter
+*                   finding no write in progress writes every pending record
+*                   with one fdatasync; the others wait for it.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void journal_wait(journal_t *j, uint64_t seq);
+
+/*
+*******************************************************************************
+*   journal_flush
+*******************************************************************************
+*
+*  \brief           <b> journal_flush </b>\n
+*                   Makes every record appended so far durable, like
+*                   journal_wait for the last one.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void journal_flush(journal_t *j);
+
+/*
+*******************************************************************************
+*   journal_close
+*******************************************************************************
+*
+*  \brief           <b> journal_close </b>\n
+*                   Makes pending records durable and closes the file. The
+*                   caller checkpoints and removes the file if it wishes.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int journal_close(journal_t *j);
+
+/*
+*******************************************************************************
+*   journal_print_stats
+*******************************************************************************
+*
+*  \brief           <b> journal_print_stats </b>\n
+*                   Prints records, fdatasync calls and records per call.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void journal_print_stats(journal_t *j, FILE *out);
+
+#endif /* JOURNAL_H */
@@ -0,0 +1,978 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file loadgen.c
+*
+* \brief Load generator for the server. Forks one process per connection,
+*        each with its own reply queue, sending a configurable mix of
+*        requests over a configurable token distribution for a fixed time.
+*        In closed-loop mode every process sends its next request as soon as
+*        the previous one is answered. In open-loop mode requests are due on
+*        a fixed schedule and latency is measured from the moment a request
+*        was due, so a slow server is not hidden by the clients slowing
+*        down with it. Prints throughput and latency percentiles as csv or
+*        json.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>         /* For exit() and strtod() */
+#include <string.h>
+#include <strings.h>        /* For strcasecmp */
+#include <stdbool.h>
+#include <stdint.h>
+#include <fcntl.h>          /* For O_* constants */
+#include <sys/stat.h>       /* For mode constants */
+#include <sys/mman.h>       /* For the shared results */
+#include <sys/wait.h>
+#include <unistd.h>
+#include <mqueue.h>
+#include <time.h>
+#include <math.h>
+#include <limits.h>
+#include "utils.h"
+#include "constants.h"
+#include "common.h"
+#include "histogram.h"
+#include "shm_ring.h"
+
+#define LOADGEN_CONNS 4
+#define LOADGEN_SECONDS 5
+#define LOADGEN_FIRST_PORT 128  /**< Clear of the pseudo_ports of client. */
+#define LOADGEN_HELD_MAX 64     /**< Tokens remembered for RELEASE and RENEW. */
+#define LOADGEN_RENEW_TOK 8
+#define LOADGEN_BULK_TOK 4
+#define LOADGEN_REPLY_TIMEOUT_SEC 5
+
+/*
+*******************************************************************************
+*   LOADGEN_OP
+*******************************************************************************
+*
+*  \brief           <b> LOADGEN_OP </b>\n
+*                   Kinds of request in the mix.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef enum {
+    OP_TOKEN,
+    OP_ANY,
+    OP_RELEASE,
+    OP_RENEW,
+    OP_BULK,
+    OP_NO
+} LOADGEN_OP;
+
+typedef enum {
+    DIST_UNIFORM,
+    DIST_HOT,
+    DIST_ZIPF
+} LOADGEN_DIST;
+
+typedef enum {
+    OUT_CSV,
+    OUT_JSON
+} LOADGEN_OUT;
+
+typedef struct {
+    unsigned int conns_no;
+    double rate;                /**< Requests per second over all, 0 closed-loop. */
+    unsigned int seconds;
+    unsigned int tokens_no;     /**< Tokens used, from 0. */
+    LOADGEN_DIST dist;
+    double hot_tokens;          /**< Fraction of tokens in the hot set. */
+    double hot_traffic;         /**< Fraction of requests going to it. */
+    double zipf_s;
+    unsigned int mix[OP_NO];    /**< Weights. */
+    LOADGEN_OUT out;
+    bool use_ring;              /**< Over the shared memory ring, not mq. */
+    LANE lane;                  /**< Of every request. */
+    unsigned int first_port;    /**< pseudo_port of the first connection. */
+} loadgen_cfg_t;
+
+typedef struct {
+    uint64_t sent[OP_NO];
+    uint64_t acks[OP_NO];       /**< ACK, or at least one token for bulk ones. */
+    uint64_t nacks[OP_NO];
+    uint64_t busy[OP_NO];       /**< Refused by the server's admission control. */
+    uint64_t errors[OP_NO];     /**< Timed out or malformed replies. */
+    hist_t latency[OP_NO];      /**< Nanoseconds. */
+} conn_stats_t;
+
+typedef struct {
+    const loadgen_cfg_t *cfg;
+    uint8_t pseudo_port;
+    pid_t pid;
+    mqd_t server_mqs[SHARDS_MAX]; /**< Only the first without shards. */
+    unsigned int shards_no;
+    mqd_t reply_mq;
+    shm_ring_t *ring;           /**< Used instead of the queues if not NULL. */
+    uint64_t rng;
+    const double *zipf_cdf;
+    uint32_t held[LOADGEN_HELD_MAX];
+    unsigned int held_first;
+    unsigned int held_no;
+    uint64_t next_req_id;       /**< Tells the reply to the last request from
+                                     late ones to requests that timed out. */
+    conn_stats_t *stats;
+} conn_t;
+
+static const char *const k_op_names[OP_NO] = {"token", "any", "release", "renew", "bulk"};
+
+static uint64_t next_rand(conn_t *conn);
+static double next_unit(conn_t *conn);
+static uint32_t pick_token(conn_t *conn);
+static LOADGEN_OP pick_op(conn_t *conn);
+static void hold_token(conn_t *conn, uint32_t token);
+static bool unhold_token(conn_t *conn, uint32_t *token);
+static bool wait_reply(conn_t *conn, const struct timespec *deadline, char *buf,
+        size_t buf_len, ssize_t *len);
+static void run_op(conn_t *conn, LOADGEN_OP op, uint64_t start_ns);
+static void run_conn(const loadgen_cfg_t *cfg, unsigned int index, const double *zipf_cdf,
+        conn_stats_t *stats);
+static double *build_zipf_cdf(unsigned int tokens_no, double s);
+static void print_results(const loadgen_cfg_t *cfg, conn_stats_t *total, double elapsed);
+static void parse_mix(const char *arg, unsigned int *mix);
+static unsigned int parse_count_arg(const char *arg, char opt);
+static double parse_fraction_arg(const char *arg, char opt);
+static void print_usage(const char *prog);
+
+/* xorshift64*, seeded from the pid, so connections do not repeat each other. */
+static uint64_t next_rand(conn_t *conn)
+{
+    conn->rng ^= conn->rng >> 12;
+    conn->rng ^= conn->rng << 25;
+    conn->rng ^= conn->rng >> 27;
+    return conn->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static double next_unit(conn_t *conn)
+{
+    return (next_rand(conn) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint32_t pick_token(conn_t *conn)
+{
+    const loadgen_cfg_t *cfg = conn->cfg;
+
+    switch (cfg->dist)
+    {
+        case DIST_HOT:
+        {
+            unsigned int hot_no = (unsigned int)(cfg->tokens_no * cfg->hot_tokens);
+            hot_no = hot_no ? hot_no : 1;
+            if (next_unit(conn) < cfg->hot_traffic || hot_no == cfg->tokens_no)
+            {
+                return next_rand(conn) % hot_no;
+            }
+            return hot_no + next_rand(conn) % (cfg->tokens_no - hot_no);
+        }
+        case DIST_ZIPF:
+        {
+            /* First token whose cumulative probability reaches u. */
+            double u = next_unit(conn);
+            unsigned int low = 0;
+            unsigned int high = cfg->tokens_no - 1;
+            while (low < high)
+            {
+                unsigned int mid = low + (high - low) / 2;
+                if (conn->zipf_cdf[mid] < u)
+                {
+                    low = mid + 1;
+                }
+                else
+                {
+                    high = mid;
+                }
+            }
+            return low;
+        }
+        default:
+            return next_rand(conn) % cfg->tokens_no;
+    }
+}
+
+static LOADGEN_OP pick_op(conn_t *conn)
+{
+    unsigned int weights = 0;
+    for (unsigned int op = 0; op < OP_NO; op++)
+    {
+        weights += conn->cfg->mix[op];
+    }
+    unsigned int pick = next_rand(conn) % weights;
+    for (unsigned int op = 0; op < OP_NO; op++)
+    {
+        if (pick < conn->cfg->mix[op])
+        {
+            return op;
+        }
+        pick -= conn->cfg->mix[op];
+    }
+    return OP_TOKEN;
+}
+
+/* Remembers a token we got, forgetting the oldest one if full. */
+static void hold_token(conn_t *conn, uint32_t token)
+{
+    if (LOADGEN_HELD_MAX == conn->held_no)
+    {
+        conn->held_first = (conn->held_first + 1) % LOADGEN_HELD_MAX;
+        conn->held_no--;
+    }
+    conn->held[(conn->held_first + conn->held_no) % LOADGEN_HELD_MAX] = token;
+    conn->held_no++;
+}
+
+static bool unhold_token(conn_t *conn, uint32_t *token)
+{
+    if (0 == conn->held_no)
+    {
+        return false;
+    }
+    *token = conn->held[conn->held_first];
+    conn->held_first = (conn->held_first + 1) % LOADGEN_HELD_MAX;
+    conn->held_no--;
+    return true;
+}
+
+/* Receives the next reply for this connection. False on timeout. */
+static bool wait_reply(conn_t *conn, const struct timespec *deadline, char *buf,
+        size_t buf_len, ssize_t *len)
+{
+    if (conn->ring != NULL)
+    {
+        *len = shm_ring_wait_reply(conn->ring, conn->pseudo_port, buf, buf_len, deadline);
+    }
+    else
+    {
+        *len = mq_timedreceive(conn->reply_mq, buf, buf_len, NULL, deadline);
+    }
+    if (-1 == *len)
+    {
+        if (ETIMEDOUT == errno)
+        {
+            return false;
+        }
+        handle_error();
+    }
+    return true;
+}
+
+/* Sends one request and waits for its reply, skipping the late replies
+ * to earlier requests. Latency counts from start_ns. */
+static void run_op(conn_t *conn, LOADGEN_OP op, uint64_t start_ns)
+{
+    request_msg_t request = {0};
+    any_request_msg_t any = {0};
+    bulk_request_msg_t bulk = {0};
+    const void *msg = &request;
+    size_t msg_len = sizeof(request);
+    uint32_t token = 0;
+    uint64_t req_id = conn->next_req_id++;
+    struct timespec deadline;
+    char buf[MQ_MSGSIZE + 1];
+    ssize_t len;
+    int rc;
+
+    time_t req_time = time(NULL);
+    if (-1 == req_time)
+    {
+        handle_error();
+    }
+    if ((OP_RELEASE == op || OP_RENEW == op) && 0 == conn->held_no)
+    {
+        /* Nothing to give back or renew yet. */
+        op = OP_TOKEN;
+    }
+    switch (op)
+    {
+        case OP_ANY:
+            any = (any_request_msg_t){
+                .req_type = TOKEN_ANY,
+                .pid = conn->pid,
+                .req_time = req_time,
+                .pseudo_port = conn->pseudo_port,
+                .lane = conn->cfg->lane,
+                .token_min = 0,
+                .token_max = conn->cfg->tokens_no - 1,
+                .req_id = req_id
+            };
+            msg = &any;
+            msg_len = sizeof(any);
+        break;
+        case OP_RENEW:
+        case OP_BULK:
+            bulk.req_type = OP_RENEW == op ? RENEW : TOKEN_BULK;
+            bulk.pid = conn->pid;
+            bulk.req_time = req_time;
+            bulk.pseudo_port = conn->pseudo_port;
+            bulk.lane = conn->cfg->lane;
+            bulk.req_id = req_id;
+            if (OP_RENEW == op)
+            {
+                for (unsigned int i = 0; i < conn->held_no && i < LOADGEN_RENEW_TOK; i++)
+                {
+                    bulk.tokens[bulk.tokens_no++] =
+                        conn->held[(conn->held_first + i) % LOADGEN_HELD_MAX];
+                }
+            }
+            else
+            {
+                bulk.flags = BULK_RANGE;
+                bulk.tokens_no = LOADGEN_BULK_TOK;
+                token = pick_token(conn);
+                if ((unsigned int)token + LOADGEN_BULK_TOK > conn->cfg->tokens_no)
+                {
+                    token = conn->cfg->tokens_no - LOADGEN_BULK_TOK;
+                }
+                bulk.tokens[0] = token;
+            }
+            msg = &bulk;
+            msg_len = bulk_request_len(bulk.tokens_no, bulk.flags);
+        break;
+        default:
+            if (OP_RELEASE == op)
+            {
+                unhold_token(conn, &token);
+            }
+            else
+            {
+                token = pick_token(conn);
+            }
+            request = (request_msg_t){
+                .req_type = OP_RELEASE == op ? RELEASE : TOKEN,
+                .token_requested = token,
+                .pid = conn->pid,
+                .pseudo_port = conn->pseudo_port,
+                .lane = conn->cfg->lane,
+                .req_time = req_time,
+                .req_id = req_id
+            };
+    }
+
+    conn->stats->sent[op]++;
+    if (conn->ring != NULL)
+    {
+        shm_ring_send(conn->ring, msg, msg_len);
+    }
+    else
+    {
+        /* TOKEN_ANY goes to a random shard, any of them can serve it. */
+        uint32_t route = OP_ANY == op ? pick_token(conn) : OP_RENEW == op ? bulk.tokens[0] : token;
+        mqd_t server_mq = conn->server_mqs[conn->shards_no ? get_token_shard(route, conn->shards_no) : 0];
+        rc = mq_send(server_mq, msg, msg_len, get_lane_prio(conn->cfg->lane));
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+    }
+    rc = clock_gettime(CLOCK_REALTIME, &deadline);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    deadline.tv_sec += LOADGEN_REPLY_TIMEOUT_SEC;
+    uint64_t reply_id;
+    do
+    {
+        if (!wait_reply(conn, &deadline, buf, sizeof(buf), &len))
+        {
+            conn->stats->errors[op]++;
+            return;
+        }
+        /* Both replies have req_id in their fixed part. */
+        size_t id_offset = OP_RENEW == op || OP_BULK == op ?
+            offsetof(bulk_response_msg_t, req_id) : offsetof(response_msg_t, req_id);
+        if ((size_t)len < id_offset + sizeof(reply_id))
+        {
+            conn->stats->errors[op]++;
+            return;
+        }
+        memcpy(&reply_id, buf + id_offset, sizeof(reply_id));
+    } while (reply_id != req_id);
+    uint64_t latency = get_monotonic_ns() - start_ns;
+
+    if (OP_RENEW == op || OP_BULK == op)
+    {
+        bulk_response_msg_t response;
+        if ((size_t)len < offsetof(bulk_response_msg_t, results) ||
+            (size_t)len > sizeof(response))
+        {
+            conn->stats->errors[op]++;
+            return;
+        }
+        memcpy(&response, buf, len);
+        if (response.resp_type != BULK_RESULT || response.pid != conn->pid ||
+            (size_t)len != bulk_response_len(response.tokens_no))
+        {
+            conn->stats->errors[op]++;
+            return;
+        }
+        if (response.reserved_no > 0)
+        {
+            conn->stats->acks[op]++;
+        }
+        else if (response.tokens_no > 0 && BUSY == response.results[0].result)
+        {
+            conn->stats->busy[op]++;
+        }
+        else
+        {
+            conn->stats->nacks[op]++;
+        }
+        for (unsigned int i = 0; OP_BULK == op && i < response.tokens_no; i++)
+        {
+            if (ACK == response.results[i].result)
+            {
+                hold_token(conn, response.results[i].token);
+            }
+        }
+    }
+    else
+    {
+        response_msg_t response;
+        if (len != sizeof(response))
+        {
+            conn->stats->errors[op]++;
+            return;
+        }
+        memcpy(&response, buf, sizeof(response));
+        if (response.pid != conn->pid)
+        {
+            conn->stats->errors[op]++;
+            return;
+        }
+        if (ACK == response.resp_type)
+        {
+            conn->stats->acks[op]++;
+            if (op != OP_RELEASE)
+            {
+                hold_token(conn, response.token_requested);
+            }
+        }
+        else if (BUSY == response.resp_type)
+        {
+            conn->stats->busy[op]++;
+        }
+        else
+        {
+            conn->stats->nacks[op]++;
+        }
+    }
+    hist_record(&conn->stats->latency[op], latency);
+}
+
+static void run_conn(const loadgen_cfg_t *cfg, unsigned int index, const double *zipf_cdf,
+        conn_stats_t *stats)
+{
+    char reply_mq_name[MAX_MQUEUE_NAME] = {0};
+    struct mq_attr qattr = {0};
+    conn_t conn = {0};
+    int rc;
+
+    qattr.mq_maxmsg = MQ_MAXMSG;
+    qattr.mq_msgsize = MQ_MSGSIZE;
+    conn.cfg = cfg;
+    conn.pseudo_port = cfg->first_port + index;
+    conn.pid = getpid();
+    conn.next_req_id = 1;
+    conn.rng = (uint64_t)conn.pid * 0x9E3779B97F4A7C15ULL | 1;
+    conn.zipf_cdf = zipf_cdf;
+    conn.stats = stats;
+
+    if (cfg->use_ring)
+    {
+        conn.ring = shm_ring_attach();
+        if (NULL == conn.ring)
+        {
+            fprintf(stderr, "The server does not serve %s, start it with -t shm\n",
+                    SHM_RING_NAME);
+            exit(1);
+        }
+        shm_ring_clear_reply(conn.ring, conn.pseudo_port);
+    }
+    else
+    {
+        rc = get_client_mq_name(reply_mq_name, sizeof(reply_mq_name), conn.pseudo_port);
+        if (rc < 0 || (unsigned int)rc > sizeof(reply_mq_name))
+        {
+            handle_error();
+        }
+        conn.reply_mq = mq_open(reply_mq_name, O_RDONLY | O_CREAT, MQ_MODE, &qattr);
+        if (-1 == conn.reply_mq)
+        {
+            handle_error();
+        }
+        conn.shards_no = get_shards_no();
+        for (unsigned int i = 0; i < conn.shards_no || 0 == i; i++)
+        {
+            char server_mq_name[MAX_MQUEUE_NAME] = MQ_REQ_NAME;
+            if (conn.shards_no > 0)
+            {
+                snprintf(server_mq_name, sizeof(server_mq_name), MQ_SHARD_NAME_FMT, i);
+            }
+            conn.server_mqs[i] = mq_open(server_mq_name, O_WRONLY);
+            if (-1 == conn.server_mqs[i])
+            {
+                handle_error();
+            }
+        }
+    }
+
+    uint64_t now = get_monotonic_ns();
+    uint64_t end = now + cfg->seconds * 1000000000ull;
+    /* Every connection sends its share of the rate, starting at an offset
+     * so they do not all fire together. */
+    uint64_t interval = cfg->rate > 0 ? (uint64_t)(cfg->conns_no * 1e9 / cfg->rate) : 0;
+    uint64_t due = now + interval * index / cfg->conns_no;
+    while (now < end)
+    {
+        if (interval > 0)
+        {
+            if (due >= end)
+            {
+                break;
+            }
+            if (now < due)
+            {
+                struct timespec ts = {
+                    .tv_sec = due / 1000000000ull,
+                    .tv_nsec = due % 1000000000ull
+                };
+                rc = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+                if (rc != 0 && rc != EINTR)
+                {
+                    handle_error_en(rc);
+                }
+                now = get_monotonic_ns();
+                continue;
+            }
+            run_op(&conn, pick_op(&conn), due);
+            due += interval;
+        }
+        else
+        {
+            run_op(&conn, pick_op(&conn), now);
+        }
+        now = get_monotonic_ns();
+    }
+
+    if (conn.ring != NULL)
+    {
+        shm_ring_detach(conn.ring);
+        return;
+    }
+    for (unsigned int i = 0; i < conn.shards_no || 0 == i; i++)
+    {
+        rc = mq_close(conn.server_mqs[i]);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+    }
+    rc = mq_close(conn.reply_mq);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    rc = mq_unlink(reply_mq_name);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
+
+/* Token t gets probability proportional to 1 / (t + 1)^s. */
+static double *build_zipf_cdf(unsigned int tokens_no, double s)
+{
+    double *cdf = malloc(tokens_no * sizeof(*cdf));
+    double sum = 0;
+
+    if (NULL == cdf)
+    {
+        handle_error();
+    }
+    for (unsigned int i = 0; i < tokens_no; i++)
+    {
+        sum += 1.0 / pow(i + 1, s);
+        cdf[i] = sum;
+    }
+    for (unsigned int i = 0; i < tokens_no; i++)
+    {
+        cdf[i] /= sum;
+    }
+    return cdf;
+}
+
+static void print_results(const loadgen_cfg_t *cfg, conn_stats_t *total, double elapsed)
+{
+    static hist_t all_latency;
+    uint64_t all_acks = 0;
+    uint64_t all_nacks = 0;
+    uint64_t all_busy = 0;
+    uint64_t all_errors = 0;
+    bool first = true;
+    const double us = 1000.0;
+
+    if (OUT_CSV == cfg->out)
+    {
+        printf("op,requests,acks,nacks,busy,errors,per_sec,mean_us,p50_us,p99_us,p999_us,max_us\n");
+    }
+    else
+    {
+        printf("{\"mode\":\"%s\",\"connections\":%u,\"rate\":%.0f,\"seconds\":%.3f,"
+                "\"ops\":[", cfg->rate > 0 ? "open" : "closed", cfg->conns_no,
+                cfg->rate, elapsed);
+    }
+    for (unsigned int op = 0; op <= OP_NO; op++)
+    {
+        const char *name = "all";
+        hist_t *latency = &all_latency;
+        uint64_t acks = all_acks;
+        uint64_t nacks = all_nacks;
+        uint64_t busy = all_busy;
+        uint64_t errors = all_errors;
+        if (op < OP_NO)
+        {
+            if (0 == total->sent[op])
+            {
+                continue;
+            }
+            name = k_op_names[op];
+            latency = &total->latency[op];
+            acks = total->acks[op];
+            nacks = total->nacks[op];
+            busy = total->busy[op];
+            errors = total->errors[op];
+            hist_merge(&all_latency, latency);
+            all_acks += acks;
+            all_nacks += nacks;
+            all_busy += busy;
+            all_errors += errors;
+        }
+        uint64_t done = atomic_load(&latency->total);
+        if (OUT_CSV == cfg->out)
+        {
+            printf("%s,%llu,%llu,%llu,%llu,%llu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", name,
+                    (unsigned long long)done, (unsigned long long)acks,
+                    (unsigned long long)nacks, (unsigned long long)busy,
+                    (unsigned long long)errors, done / elapsed,
+                    hist_mean(latency) / us, hist_percentile(latency, 0.5) / us,
+                    hist_percentile(latency, 0.99) / us, hist_percentile(latency, 0.999) / us,
+                    atomic_load(&latency->max) / us);
+        }
+        else
+        {
+            printf("%s{\"op\":\"%s\",\"requests\":%llu,\"acks\":%llu,\"nacks\":%llu,"
+                    "\"busy\":%llu,\"errors\":%llu,\"per_sec\":%.1f,\"mean_us\":%.1f,\"p50_us\":%.1f,"
+                    "\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f}",
+                    first ? "" : ",", name,
+                    (unsigned long long)done, (unsigned long long)acks,
+                    (unsigned long long)nacks, (unsigned long long)busy,
+                    (unsigned long long)errors, done / elapsed,
+                    hist_mean(latency) / us, hist_percentile(latency, 0.5) / us,
+                    hist_percentile(latency, 0.99) / us, hist_percentile(latency, 0.999) / us,
+                    atomic_load(&latency->max) / us);
+        }
+        first = false;
+    }
+    if (OUT_JSON == cfg->out)
+    {
+        printf("]}\n");
+    }
+}
+
+/* Parses "token=70,any=20,release=10", missing kinds weigh 0. */
+static void parse_mix(const char *arg, unsigned int *mix)
+{
+    char buf[256];
+    unsigned int weights = 0;
+    char *save = NULL;
+
+    if (strlen(arg) >= sizeof(buf))
+    {
+        fprintf(stderr, "Invalid request mix \"%s\"\n", arg);
+        exit(1);
+    }
+    strcpy(buf, arg);
+    memset(mix, 0, OP_NO * sizeof(*mix));
+    for (char *item = strtok_r(buf, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+    {
+        char *eq = strchr(item, '=');
+        unsigned int op = 0;
+        if (eq != NULL)
+        {
+            *eq = '\0';
+            for (op = 0; op < OP_NO && strcasecmp(item, k_op_names[op]) != 0; op++)
+            {
+            }
+        }
+        if (NULL == eq || OP_NO == op)
+        {
+            fprintf(stderr, "Invalid request mix \"%s\"\n", arg);
+            exit(1);
+        }
+        mix[op] = parse_count_arg(eq + 1, 'm');
+        weights += mix[op];
+    }
+    if (0 == weights)
+    {
+        fprintf(stderr, "Invalid request mix \"%s\"\n", arg);
+        exit(1);
+    }
+}
+
+static unsigned int parse_count_arg(const char *arg, char opt)
+{
+    char *end = NULL;
+    errno = 0;
+    unsigned long val = strtoul(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || 0 == val || val > UINT_MAX)
+    {
+        fprintf(stderr, "Invalid value \"%s\" for -%c\n", arg, opt);
+        exit(1);
+    }
+    return (unsigned int)val;
+}
+
+static double parse_fraction_arg(const char *arg, char opt)
+{
+    char *end = NULL;
+    errno = 0;
+    double val = strtod(arg, &end);
+    if (errno != 0 || end == arg || *end != '\0' || !(val > 0))
+    {
+        fprintf(stderr, "Invalid value \"%s\" for -%c\n", arg, opt);
+        exit(1);
+    }
+    return val;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-c connections] [-r rate] [-d seconds] [-k tokens]"
+            " [-D uniform|hot|zipf] [-H hot_tokens] [-T hot_traffic] [-s zipf_s]"
+            " [-m mix] [-o csv|json] [-t mq|shm] [-p normal|interactive|batch]"
+            " [-P first_port]\n"
+            "  -c  connections, each a process with its own reply queue (default %d)\n"
+            "  -r  open loop at this many requests per second over all; closed loop\n"
+            "      when not given\n"
+            "  -d  seconds to run (default %d)\n"
+            "  -k  tokens used, from 0 (default %d)\n"
+            "  -D  token distribution (default uniform)\n"
+            "  -H  fraction of the tokens in the hot set (default 0.01)\n"
+            "  -T  fraction of the requests going to the hot set (default 0.9)\n"
+            "  -s  exponent of the Zipf distribution (default 0.99)\n"
+            "  -m  weights of token, any, release, renew and bulk requests\n"
+            "      (default token=70,any=10,release=10,renew=5,bulk=5)\n"
+            "  -o  output format (default csv)\n"
+            "  -t  transport, the message queues (default) or the shared memory\n"
+            "      ring of a server started with -t shm\n"
+            "  -p  lane of the requests, sent with its priority (default normal)\n"
+            "  -P  pseudo_port of the first connection, the others follow; apart\n"
+            "      for every loadgen running at once (default %d)\n",
+            prog, LOADGEN_CONNS, LOADGEN_SECONDS, CLIENT_MAX_TOK + 1, LOADGEN_FIRST_PORT);
+}
+
+int main(int argc, char *argv[])
+{
+    loadgen_cfg_t cfg = {
+        .conns_no = LOADGEN_CONNS,
+        .rate = 0,
+        .seconds = LOADGEN_SECONDS,
+        .tokens_no = CLIENT_MAX_TOK + 1,
+        .dist = DIST_UNIFORM,
+        .hot_tokens = 0.01,
+        .hot_traffic = 0.9,
+        .zipf_s = 0.99,
+        .mix = {[OP_TOKEN] = 70, [OP_ANY] = 10, [OP_RELEASE] = 10, [OP_RENEW] = 5, [OP_BULK] = 5},
+        .out = OUT_CSV,
+        .lane = LANE_NORMAL,
+        .first_port = LOADGEN_FIRST_PORT
+    };
+    double *zipf_cdf = NULL;
+    int opt;
+    int rc;
+
+    while ((opt = getopt(argc, argv, "c:r:d:k:D:H:T:s:m:o:t:p:P:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':
+                cfg.conns_no = parse_count_arg(optarg, opt);
+            break;
+            case 'p':
+                if (parse_lane(optarg, &cfg.lane) != 0)
+                {
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+            break;
+            case 'P':
+                cfg.first_port = parse_count_arg(optarg, opt);
+            break;
+            case 'r':
+                cfg.rate = parse_fraction_arg(optarg, opt);
+            break;
+            case 'd':
+                cfg.seconds = parse_count_arg(optarg, opt);
+            break;
+            case 'k':
+                cfg.tokens_no = parse_count_arg(optarg, opt);
+                if (cfg.tokens_no > DB_TOKENS_MAX || cfg.tokens_no < LOADGEN_BULK_TOK)
+                {
+                    fprintf(stderr, "Use %d to %u tokens\n", LOADGEN_BULK_TOK, DB_TOKENS_MAX);
+                    exit(1);
+                }
+            break;
+            case 'D':
+                if (0 == strcmp(optarg, "uniform"))
+                {
+                    cfg.dist = DIST_UNIFORM;
+                }
+                else if (0 == strcmp(optarg, "hot"))
+                {
+                    cfg.dist = DIST_HOT;
+                }
+                else if (0 == strcmp(optarg, "zipf"))
+                {
+                    cfg.dist = DIST_ZIPF;
+                }
+                else
+                {
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+            break;
+            case 'H':
+                cfg.hot_tokens = parse_fraction_arg(optarg, opt);
+            break;
+            case 'T':
+                cfg.hot_traffic = parse_fraction_arg(optarg, opt);
+            break;
+            case 's':
+                cfg.zipf_s = parse_fraction_arg(optarg, opt);
+            break;
+            case 'm':
+                parse_mix(optarg, cfg.mix);
+            break;
+            case 'o':
+                if (0 == strcmp(optarg, "csv"))
+                {
+                    cfg.out = OUT_CSV;
+                }
+                else if (0 == strcmp(optarg, "json"))
+                {
+                    cfg.out = OUT_JSON;
+                }
+                else
+                {
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+            break;
+            case 't':
+                if (0 == strcmp(optarg, "mq"))
+                {
+                    cfg.use_ring = false;
+                }
+                else if (0 == strcmp(optarg, "shm"))
+                {
+                    cfg.use_ring = true;
+                }
+                else
+                {
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+            break;
+            default:
+                print_usage(argv[0]);
+                exit(1);
+        }
+    }
+    if (cfg.first_port > UINT8_MAX || cfg.conns_no > UINT8_MAX + 1 - cfg.first_port)
+    {
+        fprintf(stderr, "At most %u connections from pseudo_port %u\n",
+                cfg.first_port > UINT8_MAX ? 0 : UINT8_MAX + 1 - cfg.first_port, cfg.first_port);
+        exit(1);
+    }
+    if (cfg.hot_tokens > 1 || cfg.hot_traffic > 1)
+    {
+        print_usage(argv[0]);
+        exit(1);
+    }
+    if (DIST_ZIPF == cfg.dist)
+    {
+        zipf_cdf = build_zipf_cdf(cfg.tokens_no, cfg.zipf_s);
+    }
+
+    /* One stats block per connection, shared with the children. */
+    size_t stats_len = (cfg.conns_no + 1) * sizeof(conn_stats_t);
+    conn_stats_t *stats = mmap(NULL, stats_len, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == stats)
+    {
+        handle_error();
+    }
+    pid_t children[cfg.conns_no];
+    uint64_t start = get_monotonic_ns();
+    for (unsigned int i = 0; i < cfg.conns_no; i++)
+    {
+        children[i] = fork();
+        if (0 == children[i])
+        {
+            run_conn(&cfg, i, zipf_cdf, &stats[i]);
+            exit(0);
+        }
+        else if (-1 == children[i])
+        {
+            handle_error();
+        }
+    }
+    for (unsigned int i = 0; i < cfg.conns_no; i++)
+    {
+        int status;
+        pid_t wait_rc = waitpid(children[i], &status, 0);
+        if (-1 == wait_rc)
+        {
+            handle_error();
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            fprintf(stderr, "Connection %u failed\n", i);
+            exit(1);
+        }
+    }
+    double elapsed = (get_monotonic_ns() - start) / 1e9;
+
+    /* The last block collects the sum. */
+    conn_stats_t *total = &stats[cfg.conns_no];
+    for (unsigned int i = 0; i < cfg.conns_no; i++)
+    {
+        for (unsigned int op = 0; op < OP_NO; op++)
+        {
+            total->sent[op] += stats[i].sent[op];
+            total->acks[op] += stats[i].acks[op];
+            total->nacks[op] += stats[i].nacks[op];
+            total->busy[op] += stats[i].busy[op];
+            total->errors[op] += stats[i].errors[op];
+            hist_merge(&total->latency[op], &stats[i].latency[op]);
+        }
+    }
+    print_results(&cfg, total, elapsed);
+
+    rc = munmap(stats, stats_len);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    free(zipf_cdf);
+    return 0;
+}
@@ -0,0 +1,320 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file logger.c
+*
+* \brief Implements the asynchronous logger declared in logger.h. Every ring
+*        has a single producer, its thread, and a single consumer, the
+*        logger thread, so head and tail are plain atomic counters.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdlib.h>         /* For exit() */
+#include <string.h>
+#include <strings.h>        /* For strcasecmp */
+#include <assert.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include "utils.h"
+#include "common.h"
+#include "logger.h"
+
+#define LOG_IDLE_WAIT_MS 10
+
+typedef struct {
+    uint64_t time_ns;
+    const char *fmt;
+    int64_t args[LOG_ARGS_MAX];
+    LOG_LEVEL level;
+} log_rec_t;
+
+typedef struct {
+    _Atomic uint64_t head;      /**< Next record written, by its thread. */
+    _Atomic uint64_t tail;      /**< Next record read, by the logger. */
+    atomic_uint_fast64_t dropped;
+    log_rec_t recs[LOG_RING_LEN];
+} log_ring_t;
+
+typedef struct {
+    FILE *out;
+    log_ring_t *rings[LOG_RINGS_MAX];
+    atomic_uint rings_no;
+    pthread_mutex_t register_lock;
+    atomic_uint_fast64_t unregistered_dropped; /**< Threads past LOG_RINGS_MAX. */
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool closing;               /**< Protected by lock. */
+} logger_t;
+
+atomic_int g_log_level = LOG_INFO;
+
+static logger_t s_logger;
+static _Thread_local log_ring_t *tl_ring;
+static _Thread_local bool tl_ring_failed;
+
+static const char *const k_level_names[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+
+static log_ring_t *get_ring(void);
+static void write_rec(const log_rec_t *rec);
+static bool drain_rings(void);
+static void *writer_f(void *args);
+
+/* Registers a ring for the calling thread on its first record. */
+static log_ring_t *get_ring(void)
+{
+    int rc;
+
+    if (tl_ring != NULL || tl_ring_failed)
+    {
+        return tl_ring;
+    }
+    rc = pthread_mutex_lock(&s_logger.register_lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    unsigned int rings_no = atomic_load(&s_logger.rings_no);
+    if (rings_no < LOG_RINGS_MAX)
+    {
+        tl_ring = calloc(1, sizeof(*tl_ring));
+        if (NULL == tl_ring)
+        {
+            handle_error();
+        }
+        s_logger.rings[rings_no] = tl_ring;
+        atomic_store(&s_logger.rings_no, rings_no + 1);
+    }
+    else
+    {
+        tl_ring_failed = true;
+    }
+    rc = pthread_mutex_unlock(&s_logger.register_lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    return tl_ring;
+}
+
+static void write_rec(const log_rec_t *rec)
+{
+    fprintf(s_logger.out, "%llu.%06llu %-5s ",
+            (unsigned long long)(rec->time_ns / 1000000000ull),
+            (unsigned long long)(rec->time_ns % 1000000000ull / 1000),
+            k_level_names[rec->level]);
+    static_assert(LOG_ARGS_MAX == 4, "write_rec passes LOG_ARGS_MAX arguments\n");
+    fprintf(s_logger.out, rec->fmt, (long long)rec->args[0], (long long)rec->args[1],
+            (long long)rec->args[2], (long long)rec->args[3]);
+}
+
+/* Writes what the rings hold now, oldest record first across all of them.
+ * Returns false if there was nothing to write. */
+static bool drain_rings(void)
+{
+    unsigned int rings_no = atomic_load(&s_logger.rings_no);
+    uint64_t ends[LOG_RINGS_MAX];
+    uint64_t tails[LOG_RINGS_MAX];
+    bool wrote = false;
+
+    for (unsigned int i = 0; i < rings_no; i++)
+    {
+        ends[i] = atomic_load_explicit(&s_logger.rings[i]->head, memory_order_acquire);
+        tails[i] = atomic_load_explicit(&s_logger.rings[i]->tail, memory_order_relaxed);
+    }
+    while (true)
+    {
+        const log_rec_t *oldest = NULL;
+        unsigned int oldest_ring = 0;
+        for (unsigned int i = 0; i < rings_no; i++)
+        {
+            if (tails[i] == ends[i])
+            {
+                continue;
+            }
+            const log_rec_t *rec = &s_logger.rings[i]->recs[tails[i] % LOG_RING_LEN];
+            if (NULL == oldest || rec->time_ns < oldest->time_ns)
+            {
+                oldest = rec;
+                oldest_ring = i;
+            }
+        }
+        if (NULL == oldest)
+        {
+            break;
+        }
+        write_rec(oldest);
+        tails[oldest_ring]++;
+        atomic_store_explicit(&s_logger.rings[oldest_ring]->tail, tails[oldest_ring],
+                memory_order_release);
+        wrote = true;
+    }
+    if (wrote)
+    {
+        fflush(s_logger.out);
+    }
+    return wrote;
+}
+
+static void *writer_f(void *args)
+{
+    struct timespec deadline;
+    int rc;
+
+    (void)args;
+    rc = pthread_mutex_lock(&s_logger.lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    while (!s_logger.closing)
+    {
+        if (drain_rings())
+        {
+            continue;
+        }
+        rc = clock_gettime(CLOCK_REALTIME, &deadline);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+        deadline.tv_nsec += LOG_IDLE_WAIT_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        rc = pthread_cond_timedwait(&s_logger.cond, &s_logger.lock, &deadline);
+        if (rc != 0 && rc != ETIMEDOUT)
+        {
+            handle_error_en(rc);
+        }
+    }
+    rc = pthread_mutex_unlock(&s_logger.lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    return NULL;
+}
+
+int logger_init(LOG_LEVEL level, FILE *out)
+{
+    int rc;
+
+    s_logger.out = out;
+    atomic_init(&s_logger.rings_no, 0);
+    atomic_init(&s_logger.unregistered_dropped, 0);
+    s_logger.closing = false;
+    logger_set_level(level);
+    rc = pthread_mutex_init(&s_logger.register_lock, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_mutex_init(&s_logger.lock, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_cond_init(&s_logger.cond, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_create(&s_logger.writer, NULL, writer_f, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    return 0;
+}
+
+void logger_push(LOG_LEVEL level, const char *fmt, const int64_t *args)
+{
+    log_ring_t *ring = get_ring();
+
+    if (NULL == ring)
+    {
+        atomic_fetch_add_explicit(&s_logger.unregistered_dropped, 1, memory_order_relaxed);
+        return;
+    }
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == LOG_RING_LEN)
+    {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    log_rec_t *rec = &ring->recs[head % LOG_RING_LEN];
+    rec->time_ns = get_monotonic_ns();
+    rec->fmt = fmt;
+    rec->level = level;
+    memcpy(rec->args, args, sizeof(rec->args));
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void logger_set_level(LOG_LEVEL level)
+{
+    atomic_store(&g_log_level, level);
+}
+
+int logger_close(void)
+{
+    uint64_t dropped;
+    int rc;
+
+    rc = pthread_mutex_lock(&s_logger.lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    s_logger.closing = true;
+    rc = pthread_cond_signal(&s_logger.cond);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_mutex_unlock(&s_logger.lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_join(s_logger.writer, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    drain_rings();
+
+    dropped = atomic_load(&s_logger.unregistered_dropped);
+    for (unsigned int i = 0; i < atomic_load(&s_logger.rings_no); i++)
+    {
+        dropped += atomic_load(&s_logger.rings[i]->dropped);
+        free(s_logger.rings[i]);
+        s_logger.rings[i] = NULL;
+    }
+    fprintf(s_logger.out, "Logger: %llu records dropped\n", (unsigned long long)dropped);
+    fflush(s_logger.out);
+    pthread_cond_destroy(&s_logger.cond);
+    pthread_mutex_destroy(&s_logger.lock);
+    pthread_mutex_destroy(&s_logger.register_lock);
+    return 0;
+}
+
+int logger_parse_level(const char *name, LOG_LEVEL *level)
+{
+    for (unsigned int i = 0; i < ARRAY_LEN(k_level_names); i++)
+    {
+        if (0 == strcasecmp(name, k_level_names[i]))
+        {
+            *level = (LOG_LEVEL)i;
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,152 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file logger.h
+*
+* \brief Asynchronous logger. Threads append fixed-size binary records to a
+*        ring of their own without locking; a background thread merges the
+*        rings by time, formats the records and writes them out. When a
+*        ring is full the record is dropped and counted.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define LOG_ARGS_MAX 4      /**< Integer arguments of one record. */
+#define LOG_RING_LEN 1024   /**< Records in the ring of every thread. */
+#define LOG_RINGS_MAX 64    /**< Threads that may log. */
+
+/*
+*******************************************************************************
+*   LOG_LEVEL
+*******************************************************************************
+*
+*  \brief           <b> LOG_LEVEL </b>\n
+*                   Severity of a record. Records above the current level are
+*                   discarded before anything is stored.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef enum {
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG
+} LOG_LEVEL;
+
+extern atomic_int g_log_level;
+
+/*
+*******************************************************************************
+*   LOG
+*******************************************************************************
+*
+*  \brief           <b> LOG </b>\n
+*                   Queues a record. fmt must be a string literal, it is
+*                   formatted later by the logger thread. It may take at most
+*                   LOG_ARGS_MAX arguments, all integers, which reach it as
+*                   long long: use %lld and friends.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+#define LOG(level, fmt, ...) \
+    do \
+    { \
+        if ((int)(level) <= atomic_load_explicit(&g_log_level, memory_order_relaxed)) \
+        { \
+            logger_push((level), (fmt), (const int64_t[LOG_ARGS_MAX]){__VA_ARGS__}); \
+        } \
+    } while (0)
+
+/*
+*******************************************************************************
+*   logger_init
+*******************************************************************************
+*
+*  \brief           <b> logger_init </b>\n
+*                   Starts the logger thread writing to out. Records below
+*                   level are kept.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int logger_init(LOG_LEVEL level, FILE *out);
+
+/*
+*******************************************************************************
+*   logger_push
+*******************************************************************************
+*
+*  \brief           <b> logger_push </b>\n
+*                   Stores one record in the ring of the calling thread. Use
+*                   LOG instead. Never blocks.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void logger_push(LOG_LEVEL level, const char *fmt, const int64_t *args);
+
+/*
+*******************************************************************************
+*   logger_set_level
+*******************************************************************************
+*
+*  \brief           <b> logger_set_level </b>\n
+*                   Changes the level at run time.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void logger_set_level(LOG_LEVEL level);
+
+/*
+*******************************************************************************
+*   logger_close
+*******************************************************************************
+*
+*  \brief           <b> logger_close </b>\n
+*                   Writes every queued record, reports the dropped ones and
+*                   stops the logger thread. Nothing may log afterwards.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int logger_close(void);
+
+/*
+*******************************************************************************
+*   logger_parse_level
+*******************************************************************************
+*
+*  \brief           <b> logger_parse_level </b>\n
+*                   Converts "error", "warn", "info" or "debug" to LOG_LEVEL.
+*
+*  \return          0 on success, -1 if name is not known.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int logger_parse_level(const char *name, LOG_LEVEL *level);
+
+#endif /* LOGGER_H */
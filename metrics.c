@@ -0,0 +1,180 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file metrics.c
+*
+* \brief Implements the shared memory metrics declared in metrics.h.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdlib.h>         /* For exit() */
+#include <string.h>
+#include <fcntl.h>          /* For O_* constants */
+#include <sys/stat.h>       /* For mode constants and struct stat */
+#include <sys/mman.h>
+#include <unistd.h>
+#include "utils.h"
+#include "constants.h"
+#include "common.h"
+#include "metrics.h"
+
+const char *const g_metric_counter_names[METRIC_COUNTERS_NO] = {
+    "received", "bad_requests", "done", "token", "token_bulk", "token_any",
+    "release", "renew", "query", "ack", "not_available", "rolled_back", "not_owner",
+    "send_timeouts", "busy"
+};
+
+const char *const g_metric_hist_names[METRIC_HISTS_NO] = {
+    "queue_wait", "service", "lane_normal", "lane_interactive", "lane_batch"
+};
+
+static _Thread_local metrics_shard_t *tl_shard;
+
+static metrics_shard_t *get_shard(metrics_t *metrics);
+
+static metrics_shard_t *get_shard(metrics_t *metrics)
+{
+    if (NULL == tl_shard)
+    {
+        unsigned int shard = atomic_fetch_add_explicit(&metrics->next_shard, 1,
+                memory_order_relaxed);
+        tl_shard = &metrics->shards[shard % METRICS_SHARDS_NO];
+    }
+    return tl_shard;
+}
+
+metrics_t *metrics_create(void)
+{
+    metrics_t *metrics;
+    int fd;
+    int rc;
+
+    rc = shm_unlink(METRICS_SHM_NAME);
+    if (-1 == rc && errno != ENOENT)
+    {
+        handle_error();
+    }
+    fd = shm_open(METRICS_SHM_NAME, O_RDWR | O_CREAT | O_EXCL, MQ_MODE);
+    if (-1 == fd)
+    {
+        handle_error();
+    }
+    rc = ftruncate(fd, sizeof(*metrics));
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    metrics = mmap(NULL, sizeof(*metrics), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == metrics)
+    {
+        handle_error();
+    }
+    rc = close(fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    /* ftruncate zeroed it, which is a valid empty state. */
+    metrics->version = METRICS_VERSION;
+    metrics->server_pid = getpid();
+    metrics->start_ns = get_monotonic_ns();
+    atomic_store_explicit(&metrics->magic, METRICS_MAGIC, memory_order_release);
+    return metrics;
+}
+
+const metrics_t *metrics_attach(void)
+{
+    const metrics_t *metrics;
+    struct stat st;
+    int fd;
+    int rc;
+
+    fd = shm_open(METRICS_SHM_NAME, O_RDONLY, 0);
+    if (-1 == fd)
+    {
+        return NULL;
+    }
+    rc = fstat(fd, &st);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    if ((size_t)st.st_size != sizeof(*metrics))
+    {
+        close(fd);
+        return NULL;
+    }
+    metrics = mmap(NULL, sizeof(*metrics), PROT_READ, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == metrics)
+    {
+        handle_error();
+    }
+    rc = close(fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    if (atomic_load_explicit(&metrics->magic, memory_order_acquire) != METRICS_MAGIC ||
+        metrics->version != METRICS_VERSION)
+    {
+        metrics_detach(metrics);
+        return NULL;
+    }
+    return metrics;
+}
+
+void metrics_count(metrics_t *metrics, METRIC_COUNTER counter, uint64_t n)
+{
+    atomic_fetch_add_explicit(&get_shard(metrics)->counters[counter], n, memory_order_relaxed);
+}
+
+void metrics_time(metrics_t *metrics, METRIC_HIST hist, uint64_t ns)
+{
+    hist_record(&get_shard(metrics)->hists[hist], ns);
+}
+
+uint64_t metrics_sum(const metrics_t *metrics, METRIC_COUNTER counter)
+{
+    uint64_t sum = 0;
+    for (unsigned int i = 0; i < METRICS_SHARDS_NO; i++)
+    {
+        sum += atomic_load_explicit(&metrics->shards[i].counters[counter], memory_order_relaxed);
+    }
+    return sum;
+}
+
+void metrics_hist(const metrics_t *metrics, METRIC_HIST hist, hist_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    for (unsigned int i = 0; i < METRICS_SHARDS_NO; i++)
+    {
+        hist_merge(out, &metrics->shards[i].hists[hist]);
+    }
+}
+
+void metrics_destroy(metrics_t *metrics)
+{
+    int rc = munmap(metrics, sizeof(*metrics));
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    rc = shm_unlink(METRICS_SHM_NAME);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
+
+void metrics_detach(const metrics_t *metrics)
+{
+    int rc = munmap((void *)metrics, sizeof(*metrics));
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
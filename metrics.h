@@ -0,0 +1,200 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file metrics.h
+*
+* \brief Server counters and latency histograms published in the POSIX
+*        shared memory segment METRICS_SHM_NAME, so tokstat can read them
+*        while the server runs. Every thread updates a shard of its own with
+*        relaxed atomic adds; readers sum the shards.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>  /* For pid_t */
+#include "common.h"
+#include "histogram.h"
+
+#define METRICS_SHM_NAME "/tok_server_metrics"
+#define METRICS_MAGIC 0x4D45545249435301ull /**< "METRICS" and 1. */
+#define METRICS_VERSION 3
+#define METRICS_SHARDS_NO 16 /**< Threads past this share shards. */
+
+/*
+*******************************************************************************
+*   METRIC_COUNTER
+*******************************************************************************
+*
+*  \brief           <b> METRIC_COUNTER </b>\n
+*                   Counters kept by the server. Responses are counted per
+*                   token, so a bulk answer adds one for every result.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef enum {
+    METRIC_RECEIVED,        /**< Well formed requests received. */
+    METRIC_BAD_REQUESTS,
+    METRIC_DONE,            /**< Requests a worker finished. */
+    METRIC_TOKEN,
+    METRIC_TOKEN_BULK,
+    METRIC_TOKEN_ANY,
+    METRIC_RELEASE,
+    METRIC_RENEW,
+    METRIC_QUERY,
+    METRIC_ACK,
+    METRIC_NOT_AVAILABLE,
+    METRIC_ROLLED_BACK,
+    METRIC_NOT_OWNER,
+    METRIC_SEND_TIMEOUTS,   /**< Replies dropped, timed out or queue gone. */
+    METRIC_BUSY,            /**< Refused by admission control. */
+    METRIC_COUNTERS_NO
+} METRIC_COUNTER;
+
+/*
+*******************************************************************************
+*   METRIC_HIST
+*******************************************************************************
+*
+*  \brief           <b> METRIC_HIST </b>\n
+*                   Latency histograms, in nanoseconds. The lane ones are
+*                   the whole time of the requests of a lane, received to
+*                   reply sent; METRIC_LANE_NORMAL + lane is lane's.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef enum {
+    METRIC_QUEUE_WAIT,      /**< Received to picked up by a worker. */
+    METRIC_SERVICE,         /**< Picked up to reply sent. */
+    METRIC_LANE_NORMAL,
+    METRIC_LANE_INTERACTIVE,
+    METRIC_LANE_BATCH,
+    METRIC_HISTS_NO
+} METRIC_HIST;
+
+_Static_assert(METRIC_LANE_BATCH - METRIC_LANE_NORMAL == LANE_BATCH - LANE_NORMAL &&
+        METRIC_LANE_INTERACTIVE - METRIC_LANE_NORMAL == LANE_INTERACTIVE - LANE_NORMAL,
+        "the lane histograms must follow enum LANE");
+
+typedef struct {
+    _Alignas(64) _Atomic uint64_t counters[METRIC_COUNTERS_NO];
+    hist_t hists[METRIC_HISTS_NO];
+} metrics_shard_t;
+
+/*
+*******************************************************************************
+*   metrics_t
+*******************************************************************************
+*
+*  \brief           <b> metrics_t </b>\n
+*                   Layout of the segment. magic is written last by the
+*                   server, a reader seeing it finds the rest initialized.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    _Atomic uint64_t magic;
+    uint32_t version;
+    pid_t server_pid;
+    uint64_t start_ns;      /**< CLOCK_MONOTONIC when the server started. */
+    atomic_uint next_shard;
+    metrics_shard_t shards[METRICS_SHARDS_NO];
+} metrics_t;
+
+extern const char *const g_metric_counter_names[METRIC_COUNTERS_NO];
+extern const char *const g_metric_hist_names[METRIC_HISTS_NO];
+
+/*
+*******************************************************************************
+*   metrics_create
+*******************************************************************************
+*
+*  \brief           <b> metrics_create </b>\n
+*                   Creates the segment, replacing one left by a previous
+*                   server, and maps it.
+*
+*  \return          The mapping. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+metrics_t *metrics_create(void);
+
+/*
+*******************************************************************************
+*   metrics_attach
+*******************************************************************************
+*
+*  \brief           <b> metrics_attach </b>\n
+*                   Maps the segment of a running server, read only.
+*
+*  \return          The mapping, NULL if there is no valid segment.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+const metrics_t *metrics_attach(void);
+
+/*
+*******************************************************************************
+*   metrics_count / metrics_time
+*******************************************************************************
+*
+*  \brief           <b> metrics_count / metrics_time </b>\n
+*                   Add n to a counter, or one value to a histogram, in the
+*                   shard of the calling thread. Lock-free.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void metrics_count(metrics_t *metrics, METRIC_COUNTER counter, uint64_t n);
+void metrics_time(metrics_t *metrics, METRIC_HIST hist, uint64_t ns);
+
+/*
+*******************************************************************************
+*   metrics_sum / metrics_hist
+*******************************************************************************
+*
+*  \brief           <b> metrics_sum / metrics_hist </b>\n
+*                   Read a counter, or copy a histogram into out, summed over
+*                   every shard.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+uint64_t metrics_sum(const metrics_t *metrics, METRIC_COUNTER counter);
+void metrics_hist(const metrics_t *metrics, METRIC_HIST hist, hist_t *out);
+
+/*
+*******************************************************************************
+*   metrics_destroy / metrics_detach
+*******************************************************************************
+*
+*  \brief           <b> metrics_destroy / metrics_detach </b>\n
+*                   Unmap the segment. metrics_destroy, for the server, also
+*                   removes it.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void metrics_destroy(metrics_t *metrics);
+void metrics_detach(const metrics_t *metrics);
+
+#endif /* METRICS_H */
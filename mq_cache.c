@@ -0,0 +1,239 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file mq_cache.c
+*
+* \brief Implements the reply queue descriptor cache declared in mq_cache.h.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdlib.h>         /* For exit() */
+#include <fcntl.h>          /* For O_* constants */
+#include <limits.h>         /* For NAME_MAX */
+#include "utils.h"
+#include "common.h"
+#include "mq_cache.h"
+
+#define MQ_CACHE_SWEEP_NS 1000000000ull
+
+static mqd_t open_client_mq(uint8_t pseudo_port);
+static void close_entry(mq_cache_t *cache, mq_cache_entry_t *entry);
+static void sweep_idle(mq_cache_t *cache, uint64_t now);
+static bool evict_lru(mq_cache_t *cache);
+static void lock_cache(mq_cache_t *cache);
+static void unlock_cache(mq_cache_t *cache);
+
+static mqd_t open_client_mq(uint8_t pseudo_port)
+{
+    char client_mq_name[NAME_MAX] = {0};
+    int rc;
+
+    rc = get_client_mq_name(client_mq_name, sizeof(client_mq_name), pseudo_port);
+    if (rc < 0 || (unsigned int)rc > sizeof(client_mq_name))
+    {
+        handle_error();
+    }
+    return mq_open(client_mq_name, O_WRONLY);
+}
+
+static void close_entry(mq_cache_t *cache, mq_cache_entry_t *entry)
+{
+    int rc = mq_close(entry->mqd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    *entry = (mq_cache_entry_t){0};
+    cache->open_no--;
+}
+
+static void sweep_idle(mq_cache_t *cache, uint64_t now)
+{
+    cache->last_sweep_ns = now;
+    for (unsigned int i = 0; i < MQ_CACHE_SLOTS_NO; i++)
+    {
+        mq_cache_entry_t *entry = &cache->entries[i];
+        if (entry->open && 0 == entry->refs &&
+            now - entry->last_used_ns > cache->idle_ns)
+        {
+            close_entry(cache, entry);
+            cache->evictions++;
+        }
+    }
+}
+
+/* Returns false if every open entry is in use. */
+static bool evict_lru(mq_cache_t *cache)
+{
+    mq_cache_entry_t *lru = NULL;
+    for (unsigned int i = 0; i < MQ_CACHE_SLOTS_NO; i++)
+    {
+        mq_cache_entry_t *entry = &cache->entries[i];
+        if (entry->open && 0 == entry->refs &&
+            (NULL == lru || entry->last_used_ns < lru->last_used_ns))
+        {
+            lru = entry;
+        }
+    }
+    if (NULL == lru)
+    {
+        return false;
+    }
+    close_entry(cache, lru);
+    cache->evictions++;
+    return true;
+}
+
+static void lock_cache(mq_cache_t *cache)
+{
+    int rc = pthread_mutex_lock(&cache->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+}
+
+static void unlock_cache(mq_cache_t *cache)
+{
+    int rc = pthread_mutex_unlock(&cache->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+}
+
+int mq_cache_init(mq_cache_t *cache, unsigned int capacity, unsigned int idle_sec)
+{
+    int rc;
+
+    *cache = (mq_cache_t){0};
+    cache->capacity = capacity;
+    cache->idle_ns = (uint64_t)idle_sec * 1000000000ull;
+    cache->last_sweep_ns = get_monotonic_ns();
+    rc = pthread_mutex_init(&cache->lock, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    return 0;
+}
+
+mq_cache_ref_t mq_cache_get(mq_cache_t *cache, uint8_t pseudo_port, pid_t pid)
+{
+    mq_cache_entry_t *entry = &cache->entries[pseudo_port];
+    mq_cache_ref_t ref = {.mqd = -1, .pseudo_port = pseudo_port, .cached = false};
+    uint64_t now = get_monotonic_ns();
+    int open_errno;
+
+    lock_cache(cache);
+    if (now - cache->last_sweep_ns > MQ_CACHE_SWEEP_NS)
+    {
+        sweep_idle(cache, now);
+    }
+    if (entry->open && !entry->dropped && entry->pid == pid)
+    {
+        cache->hits++;
+        entry->refs++;
+        entry->last_used_ns = now;
+        ref.mqd = entry->mqd;
+        ref.cached = true;
+        unlock_cache(cache);
+        return ref;
+    }
+
+    cache->misses++;
+    if (entry->open && !entry->dropped)
+    {
+        /* Another client took over this pseudo_port. */
+        entry->dropped = true;
+        cache->drops++;
+    }
+    if (entry->open && 0 == entry->refs)
+    {
+        close_entry(cache, entry);
+    }
+    /* If the slot is still busy or nothing can be evicted, do not cache. */
+    bool cacheable = !entry->open &&
+        (cache->open_no < cache->capacity || evict_lru(cache));
+
+    ref.mqd = open_client_mq(pseudo_port);
+    open_errno = errno;
+    if (ref.mqd != -1 && cacheable)
+    {
+        *entry = (mq_cache_entry_t){
+            .mqd = ref.mqd,
+            .pid = pid,
+            .open = true,
+            .dropped = false,
+            .refs = 1,
+            .last_used_ns = now
+        };
+        cache->open_no++;
+        ref.cached = true;
+    }
+    unlock_cache(cache);
+    errno = open_errno;
+    return ref;
+}
+
+void mq_cache_put(mq_cache_t *cache, mq_cache_ref_t ref, bool failed)
+{
+    mq_cache_entry_t *entry = &cache->entries[ref.pseudo_port];
+    int rc;
+
+    if (-1 == ref.mqd)
+    {
+        return;
+    }
+    if (!ref.cached)
+    {
+        rc = mq_close(ref.mqd);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+        return;
+    }
+
+    lock_cache(cache);
+    entry->refs--;
+    if (failed && !entry->dropped)
+    {
+        entry->dropped = true;
+        cache->drops++;
+    }
+    if (entry->dropped && 0 == entry->refs)
+    {
+        close_entry(cache, entry);
+    }
+    unlock_cache(cache);
+}
+
+void mq_cache_destroy(mq_cache_t *cache)
+{
+    for (unsigned int i = 0; i < MQ_CACHE_SLOTS_NO; i++)
+    {
+        if (cache->entries[i].open)
+        {
+            close_entry(cache, &cache->entries[i]);
+        }
+    }
+    pthread_mutex_destroy(&cache->lock);
+}
+
+void mq_cache_print_stats(mq_cache_t *cache, FILE *out)
+{
+    lock_cache(cache);
+    uint64_t lookups = cache->hits + cache->misses;
+    fprintf(out, "Reply queue cache: capacity %u; open %u; hits %llu; misses %llu;"
+            " hit rate %.1f%%; evictions %llu; drops %llu\n",
+            cache->capacity, cache->open_no,
+            (unsigned long long)cache->hits, (unsigned long long)cache->misses,
+            lookups ? 100.0 * cache->hits / lookups : 0.0,
+            (unsigned long long)cache->evictions, (unsigned long long)cache->drops);
+    unlock_cache(cache);
+}
@@ -0,0 +1,179 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file mq_cache.h
+*
+* \brief Cache of open client reply queue descriptors, so the server does not
+*        have to mq_open and mq_close the queue around every response. Entries
+*        are keyed by pseudo_port and remember the pid that last used them: a
+*        different pid on the same pseudo_port means a new queue, so the old
+*        descriptor is dropped.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef MQ_CACHE_H
+#define MQ_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <mqueue.h>
+#include <pthread.h>
+#include <sys/types.h>  /* For pid_t */
+
+#define MQ_CACHE_SLOTS_NO (UINT8_MAX + 1) /**< One for every pseudo_port. */
+
+/*
+*******************************************************************************
+*   mq_cache_entry_t
+*******************************************************************************
+*
+*  \brief           <b> mq_cache_entry_t </b>\n
+*                   One cached descriptor. Private to mq_cache.c.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    mqd_t mqd;
+    pid_t pid;
+    bool open;
+    bool dropped;       /**< Close as soon as refs reaches 0. */
+    unsigned int refs;  /**< Workers currently sending on mqd. */
+    uint64_t last_used_ns;
+} mq_cache_entry_t;
+
+/*
+*******************************************************************************
+*   mq_cache_ref_t
+*******************************************************************************
+*
+*  \brief           <b> mq_cache_ref_t </b>\n
+*                   What mq_cache_get hands out. Give it back with
+*                   mq_cache_put.
+*
+*  \var             mqd                               Descriptor to send on,
+*                                                     -1 if mq_open failed.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    mqd_t mqd;
+    uint8_t pseudo_port;
+    bool cached;        /**< false: mqd is private and closed by put. */
+} mq_cache_ref_t;
+
+/*
+*******************************************************************************
+*   mq_cache_t
+*******************************************************************************
+*
+*  \brief           <b> mq_cache_t </b>\n
+*                   The cache. Treat the members as private.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    pthread_mutex_t lock;
+    mq_cache_entry_t entries[MQ_CACHE_SLOTS_NO];
+    unsigned int capacity;
+    unsigned int open_no;
+    uint64_t idle_ns;
+    uint64_t last_sweep_ns;
+
+    /* Statistics, protected by lock. */
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;     /**< Closed for capacity or idleness. */
+    uint64_t drops;         /**< Closed after a failure or a pid change. */
+} mq_cache_t;
+
+/*
+*******************************************************************************
+*   mq_cache_init
+*******************************************************************************
+*
+*  \brief           <b> mq_cache_init </b>\n
+*                   Initializes an empty cache holding at most capacity open
+*                   descriptors. Descriptors unused for idle_sec seconds are
+*                   closed.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int mq_cache_init(mq_cache_t *cache, unsigned int capacity, unsigned int idle_sec);
+
+/*
+*******************************************************************************
+*   mq_cache_get
+*******************************************************************************
+*
+*  \brief           <b> mq_cache_get </b>\n
+*                   Returns a write descriptor for the reply queue of the
+*                   client pid listening on pseudo_port, opening it on a miss
+*                   and evicting the least recently used entry if the cache is
+*                   full.
+*
+*  \return          ref.mqd is -1 if mq_open failed, errno is set.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+mq_cache_ref_t mq_cache_get(mq_cache_t *cache, uint8_t pseudo_port, pid_t pid);
+
+/*
+*******************************************************************************
+*   mq_cache_put
+*******************************************************************************
+*
+*  \brief           <b> mq_cache_put </b>\n
+*                   Gives back a reference from mq_cache_get. With failed set
+*                   the entry is dropped, so the next get reopens the queue.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void mq_cache_put(mq_cache_t *cache, mq_cache_ref_t ref, bool failed);
+
+/*
+*******************************************************************************
+*   mq_cache_destroy
+*******************************************************************************
+*
+*  \brief           <b> mq_cache_destroy </b>\n
+*                   Closes every descriptor. No reference may be outstanding.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void mq_cache_destroy(mq_cache_t *cache);
+
+/*
+*******************************************************************************
+*   mq_cache_print_stats
+*******************************************************************************
+*
+*  \brief           <b> mq_cache_print_stats </b>\n
+*                   Prints hits, misses, evictions and drops.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void mq_cache_print_stats(mq_cache_t *cache, FILE *out);
+
+#endif /* MQ_CACHE_H */
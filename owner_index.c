@@ -0,0 +1,233 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file owner_index.c
+*
+* \brief Implements the owner index declared in owner_index.h. The owner
+*        table uses linear probing; removing an owner shifts back the ones
+*        probed past its slot, so lookups never meet a deleted slot.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdlib.h>         /* For calloc() and exit() */
+#include "utils.h"
+#include "owner_index.h"
+
+static uint32_t home_slot(const owner_index_t *oi, pid_t owner);
+static uint32_t find_slot(const owner_index_t *oi, pid_t owner);
+static void remove_slot(owner_index_t *oi, uint32_t slot);
+static void grow(owner_index_t *oi);
+static void link_id(owner_index_t *oi, uint32_t id, pid_t owner);
+static int unlink_id(owner_index_t *oi, uint32_t id, pid_t owner);
+
+/* Pids are dense, multiplying spreads neighbours over the table. */
+static uint32_t home_slot(const owner_index_t *oi, pid_t owner)
+{
+    uint32_t hash = (uint32_t)owner * 2654435769u;
+    return (hash ^ hash >> 16) & (oi->slots_no - 1);
+}
+
+/* The slot of owner, or the empty one where it would go. */
+static uint32_t find_slot(const owner_index_t *oi, pid_t owner)
+{
+    uint32_t slot = home_slot(oi, owner);
+
+    while (oi->slots[slot].owner != 0 && oi->slots[slot].owner != owner)
+    {
+        slot = (slot + 1) & (oi->slots_no - 1);
+    }
+    return slot;
+}
+
+static void remove_slot(owner_index_t *oi, uint32_t slot)
+{
+    uint32_t mask = oi->slots_no - 1;
+    uint32_t next = slot;
+
+    for (;;)
+    {
+        next = (next + 1) & mask;
+        if (0 == oi->slots[next].owner)
+        {
+            break;
+        }
+        /* Stays if its home is after the hole, on the way to next. */
+        uint32_t home = home_slot(oi, oi->slots[next].owner);
+        if (((next - home) & mask) < ((next - slot) & mask))
+        {
+            continue;
+        }
+        oi->slots[slot] = oi->slots[next];
+        slot = next;
+    }
+    oi->slots[slot].owner = 0;
+    oi->owners_no--;
+}
+
+static void grow(owner_index_t *oi)
+{
+    oi_slot_t *old_slots = oi->slots;
+    uint32_t old_slots_no = oi->slots_no;
+
+    oi->slots_no *= 2;
+    oi->slots = calloc(oi->slots_no, sizeof(*oi->slots));
+    if (NULL == oi->slots)
+    {
+        handle_error();
+    }
+    for (uint32_t i = 0; i < old_slots_no; i++)
+    {
+        if (old_slots[i].owner != 0)
+        {
+            oi->slots[find_slot(oi, old_slots[i].owner)] = old_slots[i];
+        }
+    }
+    free(old_slots);
+}
+
+static void link_id(owner_index_t *oi, uint32_t id, pid_t owner)
+{
+    uint32_t slot = find_slot(oi, owner);
+
+    if (0 == oi->slots[slot].owner)
+    {
+        if ((oi->owners_no + 1) * 2 > oi->slots_no)
+        {
+            grow(oi);
+            slot = find_slot(oi, owner);
+        }
+        oi->slots[slot] = (oi_slot_t){
+            .owner = owner, .head = OI_NIL, .count = 0, .tag = OI_NO_TAG
+        };
+        oi->owners_no++;
+    }
+    oi_slot_t *entry = &oi->slots[slot];
+    oi->next[id] = entry->head;
+    oi->prev[id] = OI_NIL;
+    if (entry->head != OI_NIL)
+    {
+        oi->prev[entry->head] = id;
+    }
+    entry->head = id;
+    entry->count++;
+    oi->listed_no++;
+}
+
+/* Returns the tag of owner if it was its last id, OI_NO_TAG otherwise. */
+static int unlink_id(owner_index_t *oi, uint32_t id, pid_t owner)
+{
+    uint32_t slot = find_slot(oi, owner);
+    oi_slot_t *entry = &oi->slots[slot];
+    int tag = entry->tag;
+
+    if (OI_NIL == oi->prev[id])
+    {
+        entry->head = oi->next[id];
+    }
+    else
+    {
+        oi->next[oi->prev[id]] = oi->next[id];
+    }
+    if (oi->next[id] != OI_NIL)
+    {
+        oi->prev[oi->next[id]] = oi->prev[id];
+    }
+    entry->count--;
+    oi->listed_no--;
+    if (entry->count > 0)
+    {
+        return OI_NO_TAG;
+    }
+    remove_slot(oi, slot);
+    return tag;
+}
+
+int oi_init(owner_index_t *oi, uint32_t ids_no)
+{
+    oi->ids_no = ids_no;
+    oi->slots_no = OI_SLOTS_MIN;
+    oi->owners_no = 0;
+    oi->listed_no = 0;
+    oi->next = calloc(ids_no, sizeof(*oi->next));
+    oi->prev = calloc(ids_no, sizeof(*oi->prev));
+    oi->owners = calloc(ids_no, sizeof(*oi->owners));
+    oi->slots = calloc(oi->slots_no, sizeof(*oi->slots));
+    if (NULL == oi->next || NULL == oi->prev || NULL == oi->owners || NULL == oi->slots)
+    {
+        handle_error();
+    }
+    return 0;
+}
+
+int oi_set(owner_index_t *oi, uint32_t id, pid_t owner)
+{
+    pid_t old_owner = oi->owners[id];
+    int dropped_tag = OI_NO_TAG;
+
+    if (old_owner == owner)
+    {
+        return OI_NO_TAG;
+    }
+    if (old_owner != 0)
+    {
+        dropped_tag = unlink_id(oi, id, old_owner);
+    }
+    if (owner != 0)
+    {
+        link_id(oi, id, owner);
+    }
+    oi->owners[id] = owner;
+    return dropped_tag;
+}
+
+int *oi_tag(owner_index_t *oi, pid_t owner)
+{
+    oi_slot_t *entry = &oi->slots[find_slot(oi, owner)];
+
+    if (0 == owner || 0 == entry->owner)
+    {
+        return NULL;
+    }
+    return &entry->tag;
+}
+
+void oi_for_each_owner(const owner_index_t *oi, oi_owner_f f, void *ctx)
+{
+    for (uint32_t i = 0; i < oi->slots_no; i++)
+    {
+        if (oi->slots[i].owner != 0)
+        {
+            f(oi->slots[i].owner, oi->slots[i].tag, ctx);
+        }
+    }
+}
+
+uint32_t oi_first(const owner_index_t *oi, pid_t owner, uint32_t *count)
+{
+    const oi_slot_t *entry = &oi->slots[find_slot(oi, owner)];
+
+    if (0 == owner || 0 == entry->owner)
+    {
+        *count = 0;
+        return OI_NIL;
+    }
+    *count = entry->count;
+    return entry->head;
+}
+
+uint32_t oi_next(const owner_index_t *oi, uint32_t id)
+{
+    return oi->next[id];
+}
+
+void oi_destroy(owner_index_t *oi)
+{
+    free(oi->next);
+    free(oi->prev);
+    free(oi->owners);
+    free(oi->slots);
+}
@@ -0,0 +1,188 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file owner_index.h
+*
+* \brief Index from an owner pid to the numeric ids it holds, over a fixed
+*        set of ids. Every id is listed under at most one owner. Listing,
+*        moving and unlisting an id are O(1), and so is finding the first
+*        id of an owner; walking its ids costs the ids it holds. The owners
+*        are kept in an open addressing hash table that grows with them,
+*        each with a tag left to the user. Not thread-safe.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef OWNER_INDEX_H
+#define OWNER_INDEX_H
+
+#include <stdint.h>
+#include <sys/types.h>  /* For pid_t */
+
+#define OI_NIL UINT32_MAX
+#define OI_SLOTS_MIN 64 /**< Initial size of the owner table, a power of two. */
+#define OI_NO_TAG (-1)  /**< Tag of an owner when it gets its first id. */
+
+typedef void (*oi_owner_f)(pid_t owner, int tag, void *ctx);
+
+/*
+*******************************************************************************
+*   oi_slot_t
+*******************************************************************************
+*
+*  \brief           <b> oi_slot_t </b>\n
+*                   One owner in the hash table, the head of the list of its
+*                   ids and their number.
+*
+*  \var             owner                             0 for an empty slot.
+*
+*  \var             tag                               Set by the user, see
+*                                                     oi_tag.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    pid_t owner;
+    uint32_t head;
+    uint32_t count;
+    int tag;
+} oi_slot_t;
+
+/*
+*******************************************************************************
+*   owner_index_t
+*******************************************************************************
+*
+*  \brief           <b> owner_index_t </b>\n
+*                   The index. The ids of an owner form a doubly linked list
+*                   ended by OI_NIL. Treat the members as private.
+*
+*  \var             owners                            Owner every id is
+*                                                     listed under, 0 if
+*                                                     none.
+*
+*  \var             listed_no                         Ids listed under any
+*                                                     owner.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    uint32_t ids_no;
+    uint32_t *next;
+    uint32_t *prev;
+    pid_t *owners;
+    oi_slot_t *slots;
+    uint32_t slots_no;      /**< A power of two, at least twice owners_no. */
+    uint32_t owners_no;
+    uint32_t listed_no;
+} owner_index_t;
+
+/*
+*******************************************************************************
+*   oi_init
+*******************************************************************************
+*
+*  \brief           <b> oi_init </b>\n
+*                   Creates an empty index for ids 0 to ids_no - 1. The
+*                   arrays are zero filled lazily, ids never listed cost
+*                   nothing.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int oi_init(owner_index_t *oi, uint32_t ids_no);
+
+/*
+*******************************************************************************
+*   oi_set
+*******************************************************************************
+*
+*  \brief           <b> oi_set </b>\n
+*                   Lists id under owner, moving it if it was listed under
+*                   another one. An owner of 0 unlists it.
+*
+*  \return          The tag of the owner id was listed under, if it holds
+*                   no id any more, so what the tag refers to can be
+*                   released. OI_NO_TAG otherwise.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int oi_set(owner_index_t *oi, uint32_t id, pid_t owner);
+
+/*
+*******************************************************************************
+*   oi_tag
+*******************************************************************************
+*
+*  \brief           <b> oi_tag </b>\n
+*                   The tag of owner, to read or set, valid until the next
+*                   oi_set. It lives as long as owner holds ids, starting
+*                   as OI_NO_TAG.
+*
+*  \return          NULL if owner holds no id.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int *oi_tag(owner_index_t *oi, pid_t owner);
+
+/*
+*******************************************************************************
+*   oi_for_each_owner
+*******************************************************************************
+*
+*  \brief           <b> oi_for_each_owner </b>\n
+*                   Calls f(owner, tag, ctx) for every owner holding ids.
+*                   f must not change the index.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void oi_for_each_owner(const owner_index_t *oi, oi_owner_f f, void *ctx);
+
+/*
+*******************************************************************************
+*   oi_first / oi_next
+*******************************************************************************
+*
+*  \brief           <b> oi_first / oi_next </b>\n
+*                   Walk the ids of owner, in no particular order. oi_first
+*                   also gives their number through count.
+*
+*  \return          An id, OI_NIL after the last one.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+uint32_t oi_first(const owner_index_t *oi, pid_t owner, uint32_t *count);
+uint32_t oi_next(const owner_index_t *oi, uint32_t id);
+
+/*
+*******************************************************************************
+*   oi_destroy
+*******************************************************************************
+*
+*  \brief           <b> oi_destroy </b>\n
+*                   Frees the index.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void oi_destroy(owner_index_t *oi);
+
+#endif /* OWNER_INDEX_H */
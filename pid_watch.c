@@ -0,0 +1,209 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file pid_watch.c
+*
+* \brief Implements the process watch declared in pid_watch.h. A pidfd
+*        turns readable once its process exits; it is watched with
+*        EPOLLONESHOT, so an exit is reported once even while the pidfd
+*        stays open.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#define _GNU_SOURCE         /* For syscall */
+#include <stdlib.h>         /* For exit() */
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "utils.h"
+#include "pid_watch.h"
+
+static void *watch_f(void *arg);
+
+/* The pid in the high half of the epoll data and the pidfd in the low one,
+ * the wake_fd has pid 0. */
+static void *watch_f(void *arg)
+{
+    pid_watch_t *watch = arg;
+    struct epoll_event events[PID_WATCH_EVENTS_MAX];
+
+    for (;;)
+    {
+        int events_no = epoll_wait(watch->epoll_fd, events, PID_WATCH_EVENTS_MAX, -1);
+        if (-1 == events_no)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            handle_error();
+        }
+        for (int i = 0; i < events_no; i++)
+        {
+            pid_t pid = (pid_t)(uint32_t)(events[i].data.u64 >> 32);
+            int pidfd = (int)(uint32_t)events[i].data.u64;
+            if (0 == pid)
+            {
+                return NULL;
+            }
+            atomic_fetch_add_explicit(&watch->exited_no, 1, memory_order_relaxed);
+            watch->exited(pid, pidfd, watch->ctx);
+        }
+    }
+}
+
+int pid_watch_init(pid_watch_t *watch, pid_exit_f exited, void *ctx)
+{
+    struct epoll_event event = {.events = EPOLLIN};
+    struct rlimit limit;
+    int rc;
+
+    memset(watch, 0, sizeof(*watch));
+    watch->exited = exited;
+    watch->ctx = ctx;
+    atomic_init(&watch->watched_no, 0);
+    atomic_init(&watch->exited_no, 0);
+    atomic_init(&watch->failed_no, 0);
+
+    rc = getrlimit(RLIMIT_NOFILE, &limit);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    if (limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        rc = setrlimit(RLIMIT_NOFILE, &limit);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+    }
+    watch->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (-1 == watch->epoll_fd)
+    {
+        handle_error();
+    }
+    watch->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (-1 == watch->wake_fd)
+    {
+        handle_error();
+    }
+    event.data.u64 = (uint32_t)watch->wake_fd;
+    rc = epoll_ctl(watch->epoll_fd, EPOLL_CTL_ADD, watch->wake_fd, &event);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    return 0;
+}
+
+int pid_watch_start(pid_watch_t *watch)
+{
+    int rc = pthread_create(&watch->thread, NULL, watch_f, watch);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    return 0;
+}
+
+int pid_watch_add(pid_watch_t *watch, pid_t pid)
+{
+    struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT};
+
+    if (pid <= 0)
+    {
+        errno = ESRCH;
+        return -1;
+    }
+    /* Opened close-on-exec. */
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (-1 == pidfd && ESRCH == errno)
+    {
+        /* Exited already: a counter that is readable from the start stands
+         * in for its pidfd. */
+        pidfd = eventfd(1, EFD_CLOEXEC);
+    }
+    if (-1 == pidfd)
+    {
+        if (EMFILE == errno || ENFILE == errno || ENOSYS == errno)
+        {
+            atomic_fetch_add_explicit(&watch->failed_no, 1, memory_order_relaxed);
+            return -1;
+        }
+        handle_error();
+    }
+    event.data.u64 = (uint64_t)(uint32_t)pid << 32 | (uint32_t)pidfd;
+    int rc = epoll_ctl(watch->epoll_fd, EPOLL_CTL_ADD, pidfd, &event);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    atomic_fetch_add_explicit(&watch->watched_no, 1, memory_order_relaxed);
+    return pidfd;
+}
+
+void pid_watch_remove(pid_watch_t *watch, int pidfd)
+{
+    int rc = epoll_ctl(watch->epoll_fd, EPOLL_CTL_DEL, pidfd, NULL);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    rc = close(pidfd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
+
+bool pid_watch_exited(int pidfd)
+{
+    struct pollfd pfd = {.fd = pidfd, .events = POLLIN};
+
+    int rc = poll(&pfd, 1, 0);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    return rc > 0 && (pfd.revents & POLLIN);
+}
+
+void pid_watch_stop(pid_watch_t *watch)
+{
+    uint64_t one = 1;
+
+    ssize_t chr_no = write(watch->wake_fd, &one, sizeof(one));
+    if (-1 == chr_no)
+    {
+        handle_error();
+    }
+    int rc = pthread_join(watch->thread, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+}
+
+void pid_watch_destroy(pid_watch_t *watch)
+{
+    int rc = close(watch->wake_fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    rc = close(watch->epoll_fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
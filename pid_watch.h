@@ -0,0 +1,189 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file pid_watch.h
+*
+* \brief Watches processes for their exit. Every watched process has a
+*        pidfd, from pidfd_open, in one epoll set; a thread waits on it and
+*        calls back once for every process that exits, so watching costs
+*        nothing per process until it exits, however many are watched.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef PID_WATCH_H
+#define PID_WATCH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/types.h>  /* For pid_t */
+
+#define PID_WATCH_EVENTS_MAX 64 /**< Exits taken from epoll at once. */
+
+/*
+*******************************************************************************
+*   pid_exit_f
+*******************************************************************************
+*
+*  \brief           <b> pid_exit_f </b>\n
+*                   Called by the watching thread, once, after the process
+*                   pid watched through pidfd exited. pidfd is not closed:
+*                   it is left to pid_watch_remove. The event may come after
+*                   pidfd was removed, and its number reused; check
+*                   pid_watch_exited first.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef void (*pid_exit_f)(pid_t pid, int pidfd, void *ctx);
+
+/*
+*******************************************************************************
+*   pid_watch_t
+*******************************************************************************
+*
+*  \brief           <b> pid_watch_t </b>\n
+*                   The epoll set and its thread. Treat the members as
+*                   private.
+*
+*  \var             failed_no                         pids not watched, for
+*                                                     lack of descriptors or
+*                                                     of pidfd_open.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    int epoll_fd;
+    int wake_fd;            /**< eventfd stopping the thread. */
+    pid_exit_f exited;
+    void *ctx;
+    pthread_t thread;
+    atomic_uint_fast64_t watched_no;
+    atomic_uint_fast64_t exited_no;
+    atomic_uint_fast64_t failed_no;
+} pid_watch_t;
+
+/*
+*******************************************************************************
+*   pid_watch_init
+*******************************************************************************
+*
+*  \brief           <b> pid_watch_init </b>\n
+*                   Creates the epoll set. Processes can be added at once,
+*                   their exits are reported after pid_watch_start. Raises
+*                   the soft limit of open files to the hard one, every
+*                   watched process takes a descriptor.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int pid_watch_init(pid_watch_t *watch, pid_exit_f exited, void *ctx);
+
+/*
+*******************************************************************************
+*   pid_watch_start
+*******************************************************************************
+*
+*  \brief           <b> pid_watch_start </b>\n
+*                   Starts the thread calling exited.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int pid_watch_start(pid_watch_t *watch);
+
+/*
+*******************************************************************************
+*   pid_watch_add
+*******************************************************************************
+*
+*  \brief           <b> pid_watch_add </b>\n
+*                   Watches pid for its exit. A pid without a process is
+*                   taken for one that exited, and reported at once.
+*
+*  \return          The pidfd, to pass to pid_watch_remove.
+*
+*  \return          -1                     pid cannot be watched: errno
+*                                          ESRCH for a pid not above 0,
+*                                          EMFILE if out of descriptors,
+*                                          ENOSYS without pidfd_open.
+*                                          Other errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int pid_watch_add(pid_watch_t *watch, pid_t pid);
+
+/*
+*******************************************************************************
+*   pid_watch_remove
+*******************************************************************************
+*
+*  \brief           <b> pid_watch_remove </b>\n
+*                   Stops watching through pidfd and closes it.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void pid_watch_remove(pid_watch_t *watch, int pidfd);
+
+/*
+*******************************************************************************
+*   pid_watch_exited
+*******************************************************************************
+*
+*  \brief           <b> pid_watch_exited </b>\n
+*                   Whether the process of pidfd has exited.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+bool pid_watch_exited(int pidfd);
+
+/*
+*******************************************************************************
+*   pid_watch_stop
+*******************************************************************************
+*
+*  \brief           <b> pid_watch_stop </b>\n
+*                   Stops the thread. Processes can still be added and
+*                   removed, their exits are not reported any more.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void pid_watch_stop(pid_watch_t *watch);
+
+/*
+*******************************************************************************
+*   pid_watch_destroy
+*******************************************************************************
+*
+*  \brief           <b> pid_watch_destroy </b>\n
+*                   Closes the epoll set, after pid_watch_stop. The pidfds
+*                   still watched are left to the caller to remove first.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void pid_watch_destroy(pid_watch_t *watch);
+
+#endif /* PID_WATCH_H */
@@ -10,6 +10,7 @@
 *
 * \version 1.0 13.01.2023 Mihnea SERBAN created
 * \version 1.1 23.01.2023 Mihnea SERBAN modified
+* \version 1.2 17.10.2026 Mihnea SERBAN modified
 *
 *//**************************** FILE HEADER *********************************/
 
@@ -28,430 +29,1655 @@
 #include <stdint.h>
 #include <time.h>
 #include <limits.h>
+#include <endian.h>
 #include "utils.h"
 #include "constants.h"
 #include "common.h"
+#include "work_pool.h"
+#include "tok_db.h"
+#include "mq_cache.h"
+#include "logger.h"
+#include "metrics.h"
+#include "shm_ring.h"
+#include "ev_loop.h"
+#include "handoff.h"
+#include "admission.h"
 
-#define OPEN_BUF_LEN 4096
 #define WORKERS_NO 12
+#define WORK_QUEUE_LEN 64
+#define DB_FLUSH_INTERVAL_MS 100
+#define MQ_CACHE_CAPACITY 64
+#define MQ_CACHE_IDLE_SEC 30
+#define HANDOFF_DRAIN_MS 1000   /**< Left to send the replies still waiting. */
+#define LANE_WEIGHT_INTERACTIVE 8
+#define LANE_WEIGHT_NORMAL 4
+#define LANE_WEIGHT_BATCH 1
+#define LANE_STARVE_MS 50       /**< Longest wait of a normal or batch request
+                                     before it is served first. */
+#define ADMISSION_DEADLINE_MS 1000
 
 typedef struct {
-    pid_t owner;
-    time_t aq_time;
-} db_entry_t;
+    tok_db_t *db;           /**< Shared by every shard. */
+    mq_cache_t *mq_cache;   /**< Reply queues, one cache for each shard. */
+    metrics_t *metrics;
+    shm_ring_t *ring;       /**< NULL unless serving the shared memory ring. */
+    ev_loop_t *loop;        /**< Replies go through it, NULL without -m epoll. */
+    handoff_t *handoff;     /**< Only for the main queue, NULL for shards. */
+    admission_t *admission; /**< Shared by every shard. */
+    mqd_t req_mq;           /**< Sampled by admission control when requests
+                                 go to the pool, -1 otherwise. */
+} server_ctx_t;
 
 typedef struct {
-    db_entry_t entry;
-    uint8_t token;
-    uint8_t pseudo_port;
-    int db_fd;
-    pthread_mutex_t *db_mutex;
-} th_info_t;
+    server_ctx_t *server;
+    work_pool_t *pool;
+} ring_receiver_ctx_t;
 
-static int open_database(int *fd);
-static int write_tok_info(int fd, uint16_t token, db_entry_t entry);
-static off_t get_offset(uint16_t token);
-static void *th_f(void* args);
+/* What a new server has to share with this one to take over. */
+typedef struct {
+    DB_BACKEND backend;
+    uint32_t tokens_no;
+    unsigned int shards_no;
+    bool use_ring;
+} handoff_ctx_t;
 
+/* Answers to the records of a wire batch, sent in one message once every
+ * record is served. */
+typedef struct {
+    uint16_t count;
+    char msg[sizeof(wire_header_t) + WIRE_BATCH_MAX * sizeof(wire_response_t)];
+} reply_batch_t;
 
-static const char k_db_magic_no[] = {0x4E, 0x41, 0x4E, 0x4F, 0x44, 0x42, 0x00, 0x01};
+/*
+*******************************************************************************
+*   shard_t
+*******************************************************************************
+*
+*  \brief           <b> shard_t </b>\n
+*                   A thread serving the requests of its own queue, in
+*                   place, for the tokens of its range. ctx shares the
+*                   database, whose stripes are aligned with the ranges, and
+*                   points to the shard's own reply queue cache, or its own
+*                   event loop.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    server_ctx_t ctx;
+    mq_cache_t mq_cache;
+    ev_loop_t loop;
+    unsigned int index;
+    mqd_t mq;
+    const atomic_bool *closing;
+    pthread_t thread;
+} shard_t;
 
-static off_t get_offset(uint16_t token)
-{
-    return sizeof(k_db_magic_no) + token*sizeof(db_entry_t);
-}
+_Static_assert(DB_STRIPES_NO % SHARDS_MAX == 0, "shards must not share stripes");
 
-static int open_database(int *fd) {
-    struct stat db_st;
-    int db_fd;
-    int flags;
-    int rc;
-    const int open_flags = O_CREAT | O_NONBLOCK | O_NOFOLLOW | O_RDWR;
-    const mode_t open_mode = MQ_MODE;
-    bool discard_content = false;
-    static_assert(sizeof(db_entry_t) <= OPEN_BUF_LEN);
-    char buf[OPEN_BUF_LEN];
-    ssize_t chr_no = 0;
+static bool send_reply(server_ctx_t *server, bool via_ring, uint8_t pseudo_port, pid_t pid,
+        const void *msg, size_t msg_len, time_t current_time);
+static bool send_response(server_ctx_t *server, reply_batch_t *batch, bool via_ring,
+        uint8_t pseudo_port, const response_msg_t *response, time_t current_time);
+static void serve_token(server_ctx_t *server, const request_msg_t *request, bool via_ring,
+        time_t current_time, reply_batch_t *batch);
+static void serve_bulk(server_ctx_t *server, const bulk_request_msg_t *request, bool via_ring,
+        time_t current_time);
+static void serve_any(server_ctx_t *server, const any_request_msg_t *request, bool via_ring,
+        time_t current_time, reply_batch_t *batch);
+static void serve_release(server_ctx_t *server, const request_msg_t *request, bool via_ring,
+        time_t current_time, reply_batch_t *batch);
+static void serve_hello(server_ctx_t *server, const request_msg_t *request, bool via_ring,
+        time_t current_time);
+static void serve_query(server_ctx_t *server, const query_request_msg_t *request,
+        bool via_ring, time_t current_time);
+static void serve_batch(server_ctx_t *server, const wire_batch_t *batch, bool via_ring,
+        time_t current_time);
+static void serve_busy(server_ctx_t *server, const work_item_t *item, time_t current_time);
+static time_t get_req_time(const work_item_t *item);
+static void count_result(server_ctx_t *server, int result);
+static void count_request(metrics_t *metrics, int req_type);
+static void th_f(const work_item_t *item, void *ctx);
+static bool parse_batch(const char *buf, ssize_t len, wire_batch_t *batch);
+static bool parse_request(const char *buf, ssize_t len, work_item_t *item);
+static uint8_t get_request_lane(const work_item_t *item);
+static bool accept_request(server_ctx_t *server, work_pool_t *pool, const char *buf,
+        ssize_t len, bool via_ring, unsigned int prio);
+static void *ring_receiver_f(void *arg);
+static void forward_request(int req_type);
+static int check_handoff(const handoff_request_t *request, void *ctx);
+static void stop_for_handoff(void *ctx);
+static void set_blocking(mqd_t mq);
+static bool shard_request_f(const char *buf, ssize_t len, unsigned int prio, void *ctx);
+static void *shard_f(void *arg);
+static bool main_request_f(const char *buf, ssize_t len, unsigned int prio, void *ctx);
+static unsigned int parse_shards_arg(const char *arg, char opt);
+static void parse_weights_arg(const char *arg, char opt, unsigned int *weights);
+static uint32_t parse_tokens_arg(const char *arg, char opt);
+static unsigned int parse_count_arg(const char *arg, char opt);
+static void print_usage(const char *prog);
 
-    db_fd = open(DATABASE_NAME, open_flags, open_mode);
-    if (-1 == db_fd)
-    {
-        handle_error();
-    }
-    rc = fstat(db_fd, &db_st);
-    if (-1 == rc)
-    {
-        handle_error();
-    }
-    if (!S_ISREG(db_st.st_mode))
-    {
-        fprintf(stderr, "%s:%d ./" DATABASE_NAME " is not a regular file\n", __FILE__, __LINE__);
-        exit(1);
-    }
 
-    /* discard O_NONBLOCK */
-    flags = fcntl(db_fd, F_GETFL);
-    if (-1 == flags)
-    {
-        handle_error();
-    }
-    rc = fcntl(db_fd, F_SETFL, flags & ~O_NONBLOCK);
-    if (-1 == rc)
-    {
-        handle_error();
-    }
+static bool send_reply(server_ctx_t *server, bool via_ring, uint8_t pseudo_port, pid_t pid,
+        const void *msg, size_t msg_len, time_t current_time)
+{
+    mq_cache_ref_t client_mq;
+    bool send_failed = false;
+    unsigned int msg_prio = MQ_DEFAULT_PRIO;
+    int rc;
 
-    /* If file has the wrong size */
-    static_assert(sizeof(db_entry_t) < SSIZE_MAX,
-            "sizeof(db_entry_t) is way to large\n");
-    if (db_st.st_size != get_offset(DB_MAX_TOK) + (ssize_t)sizeof(db_entry_t))
-    {
-        discard_content = true;
-    }
-    else
+    /* TODO Should verify with preprocessor directives or static assert if time_t is on 64 bits */
+    /* A current_time of 0 has it long past, a full queue is not waited for. */
+    struct timespec wait_time = {.tv_sec = current_time + DB_ENTRY_TTL, .tv_nsec = 0};
+    if (via_ring)
     {
-        chr_no = read(db_fd, buf, sizeof(k_db_magic_no));
-        if (-1 == chr_no)
+        send_failed = !shm_ring_reply(server->ring, pseudo_port, msg, msg_len, &wait_time);
+        if (send_failed)
         {
-            handle_error();
+            metrics_count(server->metrics, METRIC_SEND_TIMEOUTS, 1);
         }
+        return !send_failed;
+    }
 
-        static_assert(sizeof(k_db_magic_no) == sizeof(uint64_t),
-                "k_db_magic_no has a different size from uint64_t\n");
-        /* Treat magic number as uint64_t for comparison */
-        const void *magic_no = k_db_magic_no;
-        void *read_no = buf;
-        if (*(const uint64_t*)magic_no != *(uint64_t*)read_no)
+    if (server->loop != NULL)
+    {
+        send_failed = !ev_loop_reply(server->loop, pseudo_port, pid, msg, msg_len);
+        if (send_failed)
         {
-            discard_content = true;
+            metrics_count(server->metrics, METRIC_SEND_TIMEOUTS, 1);
         }
+        return !send_failed;
     }
 
-    if (discard_content)
+    /* Open mqueue specified by the client, or reuse the cached one. */
+    client_mq = mq_cache_get(server->mq_cache, pseudo_port, pid);
+    if (-1 == client_mq.mqd)
     {
-        rc = close(db_fd);
-        if (-1 == rc)
-        {
-            handle_error();
-        }
-        db_fd = open(DATABASE_NAME, open_flags | O_TRUNC, open_mode);
-        if (-1 == db_fd)
-        {
-            handle_error();
-        }
-        /* discard O_NONBLOCK */
-        flags = fcntl(db_fd, F_GETFL);
-        if (-1 == flags)
-        {
-            handle_error();
-        }
-        rc = fcntl(db_fd, F_SETFL, flags & ~O_NONBLOCK);
-        if (-1 == rc)
-        {
-            handle_error();
-        }
-        chr_no = write(db_fd, k_db_magic_no, sizeof(k_db_magic_no));
-        if (-1 == chr_no)
+        /* The client closed its queue before its reply, drop the reply. */
+        if (ENOENT == errno)
         {
-            handle_error();
+            metrics_count(server->metrics, METRIC_SEND_TIMEOUTS, 1);
+            return false;
         }
+        handle_error();
+    }
 
-        /* complete all entries with 0 */
-        off_t first_entry = get_offset(0);
-        static_assert(sizeof(int64_t) >= sizeof(off_t));
-        uint64_t remaining_chrs = (uint64_t)(get_offset(DB_MAX_TOK) + sizeof(db_entry_t));
-        memset(buf, 0, sizeof(buf));
-        off_t seek_rc = lseek(db_fd, first_entry, SEEK_SET);
-        if (-1 == seek_rc)
+    rc = mq_timedsend(client_mq.mqd, msg, msg_len, msg_prio, &wait_time);
+    if (-1 == rc)
+    {
+        if (ETIMEDOUT == errno)
         {
-            handle_error();
+            send_failed = true;
+            metrics_count(server->metrics, METRIC_SEND_TIMEOUTS, 1);
         }
-        do
-        {
-            unsigned int chrs_to_write = 0;
-            if (remaining_chrs > sizeof(buf))
-            {
-                chrs_to_write = sizeof(buf);
-            }
-            else
-            {
-                chrs_to_write = remaining_chrs;
-            }
-            chr_no = write(db_fd, buf, chrs_to_write);
-            if (-1 == chr_no)
-            {
-                handle_error();
-            }
-            remaining_chrs -= chr_no;
-        } while(remaining_chrs > 0);
-        rc = fsync(db_fd);
-        if (rc != 0)
+        else
         {
             handle_error();
         }
     }
 
-    /* return db_fd through fd */
-    *fd = db_fd;
-    /* return success */
-    return 0;
+    /* Hand the queue back to the cache, a failed one is closed. */
+    mq_cache_put(server->mq_cache, client_mq, send_failed);
+    return !send_failed;
 }
 
-static int write_tok_info(int fd, uint16_t token, db_entry_t entry)
+/* Sends response, or adds it to the answers of the wire batch being served. */
+static bool send_response(server_ctx_t *server, reply_batch_t *batch, bool via_ring,
+        uint8_t pseudo_port, const response_msg_t *response, time_t current_time)
 {
-    off_t off = get_offset(token);
-    int rc;
-    off_t seek_rc;
-    db_entry_t old_entry;
-    seek_rc = lseek(fd, off, SEEK_SET);
-    if (-1 == seek_rc)
+    if (NULL == batch)
     {
-        handle_error();
+        return send_reply(server, via_ring, pseudo_port, response->pid, response,
+                sizeof(*response), current_time);
     }
-    rc = read(fd, &old_entry, sizeof(entry));
-    if (-1 == rc)
+    wire_response_t record = {
+        .resp_type = response->resp_type,
+        .token = htole32(response->token_requested),
+        .req_id = htole64(response->req_id)
+    };
+    memcpy(batch->msg + wire_response_len(batch->count), &record, sizeof(record));
+    batch->count++;
+    return true;
+}
+
+static void serve_token(server_ctx_t *server, const request_msg_t *request, bool via_ring,
+        time_t current_time, reply_batch_t *batch)
+{
+    db_entry_t entry = {.owner = request->pid, .aq_time = request->req_time};
+    uint32_t token_requested = request->token_requested;
+    response_msg_t response_msg = {0};
+
+    /* Attempt to reserve the tokken. */
+    int write_result = db_reserve(server->db, token_requested, entry);
+
+    /* Send results to the client. */
+    response_msg.resp_type = write_result;
+    count_result(server, write_result);
+    response_msg.token_requested = token_requested;
+    response_msg.pid = entry.owner;
+    response_msg.req_id = request->req_id;
+
+    switch (write_result)
     {
-        handle_error();
+        case ACK:
+        LOG(LOG_INFO, "Server responding to TOKEN request token:%3lld; pid:%5lld; with ACK\n",
+                token_requested, entry.owner);
+        break;
+        case TOKEN_NOT_AVAILABLE:
+        LOG(LOG_INFO, "Server responding to TOKEN request token:%3lld; pid:%5lld; with TOKEN_NOT_AVAILABLE.\n",
+                token_requested, entry.owner);
+        break;
+        default:
+        LOG(LOG_WARN, "Server Responding to TOKEN request token:%3lld; pid:%5lld; with unkown response.\n",
+                token_requested, entry.owner);
     }
+    if (send_response(server, batch, via_ring, request->pseudo_port, &response_msg,
+                current_time))
+    {
+        LOG(LOG_DEBUG, "Server responded to TOKEN request token:%3lld; pid:%5lld; succesfully.\n",
+                token_requested, entry.owner);
+    }
+    else
+    {
+        LOG(LOG_WARN, "Server response to TOKEN request token:%3lld; pid:%5lld; timed out.\n",
+                token_requested, entry.owner);
+    }
+}
 
-    errno = 0;
-    time_t current_time = time(NULL);
-    if (-1 == current_time)
+static void serve_bulk(server_ctx_t *server, const bulk_request_msg_t *request, bool via_ring,
+        time_t current_time)
+{
+    db_entry_t entry = {.owner = request->pid, .aq_time = request->req_time};
+    uint32_t tokens[BULK_MAX_TOK];
+    uint8_t results[BULK_MAX_TOK];
+    const uint32_t *requested = request->tokens;
+    bulk_response_msg_t response_msg = {0};
+    static_assert(BULK_MAX_TOK <= DB_BATCH_MAX, "a bulk request does not fit in a batch\n");
+
+    if (request->flags & BULK_RANGE)
     {
-        handle_error();
+        for (unsigned int i = 0; i < request->tokens_no; i++)
+        {
+            tokens[i] = request->tokens[0] + i;
+        }
+        requested = tokens;
+    }
+    unsigned int reserved_no;
+    if (RENEW == request->req_type)
+    {
+        reserved_no = db_renew_many(server->db, requested, request->tokens_no,
+                entry, results);
+    }
+    else
+    {
+        reserved_no = db_reserve_many(server->db, requested, request->tokens_no,
+                entry, request->flags & BULK_ALL_OR_NOTHING, results);
     }
 
-    if (old_entry.owner != 0 &&
-        old_entry.owner != entry.owner &&
-        old_entry.aq_time + DB_ENTRY_TTL > current_time)
+    response_msg.resp_type = BULK_RESULT;
+    response_msg.pid = entry.owner;
+    response_msg.tokens_no = request->tokens_no;
+    response_msg.reserved_no = reserved_no;
+    response_msg.req_id = request->req_id;
+    for (unsigned int i = 0; i < request->tokens_no; i++)
     {
-        return TOKEN_NOT_AVAILABLE;
+        response_msg.results[i].token = requested[i];
+        response_msg.results[i].result = results[i];
+        count_result(server, results[i]);
     }
 
-    seek_rc = lseek(fd, off, SEEK_SET);
-    if (-1 == seek_rc)
+    if (RENEW == request->req_type)
     {
-        handle_error();
+        LOG(LOG_INFO, "Server responding to RENEW request tokens:%3lld; pid:%5lld; with %lld renewed.\n",
+                request->tokens_no, entry.owner, reserved_no);
     }
-    rc = write(fd, &entry, sizeof(entry));
-    if (-1 == rc)
+    else
     {
-        handle_error();
+        LOG(LOG_INFO, "Server responding to TOKEN_BULK request tokens:%3lld; pid:%5lld; with %lld reserved.\n",
+                request->tokens_no, entry.owner, reserved_no);
     }
-    rc = fsync(fd);
-    if (rc != 0)
+    if (!send_reply(server, via_ring, request->pseudo_port, entry.owner, &response_msg,
+                bulk_response_len(request->tokens_no), current_time))
     {
-        handle_error();
+        LOG(LOG_WARN, "Server response to bulk request type:%lld; tokens:%3lld; pid:%5lld; timed out.\n",
+                request->req_type, request->tokens_no, entry.owner);
     }
-    return 0;
 }
 
-static void *th_f(void* args)
+static void serve_any(server_ctx_t *server, const any_request_msg_t *request, bool via_ring,
+        time_t current_time, reply_batch_t *batch)
 {
-    th_info_t *info = args;
-    db_entry_t entry = info->entry;
-    uint16_t token_requested = info->token;
-    uint8_t pseudo_port = info->pseudo_port;
-    int db_fd = info->db_fd;
-    pthread_mutex_t *db_mutex = info->db_mutex;
-    char client_mq_name[NAME_MAX] = {0};
-    mqd_t client_mq;
+    db_entry_t entry = {.owner = request->pid, .aq_time = request->req_time};
     response_msg_t response_msg = {0};
-    unsigned int msg_prio = MQ_DEFAULT_PRIO;
-    int rc;
+    uint32_t token = 0;
 
-    /* Cache time. */
-    time_t current_time = time(NULL);
-    if (-1 == current_time)
+    response_msg.resp_type = db_reserve_any(server->db, request->token_min,
+            request->token_max, entry, &token);
+    count_result(server, response_msg.resp_type);
+    response_msg.token_requested = token;
+    response_msg.pid = entry.owner;
+    response_msg.req_id = request->req_id;
+
+    if (ACK == response_msg.resp_type)
     {
-        handle_error_en(0);
+        LOG(LOG_INFO, "Server responding to TOKEN_ANY request range:%3lld-%3lld; pid:%5lld; with token %3lld.\n",
+                request->token_min, request->token_max, entry.owner, token);
+    }
+    else
+    {
+        LOG(LOG_INFO, "Server responding to TOKEN_ANY request range:%3lld-%3lld; pid:%5lld; with TOKEN_NOT_AVAILABLE.\n",
+                request->token_min, request->token_max, entry.owner);
     }
+    if (!send_response(server, batch, via_ring, request->pseudo_port, &response_msg,
+                current_time))
+    {
+        LOG(LOG_WARN, "Server response to TOKEN_ANY request range:%3lld-%3lld; pid:%5lld; timed out.\n",
+                request->token_min, request->token_max, entry.owner);
+    }
+}
+
+static void serve_release(server_ctx_t *server, const request_msg_t *request, bool via_ring,
+        time_t current_time, reply_batch_t *batch)
+{
+    uint32_t token = request->token_requested;
+    response_msg_t response_msg = {0};
 
-    /* Open mqueue specified by the client. */
-    rc = get_client_mq_name(client_mq_name, sizeof(client_mq_name), pseudo_port);
-    if (rc < 0 || (unsigned int)rc > sizeof(client_mq_name))
+    response_msg.resp_type = db_release(server->db, token, request->pid);
+    count_result(server, response_msg.resp_type);
+    response_msg.token_requested = token;
+    response_msg.pid = request->pid;
+    response_msg.req_id = request->req_id;
+
+    if (ACK == response_msg.resp_type)
     {
-        handle_error();
+        LOG(LOG_INFO, "Server responding to RELEASE request token:%3lld; pid:%5lld; with ACK.\n",
+                token, request->pid);
     }
-    client_mq = mq_open(client_mq_name, O_WRONLY);
-    if (-1 == client_mq)
+    else
     {
-        handle_error();
+        LOG(LOG_INFO, "Server responding to RELEASE request token:%3lld; pid:%5lld; with NOT_OWNER.\n",
+                token, request->pid);
+    }
+    if (!send_response(server, batch, via_ring, request->pseudo_port, &response_msg,
+                current_time))
+    {
+        LOG(LOG_WARN, "Server response to RELEASE request token:%3lld; pid:%5lld; timed out.\n",
+                token, request->pid);
     }
+}
 
-    /* Attempt to reserve the tokken. */
-    rc = pthread_mutex_lock(db_mutex);
-    if (rc != 0)
+/* Agrees on the newest wire format both sides speak, 0 for none. */
+static void serve_hello(server_ctx_t *server, const request_msg_t *request, bool via_ring,
+        time_t current_time)
+{
+    response_msg_t response_msg = {0};
+
+    response_msg.resp_type = ACK;
+    if (request->token_requested >= WIRE_VERSION_MIN)
     {
-        handle_error_en(rc);
+        response_msg.token_requested = request->token_requested < WIRE_VERSION ?
+            request->token_requested : WIRE_VERSION;
     }
-    int write_result = write_tok_info(db_fd, token_requested, entry);
-    rc = pthread_mutex_unlock(db_mutex);
-    if (rc != 0)
+    response_msg.pid = request->pid;
+    response_msg.req_id = request->req_id;
+
+    LOG(LOG_INFO, "Server responding to HELLO pid:%5lld; with wire version %lld.\n",
+            request->pid, response_msg.token_requested);
+    if (!send_reply(server, via_ring, request->pseudo_port, request->pid,
+                &response_msg, sizeof(response_msg), current_time))
     {
-        handle_error_en(rc);
+        LOG(LOG_WARN, "Server response to HELLO pid:%5lld; timed out.\n", request->pid);
     }
+}
 
-    /* Send results to the client. */
-    response_msg.resp_type = write_result;
-    response_msg.token_requested = token_requested;
-    response_msg.pid = entry.owner;
+/* Lists what request->owner holds from the owner index, without touching
+ * the backend. */
+static void serve_query(server_ctx_t *server, const query_request_msg_t *request,
+        bool via_ring, time_t current_time)
+{
+    query_response_msg_t response_msg = {0};
+    db_occupancy_t occupancy;
 
-    /* TODO Should verify with preprocessor directives or static assert if time_t is on 64 bits */
-    struct timespec wait_time = {.tv_sec = current_time + DB_ENTRY_TTL, .tv_nsec = 0};
-    switch (write_result)
+    response_msg.tokens_no = db_query_owner(server->db, request->owner, request->token_min,
+            response_msg.tokens, QUERY_MAX_TOK, &occupancy);
+    response_msg.resp_type = QUERY_RESULT;
+    response_msg.pid = request->pid;
+    response_msg.owner = request->owner;
+    response_msg.held_no = occupancy.held_no;
+    response_msg.used_no = occupancy.used_no;
+    response_msg.owners_no = occupancy.owners_no;
+    response_msg.db_tokens_no = occupancy.tokens_no;
+    response_msg.req_id = request->req_id;
+
+    LOG(LOG_INFO, "Server responding to QUERY owner:%5lld; pid:%5lld; with %lld of %lld tokens held.\n",
+            request->owner, request->pid, response_msg.tokens_no, occupancy.held_no);
+    if (!send_reply(server, via_ring, request->pseudo_port, request->pid, &response_msg,
+                query_response_len(response_msg.tokens_no), current_time))
     {
-        case ACK:
-        printf("Server responding to TOKEN request token:%3d; pid:%5d; with ACK\n",
-                token_requested, entry.owner);
-        break;
-        case TOKEN_NOT_AVAILABLE:
-        printf("Server responding to TOKEN request token:%3d; pid:%5d; with TOKEN_NOT_AVAILABLE.\n",
-                token_requested, entry.owner);
-        break;
-        default:
-        printf("Server Responding to TOKEN request token:%3d; pid:%5d; with unkown response.\n",
-                token_requested, entry.owner);
+        LOG(LOG_WARN, "Server response to QUERY owner:%5lld; pid:%5lld; timed out.\n",
+                request->owner, request->pid);
     }
-    rc = mq_timedsend(client_mq, (char*)&response_msg, sizeof(response_msg), msg_prio, &wait_time);
-    if (-1 == rc)
+}
+
+/* Serves the records of a wire message in order and answers them with one
+ * message. parse_batch checked every record. */
+static void serve_batch(server_ctx_t *server, const wire_batch_t *batch, bool via_ring,
+        time_t current_time)
+{
+    const wire_header_t *header = &batch->header;
+    reply_batch_t reply = {0};
+
+    for (unsigned int i = 0; i < header->count; i++)
     {
-        if (ETIMEDOUT == errno)
+        const wire_request_t *record = &batch->records[i];
+        if (TOKEN_ANY == record->req_type)
         {
-            printf("Server response to TOKEN request token:%3d; pid:%5d; timed out.\n",
-                    token_requested, entry.owner);
+            any_request_msg_t request = {
+                .req_type = TOKEN_ANY,
+                .pid = header->pid,
+                .req_time = le64toh(record->req_time),
+                .pseudo_port = header->pseudo_port,
+                .token_min = le32toh(record->token),
+                .token_max = le32toh(record->token_max),
+                .req_id = le64toh(record->req_id)
+            };
+            serve_any(server, &request, via_ring, current_time, &reply);
+            continue;
+        }
+        request_msg_t request = {
+            .req_type = record->req_type,
+            .token_requested = le32toh(record->token),
+            .pid = header->pid,
+            .pseudo_port = header->pseudo_port,
+            .req_time = le64toh(record->req_time),
+            .req_id = le64toh(record->req_id)
+        };
+        if (TOKEN == record->req_type)
+        {
+            serve_token(server, &request, via_ring, current_time, &reply);
         }
         else
         {
-            handle_error();
+            serve_release(server, &request, via_ring, current_time, &reply);
         }
     }
-    printf("Server responded to TOKEN request token:%3d; pid:%5d; succesfully.\n",
-            token_requested, entry.owner);
-
-    /* Unlink the queue. */
-    rc = mq_close(client_mq);
-    if (-1 == rc)
+    wire_put_header(reply.msg, reply.count, header->pid, header->pseudo_port, header->batch_id);
+    if (!send_reply(server, via_ring, header->pseudo_port, header->pid, reply.msg,
+                wire_response_len(reply.count), current_time))
     {
-        handle_error();
+        LOG(LOG_WARN, "Server response to a batch of %3lld requests pid:%5lld; timed out.\n",
+                header->count, header->pid);
     }
-    return NULL;
 }
 
-int main ()
+/* Answers BUSY to every request of item, without touching the database.
+ * current_time 0 does not wait for a full reply queue. */
+static void serve_busy(server_ctx_t *server, const work_item_t *item, time_t current_time)
 {
-    printf("Starting the server.\n");
-
-    int rc = 0;
-    struct mq_attr qattr = {0};
-    qattr.mq_maxmsg = MQ_MAXMSG;
-    qattr.mq_msgsize = MQ_MSGSIZE;
-    int db_fd;
-    ssize_t read_bytes = 0;
-    bool shall_close = false;
-    unsigned int prio;
-    db_entry_t db_entry = {0};
-    th_info_t th_infos[WORKERS_NO];
-    pthread_t th_ids[WORKERS_NO];
-    int last_worker = -1;
-    int max_worker_no = -1;
-    pthread_mutex_t db_mutex;
-    request_msg_t request;
-    char buf[MQ_MSGSIZE + 1];
+    response_msg_t response_msg = {.resp_type = BUSY};
+    bulk_response_msg_t bulk_msg = {.resp_type = BULK_RESULT};
+    reply_batch_t reply = {0};
+    const void *msg = &response_msg;
+    size_t msg_len = sizeof(response_msg);
+    unsigned int busy_no = 1;
+    uint8_t pseudo_port;
+    pid_t pid;
 
-    mqd_t server_mq;
-    server_mq = mq_open(MQ_REQ_NAME, O_RDONLY | O_CREAT, MQ_MODE, &qattr);
-    if (-1 == server_mq)
+    switch (item->req_type)
     {
-        handle_error();
+        case TOKEN_BULK:
+        case RENEW:
+            pseudo_port = item->bulk.pseudo_port;
+            pid = item->bulk.pid;
+            bulk_msg.pid = pid;
+            bulk_msg.tokens_no = item->bulk.tokens_no;
+            bulk_msg.req_id = item->bulk.req_id;
+            for (unsigned int i = 0; i < item->bulk.tokens_no; i++)
+            {
+                bulk_msg.results[i].token = item->bulk.flags & BULK_RANGE ?
+                    item->bulk.tokens[0] + i : item->bulk.tokens[i];
+                bulk_msg.results[i].result = BUSY;
+            }
+            msg = &bulk_msg;
+            msg_len = bulk_response_len(item->bulk.tokens_no);
+            busy_no = item->bulk.tokens_no;
+        break;
+        case TOKEN_ANY:
+            pseudo_port = item->any.pseudo_port;
+            pid = item->any.pid;
+            response_msg.pid = pid;
+            response_msg.req_id = item->any.req_id;
+        break;
+        case QUERY:
+            pseudo_port = item->query.pseudo_port;
+            pid = item->query.pid;
+            response_msg.pid = pid;
+            response_msg.req_id = item->query.req_id;
+        break;
+        case WIRE_BATCH:
+            pseudo_port = item->batch.header.pseudo_port;
+            pid = item->batch.header.pid;
+            for (unsigned int i = 0; i < item->batch.header.count; i++)
+            {
+                const wire_request_t *record = &item->batch.records[i];
+                response_msg_t record_msg = {
+                    .resp_type = BUSY,
+                    .token_requested = TOKEN_ANY == record->req_type ? 0 : le32toh(record->token),
+                    .req_id = le64toh(record->req_id)
+                };
+                send_response(server, &reply, false, pseudo_port, &record_msg, 0);
+            }
+            wire_put_header(reply.msg, reply.count, pid, pseudo_port, item->batch.header.batch_id);
+            msg = reply.msg;
+            msg_len = wire_response_len(reply.count);
+            busy_no = reply.count;
+        break;
+        default:
+            pseudo_port = item->request.pseudo_port;
+            pid = item->request.pid;
+            response_msg.token_requested = item->request.token_requested;
+            response_msg.pid = pid;
+            response_msg.req_id = item->request.req_id;
     }
-    rc = open_database(&db_fd);
-    if (rc != 0)
+    metrics_count(server->metrics, METRIC_BUSY, busy_no);
+    LOG(LOG_INFO, "Server responding to a request type:%lld; pid:%5lld; with BUSY.\n",
+            item->req_type, pid);
+    if (!send_reply(server, item->via_ring, pseudo_port, pid, msg, msg_len, current_time))
     {
-        handle_error_en(0);
+        LOG(LOG_WARN, "Server response to a request type:%lld; pid:%5lld; timed out.\n",
+                item->req_type, pid);
     }
-    rc = pthread_mutex_init(&db_mutex, NULL);
-    if (rc != 0)
+}
+
+/* When the client sent item, from its req_time, to the second. */
+static time_t get_req_time(const work_item_t *item)
+{
+    switch (item->req_type)
     {
-        handle_error_en(rc);
+        case TOKEN_BULK:
+        case RENEW:
+            return item->bulk.req_time;
+        case TOKEN_ANY:
+            return item->any.req_time;
+        case QUERY:
+            return item->query.req_time;
+        case WIRE_BATCH:
+            return le64toh(item->batch.records[0].req_time);
+        default:
+            return item->request.req_time;
     }
-    printf("The server is ready to recieve requests.\n");
+}
 
-    do
+static void count_result(server_ctx_t *server, int result)
+{
+    switch (result)
     {
-        read_bytes = mq_receive(server_mq, buf, sizeof(buf), &prio);
-        if (read_bytes == -1)
-        {
-            handle_error();
-        }
-        if (read_bytes != sizeof(request))
-        {
-            printf("Server reciceved an aunkown request\n");
-            continue;
-        }
-        memcpy(&request, buf, sizeof(request));
+        case ACK:
+            metrics_count(server->metrics, METRIC_ACK, 1);
+        break;
+        case TOKEN_NOT_AVAILABLE:
+            metrics_count(server->metrics, METRIC_NOT_AVAILABLE, 1);
+        break;
+        case ROLLED_BACK:
+            metrics_count(server->metrics, METRIC_ROLLED_BACK, 1);
+        break;
+        case NOT_OWNER:
+            metrics_count(server->metrics, METRIC_NOT_OWNER, 1);
+        break;
+        default:
+        break;
+    }
+}
 
-        switch(request.req_type)
-        {
-            case TOKEN:
-                printf("Server reciceved a TOKEN request "
-                        "token:%3d; pid:%5d;\n",
-                        request.token_requested, request.pid);
-                db_entry.owner = request.pid;
-                db_entry.aq_time = request.req_time;
-                /* use worker to work on database and send result to client*/
-                if (max_worker_no < WORKERS_NO)
-                {
-                    max_worker_no++;
-                    last_worker++;
-                } else {
-                    last_worker = (last_worker+1) % WORKERS_NO;
-                    pthread_join(th_ids[last_worker], NULL);
-                }
-                th_infos[last_worker].entry = db_entry;
-                th_infos[last_worker].token = request.token_requested;
-                th_infos[last_worker].pseudo_port = request.pseudo_port;
-                th_infos[last_worker].db_fd = db_fd;
-                th_infos[last_worker].db_mutex = &db_mutex;
-                rc = pthread_create(&th_ids[last_worker], NULL, th_f, &th_infos[last_worker]);
-                if (rc != 0)
-                {
-                    handle_error_en(rc);
-                }
-            break;
-            case CLOSE:
-                /* TODO Probably not the safest way to close. */
-                printf("Server reciceved a CLOSE request\n");
-                shall_close = true;
-            break;
-            default:
-                printf("Server reciceved an aunkown request\n");
-        }
-    } while(shall_close != true);
+static void count_request(metrics_t *metrics, int req_type)
+{
+    static const METRIC_COUNTER k_counters[] = {
+        [TOKEN] = METRIC_TOKEN,
+        [TOKEN_BULK] = METRIC_TOKEN_BULK,
+        [TOKEN_ANY] = METRIC_TOKEN_ANY,
+        [RELEASE] = METRIC_RELEASE,
+        [RENEW] = METRIC_RENEW,
+        [QUERY] = METRIC_QUERY
+    };
 
-    printf("Server is closing.\n");
-    for (int i = 0; i < max_worker_no; i++)
+    metrics_count(metrics, METRIC_RECEIVED, 1);
+    /* Types left out of k_counters map to METRIC_RECEIVED, counted already. */
+    if ((unsigned int)req_type < ARRAY_LEN(k_counters) &&
+        k_counters[req_type] != METRIC_RECEIVED)
     {
-        rc = pthread_join(th_ids[i], NULL);
-        if (0 != rc)
-        {
-            handle_error_en(rc);
-        }
+        metrics_count(metrics, k_counters[req_type], 1);
     }
-    printf("Server's workers have been closed\n");
+}
 
-    rc = mq_unlink(MQ_REQ_NAME);
-    if (-1 == rc)
+static void th_f(const work_item_t *item, void *ctx)
+{
+    server_ctx_t *server = ctx;
+    uint64_t start_ns = get_monotonic_ns();
+
+    metrics_time(server->metrics, METRIC_QUEUE_WAIT, start_ns - item->received_ns);
+
+    /* Cache time. */
+    time_t current_time = time(NULL);
+    if (-1 == current_time)
+    {
+        handle_error_en(0);
+    }
+
+    /* HELLO costs less than refusing it. */
+    if (item->req_type != HELLO && admission_late(server->admission, get_req_time(item),
+                current_time, start_ns - item->received_ns))
+    {
+        serve_busy(server, item, current_time);
+        metrics_count(server->metrics, METRIC_DONE,
+                WIRE_BATCH == item->req_type ? item->batch.header.count : 1);
+        return;
+    }
+    switch (item->req_type)
+    {
+        case TOKEN:
+            serve_token(server, &item->request, item->via_ring, current_time, NULL);
+        break;
+        case TOKEN_BULK:
+        case RENEW:
+            serve_bulk(server, &item->bulk, item->via_ring, current_time);
+        break;
+        case TOKEN_ANY:
+            serve_any(server, &item->any, item->via_ring, current_time, NULL);
+        break;
+        case RELEASE:
+            serve_release(server, &item->request, item->via_ring, current_time, NULL);
+        break;
+        case HELLO:
+            serve_hello(server, &item->request, item->via_ring, current_time);
+        break;
+        case QUERY:
+            serve_query(server, &item->query, item->via_ring, current_time);
+        break;
+        case WIRE_BATCH:
+            serve_batch(server, &item->batch, item->via_ring, current_time);
+        break;
+        default:
+            LOG(LOG_WARN, "Server worker got an aunkown request\n");
+    }
+    uint64_t done_ns = get_monotonic_ns();
+    admission_served(server->admission, done_ns - start_ns);
+    metrics_time(server->metrics, METRIC_SERVICE, done_ns - start_ns);
+    metrics_time(server->metrics, METRIC_LANE_NORMAL + item->lane, done_ns - item->received_ns);
+    metrics_count(server->metrics, METRIC_DONE,
+            WIRE_BATCH == item->req_type ? item->batch.header.count : 1);
+}
+
+/* Copies a wire message into batch if it is well formed. */
+static bool parse_batch(const char *buf, ssize_t len, wire_batch_t *batch)
+{
+    if (!wire_get_header(buf, len, sizeof(wire_request_t), &batch->header))
+    {
+        return false;
+    }
+    batch->req_type = WIRE_BATCH;
+    memcpy(batch->records, buf + sizeof(wire_header_t),
+            batch->header.count * sizeof(wire_request_t));
+    for (unsigned int i = 0; i < batch->header.count; i++)
+    {
+        const wire_request_t *record = &batch->records[i];
+        switch (record->req_type)
+        {
+            case TOKEN:
+            case RELEASE:
+            break;
+            case TOKEN_ANY:
+                if (le32toh(record->token) > le32toh(record->token_max))
+                {
+                    return false;
+                }
+            break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+/* Copies a received message into item if it is well formed. */
+static bool parse_request(const char *buf, ssize_t len, work_item_t *item)
+{
+    int req_type;
+    uint32_t magic;
+
+    if (len < (ssize_t)sizeof(req_type))
+    {
+        return false;
+    }
+    memcpy(&magic, buf, sizeof(magic));
+    if (WIRE_MAGIC == le32toh(magic))
+    {
+        return parse_batch(buf, len, &item->batch);
+    }
+    memcpy(&req_type, buf, sizeof(req_type));
+    switch (req_type)
+    {
+        case TOKEN:
+        case CLOSE:
+        case RELEASE:
+        case HELLO:
+        case HANDOFF:
+            if (len != sizeof(item->request))
+            {
+                return false;
+            }
+            memcpy(&item->request, buf, sizeof(item->request));
+        break;
+        case TOKEN_BULK:
+        case RENEW:
+            if (len < (ssize_t)offsetof(bulk_request_msg_t, tokens))
+            {
+                return false;
+            }
+            memcpy(&item->bulk, buf, offsetof(bulk_request_msg_t, tokens));
+            if (0 == item->bulk.tokens_no || item->bulk.tokens_no > BULK_MAX_TOK ||
+                len != (ssize_t)bulk_request_len(item->bulk.tokens_no, item->bulk.flags))
+            {
+                return false;
+            }
+            memcpy(&item->bulk, buf, len);
+            if ((item->bulk.flags & BULK_RANGE) &&
+                item->bulk.tokens[0] > UINT32_MAX - (item->bulk.tokens_no - 1))
+            {
+                return false;
+            }
+        break;
+        case TOKEN_ANY:
+            if (len != sizeof(item->any))
+            {
+                return false;
+            }
+            memcpy(&item->any, buf, sizeof(item->any));
+            if (item->any.token_min > item->any.token_max)
+            {
+                return false;
+            }
+        break;
+        case QUERY:
+            if (len != sizeof(item->query))
+            {
+                return false;
+            }
+            memcpy(&item->query, buf, sizeof(item->query));
+        break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+/* The lane a client asked for in the request, for the ring. */
+static uint8_t get_request_lane(const work_item_t *item)
+{
+    uint8_t lane;
+
+    switch (item->req_type)
+    {
+        case TOKEN_BULK:
+        case RENEW:
+            lane = item->bulk.lane;
+        break;
+        case TOKEN_ANY:
+            lane = item->any.lane;
+        break;
+        case QUERY:
+            lane = item->query.lane;
+        break;
+        case WIRE_BATCH:
+            lane = item->batch.records[0].lane;
+        break;
+        default:
+            lane = item->request.lane;
+    }
+    return lane < LANES_NO ? lane : LANE_NORMAL;
+}
+
+/* Parses a received request and hands it to the pool, or serves it in the
+ * calling thread when pool is NULL. The lane is the one of prio, the mq
+ * priority, unless the request came over the ring. True for CLOSE, and for
+ * HANDOFF on the main queue once a new server was accepted. */
+static bool accept_request(server_ctx_t *server, work_pool_t *pool, const char *buf,
+        ssize_t len, bool via_ring, unsigned int prio)
+{
+    work_item_t item;
+    int rc;
+
+    if (!parse_request(buf, len, &item))
+    {
+        metrics_count(server->metrics, METRIC_BAD_REQUESTS, 1);
+        LOG(LOG_WARN, "Server reciceved an aunkown request\n");
+        return false;
+    }
+    if (WIRE_BATCH == item.req_type)
+    {
+        for (unsigned int i = 0; i < item.batch.header.count; i++)
+        {
+            count_request(server->metrics, item.batch.records[i].req_type);
+        }
+    }
+    else
+    {
+        count_request(server->metrics, item.req_type);
+    }
+    item.received_ns = get_monotonic_ns();
+    item.via_ring = via_ring;
+    item.lane = via_ring ? get_request_lane(&item) : get_prio_lane(prio);
+
+    switch(item.req_type)
+    {
+        case TOKEN:
+            LOG(LOG_DEBUG, "Server reciceved a TOKEN request "
+                    "token:%3lld; pid:%5lld;\n",
+                    item.request.token_requested, item.request.pid);
+        break;
+        case TOKEN_ANY:
+            LOG(LOG_DEBUG, "Server reciceved a TOKEN_ANY request "
+                    "range:%3lld-%3lld; pid:%5lld;\n",
+                    item.any.token_min, item.any.token_max, item.any.pid);
+        break;
+        case RELEASE:
+            LOG(LOG_DEBUG, "Server reciceved a RELEASE request "
+                    "token:%3lld; pid:%5lld;\n",
+                    item.request.token_requested, item.request.pid);
+        break;
+        case TOKEN_BULK:
+        case RENEW:
+            LOG(LOG_DEBUG, "Server reciceved a bulk request "
+                    "type:%lld; tokens:%3lld; pid:%5lld;\n",
+                    item.req_type, item.bulk.tokens_no, item.bulk.pid);
+        break;
+        case HELLO:
+            LOG(LOG_DEBUG, "Server reciceved a HELLO request pid:%5lld;\n",
+                    item.request.pid);
+        break;
+        case QUERY:
+            LOG(LOG_DEBUG, "Server reciceved a QUERY request owner:%5lld; pid:%5lld;\n",
+                    item.query.owner, item.query.pid);
+        break;
+        case WIRE_BATCH:
+            LOG(LOG_DEBUG, "Server reciceved a batch of %3lld requests pid:%5lld;\n",
+                    item.batch.header.count, item.batch.header.pid);
+        break;
+        case CLOSE:
+            LOG(LOG_INFO, "Server reciceved a CLOSE request\n");
+            return true;
+        case HANDOFF:
+            return !via_ring && server->handoff != NULL && handoff_accepted(server->handoff);
+        default:
+            LOG(LOG_WARN, "Server reciceved an aunkown request\n");
+            return false;
+    }
+    if (NULL == pool)
+    {
+        th_f(&item, server);
+        return false;
+    }
+    /* While clients block on a full queue, turn away at once what the
+     * workers could not serve in time. */
+    if (item.req_type != HELLO && !via_ring && server->req_mq != (mqd_t)-1 &&
+        admission_sample(server->admission, server->req_mq, item.received_ns))
+    {
+        time_t current_time = time(NULL);
+        if (-1 == current_time)
+        {
+            handle_error();
+        }
+        if (admission_shed(server->admission, get_req_time(&item), current_time,
+                    work_pool_depth(pool), pool->workers_no))
+        {
+            serve_busy(server, &item, 0);
+            metrics_count(server->metrics, METRIC_DONE,
+                    WIRE_BATCH == item.req_type ? item.batch.header.count : 1);
+            return false;
+        }
+    }
+    /* use worker to work on database and send result to client*/
+    rc = work_pool_submit(pool, &item);
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
+    return false;
+}
+
+/* Feeds the pool from the shared memory ring. A CLOSE is passed on to the
+ * main loop through its queue, it is the one that shuts the server down. */
+static void *ring_receiver_f(void *arg)
+{
+    ring_receiver_ctx_t *ctx = arg;
+    const char *msg;
+    size_t len;
+
+    while ((msg = shm_ring_receive(ctx->server->ring, &len)) != NULL)
+    {
+        bool is_close = accept_request(ctx->server, ctx->pool, msg, len, true, MQ_DEFAULT_PRIO);
+        shm_ring_consume(ctx->server->ring);
+        if (is_close)
+        {
+            forward_request(CLOSE);
+        }
+    }
+    return NULL;
+}
+
+/* Passes a CLOSE, or a HANDOFF, on to the main loop, which shuts the
+ * server down. Requests already queued are served first. */
+static void forward_request(int req_type)
+{
+    request_msg_t request = {.req_type = req_type};
+    mqd_t server_mq = mq_open(MQ_REQ_NAME, O_WRONLY);
+    if (-1 == server_mq)
     {
         handle_error();
     }
-    printf("Message queue deleted.\n");
+    int rc = mq_send(server_mq, (char*)&request, sizeof(request), MQ_DEFAULT_PRIO);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    rc = mq_close(server_mq);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
+
+/* Serves the queue of one shard. The main loop stops it with a CLOSE once
+ * closing is set, any other CLOSE comes from a client. */
+static bool shard_request_f(const char *buf, ssize_t len, unsigned int prio, void *ctx)
+{
+    shard_t *shard = ctx;
+
+    if (!accept_request(&shard->ctx, NULL, buf, len, false, prio))
+    {
+        return false;
+    }
+    if (atomic_load(shard->closing))
+    {
+        return true;
+    }
+    forward_request(CLOSE);
+    return false;
+}
+
+static void *shard_f(void *arg)
+{
+    shard_t *shard = arg;
+    char buf[MQ_MSGSIZE + 1];
+    unsigned int prio;
+
+    if (shard->ctx.loop != NULL)
+    {
+        ev_loop_run(shard->ctx.loop);
+        return NULL;
+    }
+    for (;;)
+    {
+        ssize_t read_bytes = mq_receive(shard->mq, buf, sizeof(buf), &prio);
+        if (-1 == read_bytes)
+        {
+            handle_error();
+        }
+        if (shard_request_f(buf, read_bytes, prio, shard))
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Called by the handoff thread for a new server asking to take over. */
+static int check_handoff(const handoff_request_t *request, void *ctx)
+{
+    const handoff_ctx_t *handoff_ctx = ctx;
+
+    if (request->backend != handoff_ctx->backend ||
+        request->shards_no != handoff_ctx->shards_no ||
+        (request->use_ring != 0) != handoff_ctx->use_ring ||
+        (request->tokens_no != 0 && request->tokens_no != handoff_ctx->tokens_no))
+    {
+        LOG(LOG_WARN, "Server refused to hand over to a new server set up differently.\n");
+        return EINVAL;
+    }
+    LOG(LOG_INFO, "Server is handing over to a new server.\n");
+    return 0;
+}
+
+static void stop_for_handoff(void *ctx)
+{
+    (void)ctx;
+    forward_request(HANDOFF);
+}
+
+/* A queue taken over keeps the flags the previous server gave it. */
+static void set_blocking(mqd_t mq)
+{
+    struct mq_attr attr = {.mq_flags = 0};
+
+    int rc = mq_setattr(mq, &attr, NULL);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
+
+/* Serves the main queue in place, from the event loop. */
+static bool main_request_f(const char *buf, ssize_t len, unsigned int prio, void *ctx)
+{
+    return accept_request(ctx, NULL, buf, len, false, prio);
+}
+
+static unsigned int parse_count_arg(const char *arg, char opt)
+{
+    char *end = NULL;
+    errno = 0;
+    unsigned long val = strtoul(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || 0 == val || val > UINT_MAX)
+    {
+        fprintf(stderr, "Invalid value \"%s\" for -%c\n", arg, opt);
+        exit(1);
+    }
+    return (unsigned int)val;
+}
+
+static unsigned int parse_shards_arg(const char *arg, char opt)
+{
+    unsigned int shards_no = parse_count_arg(arg, opt);
+    if (shards_no > SHARDS_MAX || (shards_no & (shards_no - 1)) != 0)
+    {
+        fprintf(stderr, "The number of shards must be a power of two up to %d\n", SHARDS_MAX);
+        exit(1);
+    }
+    return shards_no;
+}
+
+/* Weights of the lanes in g_lane_order, as "8,4,1". */
+static void parse_weights_arg(const char *arg, char opt, unsigned int *weights)
+{
+    const char *next = arg;
+
+    for (unsigned int i = 0; i < LANES_NO; i++)
+    {
+        char *end = NULL;
+        errno = 0;
+        unsigned long val = strtoul(next, &end, 10);
+        if (errno != 0 || end == next || 0 == val || val > UINT_MAX ||
+            *end != (i + 1 < LANES_NO ? ',' : '\0'))
+        {
+            fprintf(stderr, "Invalid value \"%s\" for -%c\n", arg, opt);
+            exit(1);
+        }
+        weights[g_lane_order[i]] = (unsigned int)val;
+        next = end + 1;
+    }
+}
+
+static uint32_t parse_tokens_arg(const char *arg, char opt)
+{
+    unsigned int tokens_no = parse_count_arg(arg, opt);
+    if (tokens_no < DB_TOKENS_MIN || tokens_no > DB_TOKENS_MAX)
+    {
+        fprintf(stderr, "The number of tokens must be between %u and %u\n",
+                DB_TOKENS_MIN, DB_TOKENS_MAX);
+        exit(1);
+    }
+    return tokens_no;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-w workers] [-q queue_len] [-b file|mmap|memory]"
+            " [-f each|periodic|none|group|dsync] [-i flush_interval_ms]"
+            " [-c reply_queue_cache] [-l error|warn|info|debug] [-t mq|shm]"
+            " [-s shards] [-m pool|epoll] [-n tokens] [-u] [-W weights] [-S starve_ms]"
+            " [-D deadline_ms] [-k]\n"
+            "  -w  number of worker threads (default %d)\n"
+            "  -q  capacity of the work queue (default %d)\n"
+            "  -b  storage backend of the database (default file); memory keeps\n"
+            "      it in memory only, with a journal and snapshots\n"
+            "  -f  when the database is flushed to disk (default each); dsync\n"
+            "      opens it with O_DSYNC so every write waits for the disk\n"
+            "  -i  interval of the periodic flush, or of the journal writes\n"
+            "      with -b memory (default %d)\n"
+            "  -c  reply queue descriptors kept open (default %d)\n"
+            "  -l  log level (default info)\n"
+            "  -t  mq serves the message queue only (default), shm serves the\n"
+            "      shared memory ring %s too\n"
+            "  -s  split the tokens between this many shards, each with its own\n"
+            "      queue and thread (default none)\n"
+            "  -m  pool hands requests to the workers, which block sending\n"
+            "      replies (default); epoll serves every queue from an event loop\n"
+            "      that never blocks on a client\n"
+            "  -n  tokens in the database, from %u to %u; a database of another\n"
+            "      size is recreated empty (default the size of the existing\n"
+            "      database, %d for a new one)\n"
+            "  -u  take over from the running server, which hands over its\n"
+            "      queues and tokens through " HANDOFF_SOCKET_NAME " once it served the\n"
+            "      requests it took; -b, -s and -t must be the same\n"
+            "  -W  requests the workers take from the interactive, normal and\n"
+            "      batch lanes in turn (default %u,%u,%u)\n"
+            "  -S  a normal or batch request waiting for a worker longer is\n"
+            "      taken first, every other time at most (default %d)\n"
+            "  -D  a request older than this many milliseconds when its turn\n"
+            "      comes is answered BUSY, 0 serves every request (default %d)\n"
+            "  -k  keep the tokens of a client that exited until they expire,\n"
+            "      for clients in another pid namespace (default they are freed\n"
+            "      at once)\n",
+            prog, WORKERS_NO, WORK_QUEUE_LEN, DB_FLUSH_INTERVAL_MS,
+            MQ_CACHE_CAPACITY, SHM_RING_NAME, DB_TOKENS_MIN, DB_TOKENS_MAX, DB_DEFAULT_TOK,
+            LANE_WEIGHT_INTERACTIVE, LANE_WEIGHT_NORMAL, LANE_WEIGHT_BATCH, LANE_STARVE_MS,
+            ADMISSION_DEADLINE_MS);
+}
+
+int main (int argc, char *argv[])
+{
+    unsigned int workers_no = WORKERS_NO;
+    unsigned int queue_len = WORK_QUEUE_LEN;
+    unsigned int mq_cache_capacity = MQ_CACHE_CAPACITY;
+    db_config_t db_cfg = {
+        .backend = DB_BACKEND_FILE,
+        .flush = DB_FLUSH_EACH,
+        .flush_interval_ms = DB_FLUSH_INTERVAL_MS,
+        .reclaim = true
+    };
+    LOG_LEVEL log_level = LOG_INFO;
+    bool use_ring = false;
+    unsigned int shards_no = 0;
+    bool use_loop = false;
+    bool hot_restart = false;
+    unsigned int lane_weights[LANES_NO] = {
+        [LANE_INTERACTIVE] = LANE_WEIGHT_INTERACTIVE,
+        [LANE_NORMAL] = LANE_WEIGHT_NORMAL,
+        [LANE_BATCH] = LANE_WEIGHT_BATCH
+    };
+    unsigned int starve_ms = LANE_STARVE_MS;
+    unsigned int deadline_ms = ADMISSION_DEADLINE_MS;
+    int opt;
+    while ((opt = getopt(argc, argv, "w:q:b:f:i:c:l:t:s:m:n:uW:S:D:k")) != -1)
+    {
+        switch (opt)
+        {
+            case 'D':
+                deadline_ms = 0 == strcmp(optarg, "0") ? 0 : parse_count_arg(optarg, opt);
+            break;
+            case 'W':
+                parse_weights_arg(optarg, opt, lane_weights);
+            break;
+            case 'S':
+                starve_ms = parse_count_arg(optarg, opt);
+            break;
+            case 'b':
+                if (db_parse_backend(optarg, &db_cfg.backend) != 0)
+                {
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+            break;
+            case 'f':
+                if (db_parse_flush(optarg, &db_cfg.flush) != 0)
+                {
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+            break;
+            case 'i':
+                db_cfg.flush_interval_ms = parse_count_arg(optarg, opt);
+            break;
+            case 'c':
+                mq_cache_capacity = parse_count_arg(optarg, opt);
+            break;
+            case 'w':
+                workers_no = parse_count_arg(optarg, opt);
+            break;
+            case 'q':
+                queue_len = parse_count_arg(optarg, opt);
+            break;
+            case 'l':
+                if (logger_parse_level(optarg, &log_level) != 0)
+                {
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+            break;
+            case 't':
+                if (0 == strcmp(optarg, "mq"))
+                {
+                    use_ring = false;
+                }
+                else if (0 == strcmp(optarg, "shm"))
+                {
+                    use_ring = true;
+                }
+                else
+                {
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+            break;
+            case 's':
+                shards_no = parse_shards_arg(optarg, opt);
+            break;
+            case 'n':
+                db_cfg.tokens_no = parse_tokens_arg(optarg, opt);
+            break;
+            case 'u':
+                hot_restart = true;
+            break;
+            case 'k':
+                db_cfg.reclaim = false;
+            break;
+            case 'm':
+                if (0 == strcmp(optarg, "pool"))
+                {
+                    use_loop = false;
+                }
+                else if (0 == strcmp(optarg, "epoll"))
+                {
+                    use_loop = true;
+                }
+                else
+                {
+                    print_usage(argv[0]);
+                    exit(1);
+                }
+            break;
+            default:
+                print_usage(argv[0]);
+                exit(1);
+        }
+    }
 
-    rc = close(db_fd);
+    printf("Starting the server.\n");
+
+    int rc = logger_init(log_level, stdout);
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
+    struct mq_attr qattr = {0};
+    qattr.mq_maxmsg = MQ_MAXMSG;
+    qattr.mq_msgsize = MQ_MSGSIZE;
+    ssize_t read_bytes = 0;
+    bool shall_close = false;
+    unsigned int prio;
+    tok_db_t db;
+    mq_cache_t mq_cache;
+    admission_t admission;
+    server_ctx_t server = {.db = &db, .mq_cache = &mq_cache, .admission = &admission};
+    ev_loop_t main_loop;
+    server_ctx_t loop_ctx;
+    shard_t shards[SHARDS_MAX];
+    atomic_bool shards_closing = false;
+    char shard_mq_name[MAX_MQUEUE_NAME];
+    work_pool_t pool;
+    char buf[MQ_MSGSIZE + 1];
+    handoff_t handoff;
+    handoff_ctx_t handoff_ctx;
+    handoff_reply_t taken = {0};
+    int taken_fds[HANDOFF_FDS_MAX];
+    bool took_over = false;
+    uint64_t taken_ns = 0;
+
+    if (hot_restart)
+    {
+        handoff_request_t request = {
+            .magic = HANDOFF_MAGIC,
+            .backend = db_cfg.backend,
+            .tokens_no = db_cfg.tokens_no,
+            .shards_no = shards_no,
+            .use_ring = use_ring
+        };
+        uint64_t ask_ns = get_monotonic_ns();
+        rc = handoff_take(&request, &taken, taken_fds);
+        taken_ns = get_monotonic_ns();
+        if (-1 == rc)
+        {
+            printf("No server to take over from, starting afresh.\n");
+        }
+        else if (taken.status != 0)
+        {
+            fprintf(stderr, "The running server refused to hand over: %s. -b, -s and -t"
+                    " must be the same, and -n its size if given.\n", strerror(taken.status));
+            exit(1);
+        }
+        else
+        {
+            took_over = true;
+            printf("The running server handed over after %llu ms.\n",
+                    (unsigned long long)(taken_ns - ask_ns) / 1000000);
+        }
+    }
+
+    /* Taken over: the main queue, every shard's and the database state. */
+    mqd_t server_mq;
+    if (took_over)
+    {
+        server_mq = taken_fds[0];
+        if (!use_loop)
+        {
+            set_blocking(server_mq);
+        }
+    }
+    else
+    {
+        server_mq = mq_open(MQ_REQ_NAME, O_RDONLY | O_CREAT, MQ_MODE, &qattr);
+        if (-1 == server_mq)
+        {
+            handle_error();
+        }
+    }
+    uint64_t open_ns = get_monotonic_ns();
+    if (took_over)
+    {
+        rc = db_attach(&db, &db_cfg, taken_fds[shards_no + 1]);
+    }
+    else
+    {
+        rc = db_open(&db, &db_cfg);
+    }
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
+    printf("Database of %u tokens %s in %llu ms.\n", db.tokens_no,
+            took_over ? "taken over" : "opened",
+            (unsigned long long)(get_monotonic_ns() - open_ns) / 1000000);
+    server.metrics = metrics_create();
+    admission_init(&admission, deadline_ms, MQ_MAXMSG);
+    server.req_mq = use_loop ? (mqd_t)-1 : server_mq;
+    rc = mq_cache_init(&mq_cache, mq_cache_capacity, MQ_CACHE_IDLE_SEC);
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
+    rc = work_pool_init(&pool, workers_no, queue_len, lane_weights, starve_ms, th_f, &server);
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
+    printf("Server started %u workers with a work queue of %u.\n",
+            workers_no, queue_len);
+    ring_receiver_ctx_t ring_ctx = {.server = &server, .pool = &pool};
+    pthread_t ring_receiver;
+    if (use_ring)
+    {
+        server.ring = took_over ? shm_ring_resume() : shm_ring_create();
+        if (NULL == server.ring)
+        {
+            handle_error_en(ENOENT);
+        }
+        rc = pthread_create(&ring_receiver, NULL, ring_receiver_f, &ring_ctx);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+        printf("Server also serves the shared memory ring %s.\n", SHM_RING_NAME);
+    }
+    /* Queues of a previous server with more shards would mislead clients. */
+    for (unsigned int i = shards_no; i < SHARDS_MAX; i++)
+    {
+        snprintf(shard_mq_name, sizeof(shard_mq_name), MQ_SHARD_NAME_FMT, i);
+        rc = mq_unlink(shard_mq_name);
+        if (-1 == rc && errno != ENOENT)
+        {
+            handle_error();
+        }
+    }
+    for (unsigned int i = 0; i < shards_no; i++)
+    {
+        shard_t *shard = &shards[i];
+        shard->ctx = server;
+        shard->ctx.mq_cache = &shard->mq_cache;
+        shard->index = i;
+        shard->closing = &shards_closing;
+        rc = mq_cache_init(&shard->mq_cache, mq_cache_capacity, MQ_CACHE_IDLE_SEC);
+        if (rc != 0)
+        {
+            handle_error_en(0);
+        }
+        if (took_over)
+        {
+            shard->mq = taken_fds[1 + i];
+            if (!use_loop)
+            {
+                set_blocking(shard->mq);
+            }
+        }
+        else
+        {
+            snprintf(shard_mq_name, sizeof(shard_mq_name), MQ_SHARD_NAME_FMT, i);
+            shard->mq = mq_open(shard_mq_name, O_RDONLY | O_CREAT, MQ_MODE, &qattr);
+            if (-1 == shard->mq)
+            {
+                handle_error();
+            }
+        }
+        if (use_loop)
+        {
+            ev_loop_init(&shard->loop, shard->mq, shard_request_f, shard, MQ_CACHE_IDLE_SEC);
+            shard->ctx.loop = &shard->loop;
+        }
+        rc = pthread_create(&shard->thread, NULL, shard_f, shard);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+    }
+    if (shards_no > 0)
+    {
+        printf("Server split the tokens between %u shards.\n", shards_no);
+    }
+    handoff_ctx = (handoff_ctx_t){
+        .backend = db_cfg.backend,
+        .tokens_no = db.tokens_no,
+        .shards_no = shards_no,
+        .use_ring = use_ring
+    };
+    rc = handoff_listen(&handoff, check_handoff, stop_for_handoff, &handoff_ctx);
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
+    /* Set after the shards copied server, HANDOFF only stops the main loop. */
+    server.handoff = &handoff;
+    printf("The server is ready to recieve requests.\n");
+    if (took_over)
+    {
+        printf("Serving %llu ms after the handoff.\n",
+                (unsigned long long)(get_monotonic_ns() - taken_ns) / 1000000);
+    }
+
+    if (use_loop)
+    {
+        /* The workers keep the plain context, they only serve the ring. */
+        loop_ctx = server;
+        loop_ctx.loop = &main_loop;
+        ev_loop_init(&main_loop, server_mq, main_request_f, &loop_ctx, MQ_CACHE_IDLE_SEC);
+        ev_loop_run(&main_loop);
+    }
+    else
+    {
+        do
+        {
+            read_bytes = mq_receive(server_mq, buf, sizeof(buf), &prio);
+            if (read_bytes == -1)
+            {
+                handle_error();
+            }
+            if (accept_request(&server, &pool, buf, read_bytes, false, prio))
+            {
+                /* TODO Probably not the safest way to close. */
+                shall_close = true;
+            }
+        } while(shall_close != true);
+    }
+
+    /* From here on no new server is accepted, whatever stopped the loop. */
+    handoff_close(&handoff);
+    bool handing_off = handoff_accepted(&handoff);
+    LOG(LOG_INFO, handing_off ? "Server is handing over.\n" : "Server is closing.\n");
+    if (use_ring)
+    {
+        /* Stop feeding the pool before shutting it down. */
+        shm_ring_shutdown(server.ring);
+        rc = pthread_join(ring_receiver, NULL);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+    }
+    atomic_store(&shards_closing, true);
+    for (unsigned int i = 0; i < shards_no; i++)
+    {
+        request_msg_t request = {.req_type = CLOSE};
+        snprintf(shard_mq_name, sizeof(shard_mq_name), MQ_SHARD_NAME_FMT, i);
+        mqd_t shard_mq = mq_open(shard_mq_name, O_WRONLY);
+        if (-1 == shard_mq)
+        {
+            handle_error();
+        }
+        rc = mq_send(shard_mq, (char*)&request, sizeof(request), MQ_DEFAULT_PRIO);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+        rc = mq_close(shard_mq);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+        rc = pthread_join(shards[i].thread, NULL);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+        if (handing_off)
+        {
+            /* Requests behind the CLOSE are the new server's. */
+            continue;
+        }
+        rc = mq_close(shards[i].mq);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+        rc = mq_unlink(shard_mq_name);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+    }
+    /* Lets the workers finish what they took. */
+    rc = work_pool_shutdown(&pool);
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
+    /* Nothing logs any more, write out what is queued before the stats. */
+    rc = logger_close();
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
+    printf("Server's workers have been closed\n");
+    work_pool_print_stats(&pool, stdout);
+    admission_print_stats(&admission, stdout);
+    db_print_stats(&db, stdout);
+    if (handing_off)
+    {
+        int fds[HANDOFF_FDS_MAX];
+        unsigned int fds_no = 0;
+        uint32_t tokens_no = db.tokens_no;
+
+        fds[fds_no++] = server_mq;
+        for (unsigned int i = 0; i < shards_no; i++)
+        {
+            fds[fds_no++] = shards[i].mq;
+        }
+        rc = db_detach(&db, &fds[fds_no++]);
+        if (rc != 0)
+        {
+            handle_error_en(0);
+        }
+        rc = handoff_send(&handoff, tokens_no, fds, fds_no);
+        if (-1 == rc)
+        {
+            fprintf(stderr, "The new server left before the handoff, the queues are"
+                    " left for the next one.\n");
+        }
+        else
+        {
+            printf("Server handed over.\n");
+        }
+    }
+    if (use_loop)
+    {
+        if (handing_off)
+        {
+            ev_loop_drain(&main_loop, HANDOFF_DRAIN_MS);
+        }
+        ev_loop_print_stats(&main_loop, stdout);
+        ev_loop_destroy(&main_loop);
+    }
+    else
+    {
+        mq_cache_print_stats(&mq_cache, stdout);
+    }
+    mq_cache_destroy(&mq_cache);
+    for (unsigned int i = 0; i < shards_no; i++)
+    {
+        fprintf(stdout, "Shard %u: ", i);
+        if (use_loop)
+        {
+            if (handing_off)
+            {
+                ev_loop_drain(&shards[i].loop, HANDOFF_DRAIN_MS);
+            }
+            ev_loop_print_stats(&shards[i].loop, stdout);
+            ev_loop_destroy(&shards[i].loop);
+        }
+        else
+        {
+            mq_cache_print_stats(&shards[i].mq_cache, stdout);
+        }
+        mq_cache_destroy(&shards[i].mq_cache);
+    }
+    if (handing_off)
+    {
+        /* The new server has made its own segment, and took the ring. */
+        metrics_detach(server.metrics);
+        if (use_ring)
+        {
+            shm_ring_detach(server.ring);
+        }
+        work_pool_destroy(&pool);
+        printf("Server closed, its successor serves.\n");
+        return 0;
+    }
+    metrics_destroy(server.metrics);
+    if (use_ring)
+    {
+        shm_ring_destroy(server.ring);
+    }
+    work_pool_destroy(&pool);
+
+    rc = mq_unlink(MQ_REQ_NAME);
     if (-1 == rc)
     {
         handle_error();
     }
+    printf("Message queue deleted.\n");
+
+    rc = db_close(&db);
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
 
     printf("Server closed.\n");
     return 0;
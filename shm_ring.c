@@ -0,0 +1,343 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file shm_ring.c
+*
+* \brief Implements the shared memory transport declared in shm_ring.h. The
+*        request ring is a bounded queue with a sequence number per slot:
+*        producers claim a position with a compare-and-swap on tail, write
+*        the slot and publish it by setting its sequence number.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdlib.h>         /* For exit() */
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>          /* For O_* constants */
+#include <sys/stat.h>       /* For mode constants and struct stat */
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
+#include "utils.h"
+#include "shm_ring.h"
+
+#define SHM_RING_MASK (SHM_RING_LEN - 1)
+
+_Static_assert((SHM_RING_LEN & SHM_RING_MASK) == 0, "SHM_RING_LEN must be a power of two");
+_Static_assert(sizeof(atomic_uint) == sizeof(uint32_t), "futex words are 32 bits");
+
+static bool wait_word(atomic_uint *word, unsigned int seen, atomic_uint *waiters,
+        const struct timespec *deadline);
+static void wake_word(atomic_uint *word, atomic_uint *waiters);
+static shm_ring_t *map_ring(int fd);
+
+/* Sleeps while word still holds seen. False once deadline passed. The
+ * futexes are not private, the other side is another process. */
+static bool wait_word(atomic_uint *word, unsigned int seen, atomic_uint *waiters,
+        const struct timespec *deadline)
+{
+    long rc = 0;
+
+    /* Counted before checking word again: whoever changes it after the
+     * check sees the waiter and wakes it. */
+    atomic_fetch_add(waiters, 1);
+    if (atomic_load(word) == seen)
+    {
+        rc = syscall(SYS_futex, word, FUTEX_WAIT_BITSET | FUTEX_CLOCK_REALTIME, seen,
+                deadline, NULL, FUTEX_BITSET_MATCH_ANY);
+    }
+    atomic_fetch_sub(waiters, 1);
+    if (-1 == rc)
+    {
+        if (ETIMEDOUT == errno)
+        {
+            return false;
+        }
+        if (errno != EAGAIN && errno != EINTR)
+        {
+            handle_error();
+        }
+    }
+    return true;
+}
+
+/* Called after changing word, costs a system call only if someone sleeps. */
+static void wake_word(atomic_uint *word, atomic_uint *waiters)
+{
+    if (atomic_load(waiters) > 0)
+    {
+        long rc = syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+    }
+}
+
+static shm_ring_t *map_ring(int fd)
+{
+    shm_ring_t *ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == ring)
+    {
+        handle_error();
+    }
+    int rc = close(fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    return ring;
+}
+
+shm_ring_t *shm_ring_create(void)
+{
+    shm_ring_t *ring;
+    int fd;
+    int rc;
+
+    rc = shm_unlink(SHM_RING_NAME);
+    if (-1 == rc && errno != ENOENT)
+    {
+        handle_error();
+    }
+    fd = shm_open(SHM_RING_NAME, O_RDWR | O_CREAT | O_EXCL, MQ_MODE);
+    if (-1 == fd)
+    {
+        handle_error();
+    }
+    rc = ftruncate(fd, sizeof(*ring));
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    ring = map_ring(fd);
+    /* ftruncate zeroed everything else. */
+    for (uint64_t i = 0; i < SHM_RING_LEN; i++)
+    {
+        atomic_store_explicit(&ring->reqs[i].seq, i, memory_order_relaxed);
+    }
+    atomic_store_explicit(&ring->magic, SHM_RING_MAGIC, memory_order_release);
+    return ring;
+}
+
+shm_ring_t *shm_ring_attach(void)
+{
+    shm_ring_t *ring;
+    struct stat st;
+    int fd;
+    int rc;
+
+    fd = shm_open(SHM_RING_NAME, O_RDWR, 0);
+    if (-1 == fd)
+    {
+        return NULL;
+    }
+    rc = fstat(fd, &st);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    if ((size_t)st.st_size != sizeof(*ring))
+    {
+        close(fd);
+        return NULL;
+    }
+    ring = map_ring(fd);
+    if (atomic_load_explicit(&ring->magic, memory_order_acquire) != SHM_RING_MAGIC)
+    {
+        shm_ring_detach(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+shm_ring_t *shm_ring_resume(void)
+{
+    shm_ring_t *ring = shm_ring_attach();
+
+    if (ring != NULL)
+    {
+        atomic_store(&ring->closing, 0);
+    }
+    return ring;
+}
+
+void shm_ring_send(shm_ring_t *ring, const void *msg, size_t len)
+{
+    shm_req_slot_t *slot;
+
+    if (len > MQ_MSGSIZE)
+    {
+        handle_error_en(EMSGSIZE);
+    }
+    uint64_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    for (;;)
+    {
+        slot = &ring->reqs[pos & SHM_RING_MASK];
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int64_t dif = (int64_t)(seq - pos);
+        if (0 == dif)
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                    memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (dif < 0)
+        {
+            /* Full, the slot still holds the request from a lap ago. */
+            unsigned int freed = atomic_load(&ring->freed);
+            if (atomic_load_explicit(&slot->seq, memory_order_acquire) == seq)
+            {
+                wait_word(&ring->freed, freed, &ring->freed_waiters, NULL);
+            }
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+    memcpy(slot->msg, msg, len);
+    slot->len = len;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    atomic_fetch_add(&ring->posted, 1);
+    wake_word(&ring->posted, &ring->posted_waiters);
+}
+
+const char *shm_ring_receive(shm_ring_t *ring, size_t *len)
+{
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    shm_req_slot_t *slot = &ring->reqs[head & SHM_RING_MASK];
+
+    for (;;)
+    {
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) == head + 1)
+        {
+            *len = slot->len;
+            return slot->msg;
+        }
+        if (atomic_load(&ring->closing))
+        {
+            return NULL;
+        }
+        unsigned int posted = atomic_load(&ring->posted);
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != head + 1 &&
+            !atomic_load(&ring->closing))
+        {
+            wait_word(&ring->posted, posted, &ring->posted_waiters, NULL);
+        }
+    }
+}
+
+void shm_ring_consume(shm_ring_t *ring)
+{
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    shm_req_slot_t *slot = &ring->reqs[head & SHM_RING_MASK];
+
+    atomic_store_explicit(&slot->seq, head + SHM_RING_LEN, memory_order_release);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_relaxed);
+    atomic_fetch_add(&ring->freed, 1);
+    wake_word(&ring->freed, &ring->freed_waiters);
+}
+
+bool shm_ring_reply(shm_ring_t *ring, uint8_t pseudo_port, const void *msg,
+        size_t len, const struct timespec *deadline)
+{
+    shm_reply_slot_t *slot = &ring->replies[pseudo_port];
+
+    if (len > MQ_MSGSIZE)
+    {
+        handle_error_en(EMSGSIZE);
+    }
+    for (;;)
+    {
+        unsigned int state = SHM_REPLY_EMPTY;
+        if (atomic_compare_exchange_strong(&slot->state, &state, SHM_REPLY_WRITING))
+        {
+            break;
+        }
+        if (state != SHM_REPLY_EMPTY &&
+            !wait_word(&slot->state, state, &slot->waiters, deadline))
+        {
+            return false;
+        }
+    }
+    memcpy(slot->msg, msg, len);
+    slot->len = len;
+    atomic_store(&slot->state, SHM_REPLY_FULL);
+    wake_word(&slot->state, &slot->waiters);
+    return true;
+}
+
+ssize_t shm_ring_wait_reply(shm_ring_t *ring, uint8_t pseudo_port, void *buf,
+        size_t buf_len, const struct timespec *deadline)
+{
+    shm_reply_slot_t *slot = &ring->replies[pseudo_port];
+
+    for (;;)
+    {
+        unsigned int state = atomic_load(&slot->state);
+        if (SHM_REPLY_FULL == state)
+        {
+            break;
+        }
+        if (!wait_word(&slot->state, state, &slot->waiters, deadline))
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+    size_t len = slot->len;
+    if (len > buf_len)
+    {
+        handle_error_en(EMSGSIZE);
+    }
+    memcpy(buf, slot->msg, len);
+    atomic_store(&slot->state, SHM_REPLY_EMPTY);
+    wake_word(&slot->state, &slot->waiters);
+    return len;
+}
+
+void shm_ring_clear_reply(shm_ring_t *ring, uint8_t pseudo_port)
+{
+    shm_reply_slot_t *slot = &ring->replies[pseudo_port];
+    unsigned int state = SHM_REPLY_FULL;
+
+    if (atomic_compare_exchange_strong(&slot->state, &state, SHM_REPLY_EMPTY))
+    {
+        wake_word(&slot->state, &slot->waiters);
+    }
+}
+
+void shm_ring_shutdown(shm_ring_t *ring)
+{
+    atomic_store(&ring->closing, 1);
+    atomic_fetch_add(&ring->posted, 1);
+    wake_word(&ring->posted, &ring->posted_waiters);
+}
+
+void shm_ring_destroy(shm_ring_t *ring)
+{
+    shm_ring_detach(ring);
+    int rc = shm_unlink(SHM_RING_NAME);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
+
+void shm_ring_detach(shm_ring_t *ring)
+{
+    int rc = munmap(ring, sizeof(*ring));
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
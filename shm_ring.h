@@ -0,0 +1,261 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file shm_ring.h
+*
+* \brief Transport over the POSIX shared memory segment SHM_RING_NAME, an
+*        alternative to the message queues. Clients push requests into a
+*        lock-free multi-producer single-consumer ring read by the server;
+*        the server answers in the reply slot of the client's pseudo_port.
+*        The messages are the same request_msg_t / response_msg_t ones sent
+*        over the queues. Sleeping and waking use futexes, and only when the
+*        other side is actually waiting, so a busy exchange makes no system
+*        call at all.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/types.h>  /* For ssize_t */
+#include "constants.h"
+
+#define SHM_RING_NAME "/tok_server_ring"
+#define SHM_RING_MAGIC 0x52494E4753484D01ull /**< "RINGSHM" and 1. */
+#define SHM_RING_LEN 256        /**< Request slots, a power of two. */
+#define SHM_RING_PORTS_NO 256   /**< One reply slot per pseudo_port. */
+
+/*
+*******************************************************************************
+*   shm_req_slot_t
+*******************************************************************************
+*
+*  \brief           <b> shm_req_slot_t </b>\n
+*                   One slot of the request ring. seq tells whose turn it is:
+*                   pos for the producer claiming position pos, pos + 1 once
+*                   the request is in, for the consumer.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    _Alignas(64) _Atomic uint64_t seq;
+    uint32_t len;
+    char msg[MQ_MSGSIZE];
+} shm_req_slot_t;
+
+/*
+*******************************************************************************
+*   shm_reply_slot_t
+*******************************************************************************
+*
+*  \brief           <b> shm_reply_slot_t </b>\n
+*                   Reply slot of one pseudo_port. state is the futex word,
+*                   SHM_REPLY_EMPTY, SHM_REPLY_WRITING or SHM_REPLY_FULL;
+*                   waiters counts the threads sleeping on it.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    _Alignas(64) atomic_uint state;
+    atomic_uint waiters;
+    uint32_t len;
+    char msg[MQ_MSGSIZE];
+} shm_reply_slot_t;
+
+enum {
+    SHM_REPLY_EMPTY,
+    SHM_REPLY_WRITING,
+    SHM_REPLY_FULL
+};
+
+/*
+*******************************************************************************
+*   shm_ring_t
+*******************************************************************************
+*
+*  \brief           <b> shm_ring_t </b>\n
+*                   Layout of the segment. posted and freed are futex words
+*                   bumped for every request pushed and every slot given
+*                   back; the server sleeps on the first when the ring is
+*                   empty, clients on the second when it is full.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    _Atomic uint64_t magic;
+    _Alignas(64) _Atomic uint64_t tail;     /**< Next position to claim. */
+    _Alignas(64) _Atomic uint64_t head;     /**< Next position to read. */
+    _Alignas(64) atomic_uint posted;
+    atomic_uint posted_waiters;
+    atomic_uint closing;
+    _Alignas(64) atomic_uint freed;
+    atomic_uint freed_waiters;
+    shm_req_slot_t reqs[SHM_RING_LEN];
+    shm_reply_slot_t replies[SHM_RING_PORTS_NO];
+} shm_ring_t;
+
+/*
+*******************************************************************************
+*   shm_ring_create / shm_ring_attach
+*******************************************************************************
+*
+*  \brief           <b> shm_ring_create / shm_ring_attach </b>\n
+*                   The server creates the segment, replacing one left by a
+*                   previous server; clients attach to it.
+*
+*  \return          The mapping. Errors are fatal for the server, a client
+*                   gets NULL if no server created the segment.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+shm_ring_t *shm_ring_create(void);
+shm_ring_t *shm_ring_attach(void);
+
+/*
+*******************************************************************************
+*   shm_ring_resume
+*******************************************************************************
+*
+*  \brief           <b> shm_ring_resume </b>\n
+*                   For a server taking over from one that called
+*                   shm_ring_shutdown: attaches to its segment, keeping the
+*                   requests still in the ring, and serves it again.
+*
+*  \return          The mapping, NULL if there is no valid segment.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+shm_ring_t *shm_ring_resume(void);
+
+/*
+*******************************************************************************
+*   shm_ring_send
+*******************************************************************************
+*
+*  \brief           <b> shm_ring_send </b>\n
+*                   Pushes a request, sleeping while the ring is full. Any
+*                   number of clients may send at once.
+*
+*  \param           len                               At most MQ_MSGSIZE.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void shm_ring_send(shm_ring_t *ring, const void *msg, size_t len);
+
+/*
+*******************************************************************************
+*   shm_ring_receive / shm_ring_consume
+*******************************************************************************
+*
+*  \brief           <b> shm_ring_receive / shm_ring_consume </b>\n
+*                   For the single server thread reading the ring.
+*                   shm_ring_receive sleeps until a request is in and returns
+*                   it in place, so it can be parsed without a copy;
+*                   shm_ring_consume gives its slot back afterwards.
+*
+*  \return          The request, NULL once shm_ring_shutdown was called.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+const char *shm_ring_receive(shm_ring_t *ring, size_t *len);
+void shm_ring_consume(shm_ring_t *ring);
+
+/*
+*******************************************************************************
+*   shm_ring_reply
+*******************************************************************************
+*
+*  \brief           <b> shm_ring_reply </b>\n
+*                   Puts a response in the reply slot of pseudo_port,
+*                   sleeping while the client has not read the previous one,
+*                   like mq_timedsend on a full queue.
+*
+*  \param           deadline                          CLOCK_REALTIME, as for
+*                                                     mq_timedsend.
+*
+*  \return          False if the slot was still full at deadline.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+bool shm_ring_reply(shm_ring_t *ring, uint8_t pseudo_port, const void *msg,
+        size_t len, const struct timespec *deadline);
+
+/*
+*******************************************************************************
+*   shm_ring_wait_reply
+*******************************************************************************
+*
+*  \brief           <b> shm_ring_wait_reply </b>\n
+*                   Takes the response from the reply slot of pseudo_port,
+*                   sleeping until there is one.
+*
+*  \param           deadline                          CLOCK_REALTIME, NULL
+*                                                     waits forever.
+*
+*  \return          The length of the response copied to buf, -1 with errno
+*                   ETIMEDOUT if none came by deadline.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+ssize_t shm_ring_wait_reply(shm_ring_t *ring, uint8_t pseudo_port, void *buf,
+        size_t buf_len, const struct timespec *deadline);
+
+/*
+*******************************************************************************
+*   shm_ring_clear_reply
+*******************************************************************************
+*
+*  \brief           <b> shm_ring_clear_reply </b>\n
+*                   Drops a response left in the slot of pseudo_port by a
+*                   previous client. Called by a client before using it.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void shm_ring_clear_reply(shm_ring_t *ring, uint8_t pseudo_port);
+
+/*
+*******************************************************************************
+*   shm_ring_shutdown / shm_ring_destroy / shm_ring_detach
+*******************************************************************************
+*
+*  \brief           <b> shm_ring_shutdown / shm_ring_destroy / shm_ring_detach </b>\n
+*                   shm_ring_shutdown wakes the server thread in
+*                   shm_ring_receive for good. shm_ring_destroy unmaps and
+*                   removes the segment, shm_ring_detach only unmaps it.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void shm_ring_shutdown(shm_ring_t *ring);
+void shm_ring_destroy(shm_ring_t *ring);
+void shm_ring_detach(shm_ring_t *ring);
+
+#endif /* SHM_RING_H */
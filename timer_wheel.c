@@ -0,0 +1,186 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file timer_wheel.c
+*
+* \brief Implements the timer wheel declared in timer_wheel.h. Level l has
+*        TW_SLOTS_NO slots of TW_SLOTS_NO^l ticks each. A timer sits on the
+*        lowest level whose range reaches its expiry and is moved down a level
+*        whenever the level below wraps around.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdlib.h>         /* For calloc() and exit() */
+#include "utils.h"
+#include "timer_wheel.h"
+
+#define TW_SLOT_MASK (TW_SLOTS_NO - 1)
+#define TW_HEADS_NO (TW_LEVELS_NO * TW_SLOTS_NO)
+
+static uint32_t slot_head(timer_wheel_t *tw, unsigned int level, unsigned int slot);
+static bool is_scheduled(timer_wheel_t *tw, uint32_t id);
+static void link_node(timer_wheel_t *tw, uint32_t head, uint32_t id);
+static void unlink_node(timer_wheel_t *tw, uint32_t id);
+static void place(timer_wheel_t *tw, uint32_t id);
+static void cascade(timer_wheel_t *tw, unsigned int level);
+
+static uint32_t slot_head(timer_wheel_t *tw, unsigned int level, unsigned int slot)
+{
+    return tw->ids_no + level * TW_SLOTS_NO + slot;
+}
+
+static bool is_scheduled(timer_wheel_t *tw, uint32_t id)
+{
+    return tw->expires[id] != 0;
+}
+
+static void link_node(timer_wheel_t *tw, uint32_t head, uint32_t id)
+{
+    tw->next[id] = head;
+    tw->prev[id] = tw->prev[head];
+    tw->next[tw->prev[head]] = id;
+    tw->prev[head] = id;
+}
+
+static void unlink_node(timer_wheel_t *tw, uint32_t id)
+{
+    tw->next[tw->prev[id]] = tw->next[id];
+    tw->prev[tw->next[id]] = tw->prev[id];
+}
+
+/* Links id into the slot matching its expiry, which is after tw->now. */
+static void place(timer_wheel_t *tw, uint32_t id)
+{
+    uint64_t expires = tw->expires[id];
+    uint64_t delta = expires - tw->now;
+    unsigned int level = 0;
+
+    while (level < TW_LEVELS_NO - 1 &&
+           delta >= (uint64_t)TW_SLOTS_NO << (level * TW_LEVEL_BITS))
+    {
+        level++;
+    }
+    if (delta >= (uint64_t)TW_SLOTS_NO << (level * TW_LEVEL_BITS))
+    {
+        /* Beyond the wheel: park it as far as it reaches, it is placed
+           again when that slot cascades. */
+        expires = tw->now + ((uint64_t)TW_SLOT_MASK << (level * TW_LEVEL_BITS));
+    }
+    unsigned int slot = (expires >> (level * TW_LEVEL_BITS)) & TW_SLOT_MASK;
+    link_node(tw, slot_head(tw, level, slot), id);
+}
+
+/* Moves the timers of the current slot of level one level down. */
+static void cascade(timer_wheel_t *tw, unsigned int level)
+{
+    unsigned int slot = (tw->now >> (level * TW_LEVEL_BITS)) & TW_SLOT_MASK;
+    uint32_t head = slot_head(tw, level, slot);
+
+    while (tw->next[head] != head)
+    {
+        uint32_t id = tw->next[head];
+        unlink_node(tw, id);
+        if (tw->expires[id] <= tw->now)
+        {
+            /* Due on this very tick: level 0 is handled right after. */
+            link_node(tw, slot_head(tw, 0, tw->now & TW_SLOT_MASK), id);
+        }
+        else
+        {
+            place(tw, id);
+        }
+    }
+}
+
+int tw_init(timer_wheel_t *tw, uint32_t ids_no, uint64_t now)
+{
+    uint32_t nodes_no = ids_no + TW_HEADS_NO;
+
+    *tw = (timer_wheel_t){0};
+    tw->ids_no = ids_no;
+    tw->now = now;
+    tw->next = calloc(nodes_no, sizeof(*tw->next));
+    tw->prev = calloc(nodes_no, sizeof(*tw->prev));
+    tw->expires = calloc(ids_no, sizeof(*tw->expires));
+    if (NULL == tw->next || NULL == tw->prev || NULL == tw->expires)
+    {
+        handle_error();
+    }
+    for (uint32_t head = ids_no; head < nodes_no; head++)
+    {
+        tw->next[head] = head;
+        tw->prev[head] = head;
+    }
+    return 0;
+}
+
+void tw_schedule(timer_wheel_t *tw, uint32_t id, uint64_t expires)
+{
+    if (is_scheduled(tw, id))
+    {
+        unlink_node(tw, id);
+    }
+    else
+    {
+        tw->scheduled_no++;
+    }
+    tw->expires[id] = expires > tw->now ? expires : tw->now + 1;
+    place(tw, id);
+}
+
+void tw_cancel(timer_wheel_t *tw, uint32_t id)
+{
+    if (is_scheduled(tw, id))
+    {
+        unlink_node(tw, id);
+        tw->expires[id] = 0;
+        tw->scheduled_no--;
+    }
+}
+
+uint64_t tw_advance(timer_wheel_t *tw, uint64_t now, tw_expire_t expire, void *ctx)
+{
+    uint64_t fired = 0;
+
+    while (tw->now < now)
+    {
+        tw->now++;
+        for (unsigned int level = 1; level < TW_LEVELS_NO; level++)
+        {
+            if ((tw->now >> ((level - 1) * TW_LEVEL_BITS)) & TW_SLOT_MASK)
+            {
+                break;
+            }
+            cascade(tw, level);
+        }
+
+        uint32_t head = slot_head(tw, 0, tw->now & TW_SLOT_MASK);
+        while (tw->next[head] != head)
+        {
+            uint32_t id = tw->next[head];
+            unlink_node(tw, id);
+            tw->expires[id] = 0;
+            tw->scheduled_no--;
+            fired++;
+            expire(id, ctx);
+        }
+        if (0 == tw->scheduled_no)
+        {
+            /* Nothing left to cascade, skip the idle ticks. */
+            tw->now = now;
+        }
+    }
+    return fired;
+}
+
+void tw_destroy(timer_wheel_t *tw)
+{
+    free(tw->next);
+    free(tw->prev);
+    free(tw->expires);
+    *tw = (timer_wheel_t){0};
+}
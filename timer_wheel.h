@@ -0,0 +1,131 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file timer_wheel.h
+*
+* \brief Hierarchical timer wheel with one-second ticks over a fixed set of
+*        numeric ids. Every id has at most one timer. Scheduling, moving and
+*        cancelling a timer are O(1), and so is advancing the wheel by one
+*        tick, apart from the timers that fire. Not thread-safe.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TW_LEVEL_BITS 6
+#define TW_SLOTS_NO (1u << TW_LEVEL_BITS) /**< Slots on every level. */
+#define TW_LEVELS_NO 4  /**< 64^4 seconds, about 194 days, ahead at most. */
+#define TW_NIL UINT32_MAX
+
+typedef void (*tw_expire_t)(uint32_t id, void *ctx);
+
+/*
+*******************************************************************************
+*   timer_wheel_t
+*******************************************************************************
+*
+*  \brief           <b> timer_wheel_t </b>\n
+*                   The wheel. Every slot is a circular doubly linked list
+*                   whose head is a sentinel node numbered after the ids, so
+*                   unlinking needs no lookup. Treat the members as private.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    uint32_t ids_no;
+    uint32_t *next;     /**< ids_no nodes followed by the slot sentinels. */
+    uint32_t *prev;
+    uint64_t *expires;
+    uint64_t now;       /**< Last tick processed. */
+    uint64_t scheduled_no;
+} timer_wheel_t;
+
+/*
+*******************************************************************************
+*   tw_init
+*******************************************************************************
+*
+*  \brief           <b> tw_init </b>\n
+*                   Creates an empty wheel for ids 0 to ids_no - 1 whose
+*                   current tick is now.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int tw_init(timer_wheel_t *tw, uint32_t ids_no, uint64_t now);
+
+/*
+*******************************************************************************
+*   tw_schedule
+*******************************************************************************
+*
+*  \brief           <b> tw_schedule </b>\n
+*                   Sets the timer of id to fire at tick expires, moving it if
+*                   it was already set. A tick already passed fires on the
+*                   next one.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void tw_schedule(timer_wheel_t *tw, uint32_t id, uint64_t expires);
+
+/*
+*******************************************************************************
+*   tw_cancel
+*******************************************************************************
+*
+*  \brief           <b> tw_cancel </b>\n
+*                   Removes the timer of id, if set.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void tw_cancel(timer_wheel_t *tw, uint32_t id);
+
+/*
+*******************************************************************************
+*   tw_advance
+*******************************************************************************
+*
+*  \brief           <b> tw_advance </b>\n
+*                   Processes every tick up to now, calling expire(id, ctx)
+*                   for each timer that fires. The timer is removed before the
+*                   call, so expire may schedule it again.
+*
+*  \return          Number of timers fired.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+uint64_t tw_advance(timer_wheel_t *tw, uint64_t now, tw_expire_t expire, void *ctx);
+
+/*
+*******************************************************************************
+*   tw_destroy
+*******************************************************************************
+*
+*  \brief           <b> tw_destroy </b>\n
+*                   Frees the wheel.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void tw_destroy(timer_wheel_t *tw);
+
+#endif /* TIMER_WHEEL_H */
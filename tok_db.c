@@ -0,0 +1,1930 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file tok_db.c
+*
+* \brief Implements the token database declared in tok_db.h.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#define _GNU_SOURCE         /* For SEEK_DATA, SEEK_HOLE and memfd_create */
+#include <stdio.h>
+#include <stdlib.h>         /* For exit() */
+#include <fcntl.h>          /* For O_* constants and fnctl*/
+#include <sys/stat.h>       /* For mode constants and struct stat*/
+#include <sys/mman.h>       /* For mmap and msync */
+#include <unistd.h>
+#include <assert.h>
+#include <string.h>
+#include <limits.h>
+#include "utils.h"
+#include "constants.h"
+#include "common.h"
+#include "tok_db.h"
+#include "journal.h"
+
+#define OPEN_BUF_LEN 4096
+#define OWNER_UNWATCHED (-2)    /**< Tag of an owner that could not be watched. */
+#define PROVISIONAL_TIME UINT32_MAX /**< Packed aq_time of a token an all or
+                                         nothing batch has not decided yet. */
+
+static uint32_t read_header(int fd, off_t size);
+static void create_database(int fd, uint32_t tokens_no);
+static int open_database(const char *path, uint32_t requested_no, int sync_flags,
+        int *fd, uint32_t *tokens_no);
+static off_t get_offset(uint32_t token);
+static size_t get_db_size(uint32_t tokens_no);
+static unsigned int get_stripe(uint32_t token);
+static uint64_t pack_entry(db_entry_t entry);
+static uint64_t pack_provisional(pid_t owner);
+static db_entry_t unpack_entry(uint64_t word);
+static bool is_entry_free(const db_entry_t *old_entry, pid_t owner, time_t current_time);
+static void load_range(tok_db_t *db, uint32_t first, uint32_t last, time_t current_time);
+static void load_words(tok_db_t *db, time_t current_time);
+static size_t get_state_size(uint32_t tokens_no);
+static const db_header_t *map_state(int state_fd, size_t *len);
+static void import_state(tok_db_t *db, const db_header_t *state, time_t current_time);
+static int export_state(tok_db_t *db);
+static int open_db(tok_db_t *db, const db_config_t *cfg, int state_fd);
+static int close_db(tok_db_t *db, int *state_fd);
+static void write_entry(tok_db_t *db, uint32_t token, db_entry_t entry);
+static uint64_t persist_entry(tok_db_t *db, uint32_t token);
+static void flush_range(tok_db_t *db, uint32_t first_token, uint32_t last_token);
+static bool try_reserve(tok_db_t *db, uint32_t token, uint64_t new_word,
+        pid_t owner, time_t current_time, uint64_t *prev_word);
+static void commit_changes(tok_db_t *db, uint32_t first_token, uint32_t last_token,
+        uint64_t seq);
+static void flush_all(tok_db_t *db);
+static bool uses_journal(const tok_db_t *db);
+static bool uses_flusher(const tok_db_t *db);
+static void sync_parent_dir(const char *path);
+static void write_snapshot(tok_db_t *db);
+static void replay_rec(const journal_rec_t *rec, void *ctx);
+static void checkpoint_f(void *ctx);
+static void recover_journal(tok_db_t *db);
+static void *flusher_f(void *args);
+static void mark_free(tok_db_t *db, uint32_t token);
+static void mark_used(tok_db_t *db, uint32_t token);
+static void mark_freed(tok_db_t *db, uint32_t token, time_t current_time);
+static void schedule_expiry(tok_db_t *db, uint32_t token);
+static void list_token(tok_db_t *db, uint32_t token, pid_t owner);
+static bool index_token(tok_db_t *db, uint32_t token, time_t current_time);
+static void expire_f(uint32_t token, void *ctx);
+static void drain_pending(tok_db_t *db, time_t current_time);
+static void *expirer_f(void *args);
+static void owner_exited_f(pid_t owner, int pidfd, void *ctx);
+static void unwatch_owner_f(pid_t owner, int tag, void *ctx);
+static bool try_reserve_in_word(tok_db_t *db, unsigned int word, uint64_t mask,
+        uint64_t new_word, pid_t owner, time_t current_time, uint32_t *token);
+static bool is_taken_before(const uint32_t *tokens, const uint8_t *results, unsigned int i);
+static void sift_down(uint32_t *heap, unsigned int heap_no, unsigned int i);
+static void keep_lowest(uint32_t *heap, unsigned int *heap_no, unsigned int heap_max,
+        uint32_t token);
+
+static const char k_db_magic_no[] = {0x4E, 0x41, 0x4E, 0x4F, 0x44, 0x42, 0x00, 0x02};
+static const char k_state_magic_no[] = {0x4E, 0x41, 0x4E, 0x4F, 0x53, 0x54, 0x00, 0x01};
+
+static off_t get_offset(uint32_t token)
+{
+    static_assert(sizeof(off_t) >= sizeof(int64_t), "off_t cannot reach every entry\n");
+    return sizeof(db_header_t) + (off_t)token * sizeof(db_entry_t);
+}
+
+/* Returns the tokens_no of the database in fd, 0 if it is not one. */
+static uint32_t read_header(int fd, off_t size)
+{
+    db_header_t header;
+
+    if (size < (off_t)sizeof(header))
+    {
+        return 0;
+    }
+    ssize_t chr_no = pread(fd, &header, sizeof(header), 0);
+    if (-1 == chr_no)
+    {
+        handle_error();
+    }
+    if ((size_t)chr_no != sizeof(header) ||
+        memcmp(header.magic, k_db_magic_no, sizeof(header.magic)) != 0 ||
+        header.tokens_no < DB_TOKENS_MIN || header.tokens_no > DB_TOKENS_MAX ||
+        size != get_offset(header.tokens_no))
+    {
+        return 0;
+    }
+    return header.tokens_no;
+}
+
+/* Drops what fd held and makes it an empty database. ftruncate leaves the
+ * entries a hole, read back as zeros, instead of writing them. */
+static void create_database(int fd, uint32_t tokens_no)
+{
+    db_header_t header = {.tokens_no = tokens_no};
+    int rc;
+
+    memcpy(header.magic, k_db_magic_no, sizeof(header.magic));
+    rc = ftruncate(fd, 0);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    ssize_t chr_no = pwrite(fd, &header, sizeof(header), 0);
+    if (-1 == chr_no)
+    {
+        handle_error();
+    }
+    if ((size_t)chr_no != sizeof(header))
+    {
+        handle_error_en(EIO);
+    }
+    rc = ftruncate(fd, get_offset(tokens_no));
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    rc = fsync(fd);
+    if (rc != 0)
+    {
+        handle_error();
+    }
+}
+
+static int open_database(const char *path, uint32_t requested_no, int sync_flags,
+        int *fd, uint32_t *tokens_no) {
+    struct stat db_st;
+    int db_fd;
+    int flags;
+    int rc;
+    const int open_flags = O_CREAT | O_NONBLOCK | O_NOFOLLOW | O_RDWR | sync_flags;
+    const mode_t open_mode = MQ_MODE;
+
+    db_fd = open(path, open_flags, open_mode);
+    if (-1 == db_fd)
+    {
+        handle_error();
+    }
+    rc = fstat(db_fd, &db_st);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    if (!S_ISREG(db_st.st_mode))
+    {
+        fprintf(stderr, "%s:%d %s is not a regular file\n", __FILE__, __LINE__, path);
+        exit(1);
+    }
+
+    /* discard O_NONBLOCK */
+    flags = fcntl(db_fd, F_GETFL);
+    if (-1 == flags)
+    {
+        handle_error();
+    }
+    rc = fcntl(db_fd, F_SETFL, flags & ~O_NONBLOCK);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+
+    uint32_t file_tokens_no = read_header(db_fd, db_st.st_size);
+    if (requested_no != 0)
+    {
+        *tokens_no = requested_no;
+    }
+    else
+    {
+        *tokens_no = file_tokens_no != 0 ? file_tokens_no : DB_DEFAULT_TOK;
+    }
+    if (file_tokens_no != *tokens_no)
+    {
+        if (file_tokens_no != 0)
+        {
+            printf("%s held %u tokens, recreating it empty with %u.\n",
+                    path, file_tokens_no, *tokens_no);
+        }
+        create_database(db_fd, *tokens_no);
+    }
+
+    /* return db_fd through fd */
+    *fd = db_fd;
+    /* return success */
+    return 0;
+}
+
+static size_t get_db_size(uint32_t tokens_no)
+{
+    return get_offset(tokens_no);
+}
+
+static unsigned int get_stripe(uint32_t token)
+{
+    return token / DB_STRIPE_TOK % DB_STRIPES_NO;
+}
+
+static bool is_entry_free(const db_entry_t *old_entry, pid_t owner, time_t current_time)
+{
+    return old_entry->owner == 0 ||
+        old_entry->owner == owner ||
+        old_entry->aq_time + DB_ENTRY_TTL <= current_time;
+}
+
+/* The owner goes in the high half and the acquisition time, as unsigned
+ * seconds, in the low half, so one compare-and-swap updates both. */
+static uint64_t pack_entry(db_entry_t entry)
+{
+    static_assert(sizeof(pid_t) == sizeof(uint32_t),
+            "pid_t does not fit in half of the packed word\n");
+    uint32_t aq_time = (uint32_t)entry.aq_time;
+    /* PROVISIONAL_TIME is left to pack_provisional, a second earlier. */
+    if (PROVISIONAL_TIME == aq_time)
+    {
+        aq_time--;
+    }
+    return ((uint64_t)(uint32_t)entry.owner << 32) | aq_time;
+}
+
+/* A word no request packs: held by owner, which alone may take it over,
+ * and far from expiring. */
+static uint64_t pack_provisional(pid_t owner)
+{
+    return ((uint64_t)(uint32_t)owner << 32) | PROVISIONAL_TIME;
+}
+
+static db_entry_t unpack_entry(uint64_t word)
+{
+    db_entry_t entry = {0};
+    entry.owner = (pid_t)(uint32_t)(word >> 32);
+    entry.aq_time = (time_t)(uint32_t)word;
+    return entry;
+}
+
+/* Copies the entries of tokens first to last - 1 that were ever reserved
+ * to words and indexes them. */
+static void load_range(tok_db_t *db, uint32_t first, uint32_t last, time_t current_time)
+{
+    db_entry_t buf[OPEN_BUF_LEN / sizeof(db_entry_t)];
+
+    for (uint32_t token = first; token < last; token += ARRAY_LEN(buf))
+    {
+        unsigned int count = last - token;
+        const db_entry_t *src = buf;
+        if (count > ARRAY_LEN(buf))
+        {
+            count = ARRAY_LEN(buf);
+        }
+        if (DB_BACKEND_MMAP == db->cfg.backend)
+        {
+            src = &db->entries[token];
+        }
+        else
+        {
+            ssize_t rc = pread(db->fd, buf, count * sizeof(db_entry_t), get_offset(token));
+            if (-1 == rc)
+            {
+                handle_error();
+            }
+            if ((size_t)rc != count * sizeof(db_entry_t))
+            {
+                handle_error_en(EIO);
+            }
+        }
+        for (unsigned int i = 0; i < count; i++)
+        {
+            uint64_t word = pack_entry(src[i]);
+            if (word != 0)
+            {
+                atomic_init(&db->words[token + i], word);
+                index_token(db, token + i, current_time);
+            }
+        }
+    }
+}
+
+/* Only the data extents of the file are read: its holes are tokens never
+ * reserved, whose words calloc already left 0. */
+static void load_words(tok_db_t *db, time_t current_time)
+{
+    off_t end = get_offset(db->tokens_no);
+    off_t data = get_offset(0);
+
+    while (data < end)
+    {
+        data = lseek(db->fd, data, SEEK_DATA);
+        if (-1 == data)
+        {
+            if (ENXIO == errno)
+            {
+                break;
+            }
+            handle_error();
+        }
+        off_t hole = lseek(db->fd, data, SEEK_HOLE);
+        if (-1 == hole)
+        {
+            handle_error();
+        }
+        /* Extents are in blocks, entries may straddle their ends. */
+        uint32_t first = data > get_offset(0) ?
+            (data - get_offset(0)) / sizeof(db_entry_t) : 0;
+        uint32_t last = hole < end ?
+            (hole - get_offset(0) + sizeof(db_entry_t) - 1) / sizeof(db_entry_t) :
+            db->tokens_no;
+        load_range(db, first, last, current_time);
+        data = hole;
+    }
+}
+
+/* A state image is a db_header_t, a copy of used_bits and the words, those
+ * of the tokens not in use left a hole. */
+static size_t get_state_size(uint32_t tokens_no)
+{
+    return sizeof(db_header_t) + ((size_t)tokens_no + 63) / 64 * sizeof(uint64_t) +
+        (size_t)tokens_no * sizeof(uint64_t);
+}
+
+/* Maps the image made by export_state, closing state_fd. */
+static const db_header_t *map_state(int state_fd, size_t *len)
+{
+    struct stat st;
+    db_header_t *state;
+    int rc;
+
+    rc = fstat(state_fd, &st);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    if ((size_t)st.st_size < sizeof(*state))
+    {
+        handle_error_en(EINVAL);
+    }
+    state = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, state_fd, 0);
+    if (MAP_FAILED == state)
+    {
+        handle_error();
+    }
+    rc = close(state_fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    if (memcmp(state->magic, k_state_magic_no, sizeof(state->magic)) != 0 ||
+        state->tokens_no < DB_TOKENS_MIN || state->tokens_no > DB_TOKENS_MAX ||
+        (size_t)st.st_size != get_state_size(state->tokens_no))
+    {
+        handle_error_en(EINVAL);
+    }
+    *len = st.st_size;
+    return state;
+}
+
+/* Takes the words of the tokens in use from the image, instead of reading
+ * the file. Only the bitmap is scanned, so this costs the tokens in use. */
+static void import_state(tok_db_t *db, const db_header_t *state, time_t current_time)
+{
+    const uint64_t *bits = (const uint64_t *)(state + 1);
+    const uint64_t *words = bits + (db->tokens_no + 63) / 64;
+
+    for (unsigned int i = 0; i < (db->tokens_no + 63) / 64; i++)
+    {
+        uint64_t used = bits[i];
+        while (used != 0)
+        {
+            uint32_t token = i * 64 + __builtin_ctzll(used);
+            used &= used - 1;
+            atomic_init(&db->words[token], words[token]);
+            index_token(db, token, current_time);
+        }
+    }
+}
+
+/* Writes the tokens in use to an image in a memory file, for the db_attach
+ * of another process. The expirer and the workers must be stopped. Every
+ * word change pushes its token on a pending stack, and index_token sets
+ * the bit of every token it finds held, so once the tokens not indexed yet
+ * are, used_bits has every token in use, those replayed from the journal
+ * included, whatever bits a racing mark_free cleared before. Scanning the
+ * bitmap keeps the handoff time to the tokens in use. Tokens whose
+ * DB_ENTRY_TTL passed are left out, they are free anyway. */
+static int export_state(tok_db_t *db)
+{
+    size_t len = get_state_size(db->tokens_no);
+    int rc;
+
+    time_t current_time = time(NULL);
+    if (-1 == current_time)
+    {
+        handle_error();
+    }
+    drain_pending(db, current_time);
+
+    int state_fd = memfd_create("tok_db_state", MFD_CLOEXEC);
+    if (-1 == state_fd)
+    {
+        handle_error();
+    }
+    rc = ftruncate(state_fd, len);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    db_header_t *state = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, state_fd, 0);
+    if (MAP_FAILED == state)
+    {
+        handle_error();
+    }
+    uint64_t *bits = (uint64_t *)(state + 1);
+    uint64_t *words = bits + (db->tokens_no + 63) / 64;
+    memcpy(state->magic, k_state_magic_no, sizeof(state->magic));
+    state->tokens_no = db->tokens_no;
+    for (unsigned int i = 0; i < (db->tokens_no + 63) / 64; i++)
+    {
+        uint64_t used = atomic_load_explicit(&db->used_bits[i], memory_order_relaxed);
+        if (0 == used)
+        {
+            continue;
+        }
+        bits[i] = used;
+        while (used != 0)
+        {
+            uint32_t token = i * 64 + __builtin_ctzll(used);
+            used &= used - 1;
+            words[token] = atomic_load_explicit(&db->words[token], memory_order_relaxed);
+        }
+    }
+    rc = munmap(state, len);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    return state_fd;
+}
+
+static void write_entry(tok_db_t *db, uint32_t token, db_entry_t entry)
+{
+    if (DB_BACKEND_MMAP == db->cfg.backend)
+    {
+        db->entries[token] = entry;
+    }
+    else if (DB_BACKEND_FILE == db->cfg.backend)
+    {
+        ssize_t chr_no = pwrite(db->fd, &entry, sizeof(entry), get_offset(token));
+        if (-1 == chr_no)
+        {
+            handle_error();
+        }
+    }
+}
+
+/* Copies the current in-memory value of token to the backend and, if it
+ * keeps one, to the journal. Holding the stripe lock while reading the
+ * word means that, of two racing writers, the one that writes last also
+ * writes the newest value. Returns the journal sequence number, if any. */
+static uint64_t persist_entry(tok_db_t *db, uint32_t token)
+{
+    pthread_mutex_t *stripe = &db->stripes[get_stripe(token)];
+    db_entry_t entry;
+    uint64_t seq = 0;
+    int rc;
+
+    rc = pthread_mutex_lock(stripe);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    uint64_t word = atomic_load(&db->words[token]);
+    /* A provisional word is not written: the batch that holds it writes
+     * the token once it is decided, either way. */
+    if ((uint32_t)word != PROVISIONAL_TIME)
+    {
+        entry = unpack_entry(word);
+        write_entry(db, token, entry);
+        if (uses_journal(db))
+        {
+            seq = journal_append(&db->journal, token, entry.owner, entry.aq_time);
+        }
+    }
+    rc = pthread_mutex_unlock(stripe);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    return seq;
+}
+
+static void flush_range(tok_db_t *db, uint32_t first_token, uint32_t last_token)
+{
+    int rc;
+
+    if (DB_BACKEND_MMAP == db->cfg.backend)
+    {
+        /* msync wants a page aligned start. */
+        uintptr_t first = (uintptr_t)&db->entries[first_token] & ~(uintptr_t)(db->page_size - 1);
+        uintptr_t last = (uintptr_t)&db->entries[last_token + 1];
+        rc = msync((void *)first, last - first, MS_SYNC);
+    }
+    else
+    {
+        rc = fdatasync(db->fd);
+    }
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
+
+static void flush_all(tok_db_t *db)
+{
+    int rc;
+
+    if (DB_BACKEND_MEMORY == db->cfg.backend)
+    {
+        write_snapshot(db);
+        return;
+    }
+    if (DB_BACKEND_MMAP == db->cfg.backend)
+    {
+        rc = msync(db->map, db->map_len, MS_SYNC);
+    }
+    else
+    {
+        rc = fdatasync(db->fd);
+    }
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
+
+static bool uses_journal(const tok_db_t *db)
+{
+    return DB_FLUSH_GROUP == db->cfg.flush || DB_BACKEND_MEMORY == db->cfg.backend;
+}
+
+static bool uses_flusher(const tok_db_t *db)
+{
+    return DB_FLUSH_PERIODIC == db->cfg.flush || DB_BACKEND_MEMORY == db->cfg.backend;
+}
+
+/* Makes a rename in the directory of path durable. */
+static void sync_parent_dir(const char *path)
+{
+    char dir[PATH_MAX] = ".";
+    const char *slash = strrchr(path, '/');
+    int rc;
+
+    if (slash != NULL)
+    {
+        size_t len = slash == path ? 1 : (size_t)(slash - path);
+        if (len >= sizeof(dir))
+        {
+            handle_error_en(ENAMETOOLONG);
+        }
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+    }
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+    if (-1 == dir_fd)
+    {
+        handle_error();
+    }
+    rc = fsync(dir_fd);
+    if (rc != 0)
+    {
+        handle_error();
+    }
+    rc = close(dir_fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
+
+/* DB_BACKEND_MEMORY: writes words to a new file in the database format and
+ * renames it over the database. Words keep changing while they are copied,
+ * but each change is journaled after the records already written, so the
+ * journal replayed over the snapshot still gives the state it ends with.
+ * Runs from the journal checkpoint, so never twice at once. */
+static void write_snapshot(tok_db_t *db)
+{
+    db_entry_t buf[OPEN_BUF_LEN / sizeof(db_entry_t)];
+    uint64_t start_ns = get_monotonic_ns();
+    int rc;
+
+    int fd = open(db->snapshot_path, O_CREAT | O_TRUNC | O_NOFOLLOW | O_WRONLY, MQ_MODE);
+    if (-1 == fd)
+    {
+        handle_error();
+    }
+    create_database(fd, db->tokens_no);
+    for (uint32_t token = 0; token < db->tokens_no; token += ARRAY_LEN(buf))
+    {
+        unsigned int count = db->tokens_no - token;
+        bool used = false;
+        if (count > ARRAY_LEN(buf))
+        {
+            count = ARRAY_LEN(buf);
+        }
+        for (unsigned int i = 0; i < count; i++)
+        {
+            uint64_t word = atomic_load_explicit(&db->words[token + i], memory_order_relaxed);
+            /* The journal records how the batch holding a provisional word
+             * is decided; if it is not, it was never acknowledged. */
+            if ((uint32_t)word == PROVISIONAL_TIME)
+            {
+                word = 0;
+            }
+            buf[i] = unpack_entry(word);
+            used = used || word != 0;
+        }
+        if (!used)
+        {
+            /* Left a hole. */
+            continue;
+        }
+        ssize_t chr_no = pwrite(fd, buf, count * sizeof(db_entry_t), get_offset(token));
+        if (-1 == chr_no)
+        {
+            handle_error();
+        }
+        if ((size_t)chr_no != count * sizeof(db_entry_t))
+        {
+            handle_error_en(EIO);
+        }
+    }
+    rc = fdatasync(fd);
+    if (rc != 0)
+    {
+        handle_error();
+    }
+    rc = close(fd);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    const char *path = NULL == db->cfg.path ? DATABASE_NAME : db->cfg.path;
+    rc = rename(db->snapshot_path, path);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    /* The journal is truncated next: the new name must stick first. */
+    sync_parent_dir(path);
+    atomic_store(&db->snapshot_ns, get_monotonic_ns() - start_ns);
+    atomic_fetch_add(&db->snapshots_no, 1);
+}
+
+static void replay_rec(const journal_rec_t *rec, void *ctx)
+{
+    tok_db_t *db = ctx;
+    db_entry_t entry = {.owner = rec->owner, .aq_time = rec->aq_time};
+
+    if (rec->token >= db->tokens_no)
+    {
+        return;
+    }
+    atomic_store(&db->words[rec->token], pack_entry(entry));
+    write_entry(db, rec->token, entry);
+    /* Indexed again on the first tick. */
+    schedule_expiry(db, rec->token);
+}
+
+static void checkpoint_f(void *ctx)
+{
+    flush_all(ctx);
+}
+
+/* Applies what a previous run left in the journal and makes it durable in
+ * the database itself, so the journal can start empty. The journal only
+ * holds the changes since the last checkpoint, so this takes a bounded
+ * time whatever the history. */
+static void recover_journal(tok_db_t *db)
+{
+    uint64_t replayed = journal_replay(db->journal_path, replay_rec, db);
+    int rc;
+
+    if (replayed > 0)
+    {
+        flush_all(db);
+        printf("Replayed %llu journal records.\n", (unsigned long long)replayed);
+    }
+    if (!uses_journal(db))
+    {
+        rc = unlink(db->journal_path);
+        if (-1 == rc && errno != ENOENT)
+        {
+            handle_error();
+        }
+    }
+}
+
+static void *flusher_f(void *args)
+{
+    tok_db_t *db = args;
+    struct timespec deadline;
+    int rc;
+
+    rc = pthread_mutex_lock(&db->flush_lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    while (!db->closing)
+    {
+        rc = clock_gettime(CLOCK_REALTIME, &deadline);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+        deadline.tv_sec += db->cfg.flush_interval_ms / 1000;
+        deadline.tv_nsec += (long)(db->cfg.flush_interval_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        rc = pthread_cond_timedwait(&db->flush_cond, &db->flush_lock, &deadline);
+        if (rc != 0 && rc != ETIMEDOUT)
+        {
+            handle_error_en(rc);
+        }
+        if (DB_BACKEND_MEMORY == db->cfg.backend)
+        {
+            journal_flush(&db->journal);
+        }
+        else if (atomic_exchange(&db->dirty, false))
+        {
+            flush_all(db);
+        }
+    }
+    rc = pthread_mutex_unlock(&db->flush_lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    return NULL;
+}
+
+static void mark_free(tok_db_t *db, uint32_t token)
+{
+    atomic_fetch_and(&db->used_bits[token / 64], ~(UINT64_C(1) << (token % 64)));
+}
+
+static void mark_used(tok_db_t *db, uint32_t token)
+{
+    atomic_fetch_or(&db->used_bits[token / 64], UINT64_C(1) << (token % 64));
+}
+
+/* Clears the bit of token once its word is free. A reserve that took the
+ * token since may have set the bit before it was cleared, so the word is
+ * read again after and the bit set back if the token is held. */
+static void mark_freed(tok_db_t *db, uint32_t token, time_t current_time)
+{
+    mark_free(db, token);
+    db_entry_t entry = unpack_entry(atomic_load(&db->words[token]));
+    if (!is_entry_free(&entry, 0, current_time))
+    {
+        mark_used(db, token);
+    }
+}
+
+/* Hands token to the expirer after its word changed. Lock-free: a token
+ * already waiting is not pushed twice, the expirer reads the newest word. */
+static void schedule_expiry(tok_db_t *db, uint32_t token)
+{
+    _Atomic uint32_t *head = &db->pending_heads[get_stripe(token)];
+
+    if (atomic_exchange(&db->pending[token], true))
+    {
+        return;
+    }
+    uint32_t old_head = atomic_load_explicit(head, memory_order_relaxed);
+    do
+    {
+        atomic_store_explicit(&db->pending_next[token], old_head, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak(head, &old_head, token));
+}
+
+/* Lists token under owner, 0 for none. With reclaim an owner is watched
+ * from its first token to its last one; one gone by then is reclaimed at
+ * once. An owner that cannot be watched, out of descriptors, is not tried
+ * again while it is listed: its tokens are left to expire. */
+static void list_token(tok_db_t *db, uint32_t token, pid_t owner)
+{
+    int dropped_tag = oi_set(&db->owners, token, owner);
+
+    if (!db->cfg.reclaim)
+    {
+        return;
+    }
+    if (dropped_tag >= 0)
+    {
+        pid_watch_remove(&db->watch, dropped_tag);
+    }
+    int *tag = oi_tag(&db->owners, owner);
+    if (tag != NULL && OI_NO_TAG == *tag)
+    {
+        int pidfd = pid_watch_add(&db->watch, owner);
+        *tag = -1 == pidfd ? OWNER_UNWATCHED : pidfd;
+    }
+}
+
+/* Clears the bit of token in the bitmap if it is free, otherwise sets it,
+ * sets its timer to its expiry and lists it under its owner. Returns true
+ * if the token is free. Called by the expirer, and by db_open before it
+ * starts. */
+static bool index_token(tok_db_t *db, uint32_t token, time_t current_time)
+{
+    db_entry_t entry = unpack_entry(atomic_load(&db->words[token]));
+
+    if (is_entry_free(&entry, 0, current_time))
+    {
+        tw_cancel(&db->wheel, token);
+        list_token(db, token, 0);
+        mark_freed(db, token, current_time);
+        return true;
+    }
+    tw_schedule(&db->wheel, token, (uint64_t)entry.aq_time + DB_ENTRY_TTL);
+    list_token(db, token, entry.owner);
+    mark_used(db, token);
+    return false;
+}
+
+static void expire_f(uint32_t token, void *ctx)
+{
+    tok_db_t *db = ctx;
+
+    /* A renewed token is not free yet and just gets a new timer. */
+    if (index_token(db, token, (time_t)db->wheel.now))
+    {
+        atomic_fetch_add_explicit(&db->expired_no, 1, memory_order_relaxed);
+    }
+}
+
+static void drain_pending(tok_db_t *db, time_t current_time)
+{
+    for (unsigned int i = 0; i < DB_STRIPES_NO; i++)
+    {
+        uint32_t token = atomic_exchange(&db->pending_heads[i], TW_NIL);
+        while (token != TW_NIL)
+        {
+            /* Read next first: once pending is cleared token may be pushed
+             * again, overwriting it. */
+            uint32_t next = atomic_load_explicit(&db->pending_next[token],
+                    memory_order_relaxed);
+            atomic_store(&db->pending[token], false);
+            index_token(db, token, current_time);
+            token = next;
+        }
+    }
+}
+
+static void *expirer_f(void *args)
+{
+    tok_db_t *db = args;
+    struct timespec deadline;
+    int rc;
+
+    rc = pthread_mutex_lock(&db->expire_lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    while (!db->expire_closing)
+    {
+        rc = clock_gettime(CLOCK_REALTIME, &deadline);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+        deadline.tv_sec += DB_EXPIRY_TICK_MS / 1000;
+        rc = pthread_cond_timedwait(&db->expire_cond, &db->expire_lock, &deadline);
+        if (rc != 0 && rc != ETIMEDOUT)
+        {
+            handle_error_en(rc);
+        }
+        time_t current_time = time(NULL);
+        if (-1 == current_time)
+        {
+            handle_error();
+        }
+        drain_pending(db, current_time);
+        tw_advance(&db->wheel, current_time, expire_f, db);
+    }
+    rc = pthread_mutex_unlock(&db->expire_lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    return NULL;
+}
+
+/* Frees the tokens of owner, DB_BATCH_MAX at a time with one commit each,
+ * the way db_release frees one. The lock is dropped while committing, so
+ * every batch checks again that pidfd is still the tag of owner and its
+ * process is gone; an event for a pidfd removed meanwhile is ignored. */
+static void owner_exited_f(pid_t owner, int pidfd, void *ctx)
+{
+    tok_db_t *db = ctx;
+    uint32_t tokens[DB_BATCH_MAX];
+    int rc;
+
+    for (;;)
+    {
+        unsigned int tokens_no = 0;
+        uint32_t held_no;
+
+        rc = pthread_mutex_lock(&db->expire_lock);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+        time_t current_time = time(NULL);
+        if (-1 == current_time)
+        {
+            handle_error();
+        }
+        /* Unlists the tokens of the previous batch. */
+        drain_pending(db, current_time);
+        int *tag = oi_tag(&db->owners, owner);
+        if (tag != NULL && *tag == pidfd && pid_watch_exited(pidfd))
+        {
+            for (uint32_t token = oi_first(&db->owners, owner, &held_no);
+                    token != OI_NIL && tokens_no < DB_BATCH_MAX;
+                    token = oi_next(&db->owners, token))
+            {
+                tokens[tokens_no++] = token;
+            }
+        }
+        rc = pthread_mutex_unlock(&db->expire_lock);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+        if (0 == tokens_no)
+        {
+            return;
+        }
+
+        unsigned int freed_no = 0;
+        uint32_t first_token = UINT32_MAX;
+        uint32_t last_token = 0;
+        uint64_t seq = 0;
+        for (unsigned int i = 0; i < tokens_no; i++)
+        {
+            uint32_t token = tokens[i];
+            uint64_t old_word = atomic_load(&db->words[token]);
+            bool freed = false;
+            while (unpack_entry(old_word).owner == owner)
+            {
+                if (atomic_compare_exchange_weak(&db->words[token], &old_word, 0))
+                {
+                    freed = true;
+                    break;
+                }
+            }
+            /* Indexed again either way: a token taken by another owner
+             * since it was listed moves to its list. */
+            schedule_expiry(db, token);
+            if (!freed)
+            {
+                continue;
+            }
+            uint64_t rec_seq = persist_entry(db, token);
+            seq = rec_seq > seq ? rec_seq : seq;
+            first_token = token < first_token ? token : first_token;
+            last_token = token > last_token ? token : last_token;
+            tokens[freed_no++] = token;
+        }
+        if (freed_no > 0)
+        {
+            commit_changes(db, first_token, last_token, seq);
+        }
+        for (unsigned int i = 0; i < freed_no; i++)
+        {
+            mark_freed(db, tokens[i], current_time);
+        }
+        atomic_fetch_add_explicit(&db->reclaimed_no, freed_no, memory_order_relaxed);
+    }
+}
+
+static void unwatch_owner_f(pid_t owner, int tag, void *ctx)
+{
+    tok_db_t *db = ctx;
+
+    (void)owner;
+    if (tag >= 0)
+    {
+        pid_watch_remove(&db->watch, tag);
+    }
+}
+
+int db_open(tok_db_t *db, const db_config_t *cfg)
+{
+    return open_db(db, cfg, -1);
+}
+
+int db_attach(tok_db_t *db, const db_config_t *cfg, int state_fd)
+{
+    return open_db(db, cfg, state_fd);
+}
+
+/* The words come from the state image in state_fd, or from the file when
+ * it is -1. */
+static int open_db(tok_db_t *db, const db_config_t *cfg, int state_fd)
+{
+    const db_header_t *state = NULL;
+    size_t state_len = 0;
+    uint32_t requested_no = cfg->tokens_no;
+    int rc;
+
+    *db = (tok_db_t){0};
+    db->cfg = *cfg;
+    atomic_init(&db->dirty, false);
+    if (cfg->tokens_no != 0 &&
+        (cfg->tokens_no < DB_TOKENS_MIN || cfg->tokens_no > DB_TOKENS_MAX))
+    {
+        handle_error_en(EINVAL);
+    }
+    if (state_fd != -1)
+    {
+        state = map_state(state_fd, &state_len);
+        requested_no = state->tokens_no;
+    }
+    /* O_DSYNC cannot be set later with fcntl. */
+    int sync_flags = DB_FLUSH_DSYNC == cfg->flush && DB_BACKEND_FILE == cfg->backend ?
+            O_DSYNC : 0;
+    rc = open_database(NULL == cfg->path ? DATABASE_NAME : cfg->path, requested_no,
+            sync_flags, &db->fd, &db->tokens_no);
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
+    for (unsigned int i = 0; i < DB_STRIPES_NO; i++)
+    {
+        rc = pthread_mutex_init(&db->stripes[i], NULL);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+    }
+
+    if (DB_BACKEND_MMAP == cfg->backend)
+    {
+        db->page_size = sysconf(_SC_PAGESIZE);
+        if (-1 == db->page_size)
+        {
+            handle_error();
+        }
+        db->map_len = get_db_size(db->tokens_no);
+        db->map = mmap(NULL, db->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, db->fd, 0);
+        if (MAP_FAILED == db->map)
+        {
+            handle_error();
+        }
+        void *first_entry = (char *)db->map + get_offset(0);
+        db->entries = first_entry;
+    }
+
+    time_t current_time = time(NULL);
+    if (-1 == current_time)
+    {
+        handle_error();
+    }
+    atomic_init(&db->alloc_hint, 0);
+    atomic_init(&db->expired_no, 0);
+    atomic_init(&db->released_no, 0);
+    atomic_init(&db->renewed_no, 0);
+    atomic_init(&db->reclaimed_no, 0);
+    /* Everything below is zero filled lazily by calloc, so a large token
+     * space costs nothing until its tokens are used. */
+    db->words = calloc(db->tokens_no, sizeof(*db->words));
+    db->used_bits = calloc((db->tokens_no + 63) / 64, sizeof(*db->used_bits));
+    db->pending_next = calloc(db->tokens_no, sizeof(*db->pending_next));
+    db->pending = calloc(db->tokens_no, sizeof(*db->pending));
+    if (NULL == db->words || NULL == db->used_bits || NULL == db->pending_next ||
+        NULL == db->pending)
+    {
+        handle_error();
+    }
+    for (unsigned int i = 0; i < DB_STRIPES_NO; i++)
+    {
+        atomic_init(&db->pending_heads[i], TW_NIL);
+    }
+    rc = tw_init(&db->wheel, db->tokens_no, current_time);
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
+    rc = oi_init(&db->owners, db->tokens_no);
+    if (rc != 0)
+    {
+        handle_error_en(0);
+    }
+    if (cfg->reclaim)
+    {
+        /* The owners found next are watched, their exits wait in the
+         * epoll set until the lock exists. */
+        rc = pid_watch_init(&db->watch, owner_exited_f, db);
+        if (rc != 0)
+        {
+            handle_error_en(0);
+        }
+    }
+    if (NULL == state)
+    {
+        load_words(db, current_time);
+    }
+    else
+    {
+        import_state(db, state, current_time);
+        rc = munmap((void *)state, state_len);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+    }
+
+    rc = snprintf(db->journal_path, sizeof(db->journal_path), "%s" JOURNAL_SUFFIX,
+            NULL == cfg->path ? DATABASE_NAME : cfg->path);
+    if (rc < 0 || (size_t)rc >= sizeof(db->journal_path))
+    {
+        handle_error_en(ENAMETOOLONG);
+    }
+    rc = snprintf(db->snapshot_path, sizeof(db->snapshot_path), "%s" DB_SNAPSHOT_SUFFIX,
+            NULL == cfg->path ? DATABASE_NAME : cfg->path);
+    if (rc < 0 || (size_t)rc >= sizeof(db->snapshot_path))
+    {
+        handle_error_en(ENAMETOOLONG);
+    }
+    atomic_init(&db->snapshots_no, 0);
+    atomic_init(&db->snapshot_ns, 0);
+    /* With DB_BACKEND_MEMORY the journal of a state image is still to be
+     * made durable by the next snapshot, and the image holds it already. */
+    bool resume_journal = state != NULL && DB_BACKEND_MEMORY == cfg->backend;
+    if (!resume_journal)
+    {
+        recover_journal(db);
+    }
+    if (DB_BACKEND_MEMORY == cfg->backend)
+    {
+        /* Snapshots replace the file, this one is not needed any more. */
+        rc = close(db->fd);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+        db->fd = -1;
+    }
+    if (uses_journal(db))
+    {
+        if (resume_journal)
+        {
+            rc = journal_resume(&db->journal, db->journal_path, checkpoint_f, db);
+        }
+        else
+        {
+            rc = journal_open(&db->journal, db->journal_path, checkpoint_f, db);
+        }
+        if (rc != 0)
+        {
+            handle_error_en(0);
+        }
+    }
+    rc = pthread_mutex_init(&db->expire_lock, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_cond_init(&db->expire_cond, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_create(&db->expirer, NULL, expirer_f, db);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    if (cfg->reclaim)
+    {
+        rc = pid_watch_start(&db->watch);
+        if (rc != 0)
+        {
+            handle_error_en(0);
+        }
+    }
+
+    if (uses_flusher(db))
+    {
+        if (0 == cfg->flush_interval_ms)
+        {
+            handle_error_en(EINVAL);
+        }
+        rc = pthread_mutex_init(&db->flush_lock, NULL);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+        rc = pthread_cond_init(&db->flush_cond, NULL);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+        rc = pthread_create(&db->flusher, NULL, flusher_f, db);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+    }
+    return 0;
+}
+
+/* Compare-and-swap loop taking token for owner. On success the replaced
+ * word is returned through prev_word, so the change can be undone. */
+static bool try_reserve(tok_db_t *db, uint32_t token, uint64_t new_word,
+        pid_t owner, time_t current_time, uint64_t *prev_word)
+{
+    uint64_t old_word;
+    db_entry_t old_entry;
+
+    if (token >= db->tokens_no)
+    {
+        return false;
+    }
+    old_word = atomic_load(&db->words[token]);
+    do
+    {
+        old_entry = unpack_entry(old_word);
+        if (!is_entry_free(&old_entry, owner, current_time))
+        {
+            return false;
+        }
+        /* Two batches of owner would hold the token with the same word,
+         * and the one rolled back would take it from the other. */
+        if ((uint32_t)old_word == PROVISIONAL_TIME && (uint32_t)new_word == PROVISIONAL_TIME)
+        {
+            return false;
+        }
+    } while (!atomic_compare_exchange_weak(&db->words[token], &old_word, new_word));
+    *prev_word = old_word;
+    mark_used(db, token);
+    schedule_expiry(db, token);
+    return true;
+}
+
+/* Applies the flush policy once for changes persisted to tokens between
+ * first_token and last_token, seq being the last journal record. */
+static void commit_changes(tok_db_t *db, uint32_t first_token, uint32_t last_token,
+        uint64_t seq)
+{
+    switch (db->cfg.flush)
+    {
+        case DB_FLUSH_DSYNC:
+            if (DB_BACKEND_FILE == db->cfg.backend)
+            {
+                /* Every pwrite was synchronous already. */
+                break;
+            }
+            /* fall through */
+        case DB_FLUSH_EACH:
+            if (DB_BACKEND_MEMORY == db->cfg.backend)
+            {
+                journal_wait(&db->journal, seq);
+                break;
+            }
+            flush_range(db, first_token, last_token);
+        break;
+        case DB_FLUSH_GROUP:
+            journal_wait(&db->journal, seq);
+        break;
+        case DB_FLUSH_PERIODIC:
+            atomic_store(&db->dirty, true);
+        break;
+        default:
+        break;
+    }
+}
+
+int db_reserve(tok_db_t *db, uint32_t token, db_entry_t entry)
+{
+    uint64_t prev_word;
+
+    errno = 0;
+    time_t current_time = time(NULL);
+    if (-1 == current_time)
+    {
+        handle_error();
+    }
+
+    if (!try_reserve(db, token, pack_entry(entry), entry.owner, current_time, &prev_word))
+    {
+        return TOKEN_NOT_AVAILABLE;
+    }
+    uint64_t seq = persist_entry(db, token);
+    commit_changes(db, token, token, seq);
+    return ACK;
+}
+
+/* True if tokens[i] is listed before i and was taken there. */
+static bool is_taken_before(const uint32_t *tokens, const uint8_t *results, unsigned int i)
+{
+    for (unsigned int j = 0; j < i; j++)
+    {
+        if (tokens[j] == tokens[i] && ACK == results[j])
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned int db_reserve_many(tok_db_t *db, const uint32_t *tokens, unsigned int tokens_no,
+        db_entry_t entry, bool all_or_nothing, uint8_t *results)
+{
+    uint64_t new_word = pack_entry(entry);
+    /* All or nothing, the tokens are held with a provisional word until
+     * every one is taken. Only the owner's own requests may take them over
+     * meanwhile, and a token they took over is theirs and left alone. */
+    uint64_t held_word = all_or_nothing ? pack_provisional(entry.owner) : new_word;
+    uint64_t prev_words[DB_BATCH_MAX];
+    unsigned int reserved_no = 0;
+    uint32_t first_token = UINT32_MAX;
+    uint32_t last_token = 0;
+    uint64_t seq = 0;
+
+    if (tokens_no > DB_BATCH_MAX)
+    {
+        handle_error_en(EINVAL);
+    }
+    errno = 0;
+    time_t current_time = time(NULL);
+    if (-1 == current_time)
+    {
+        handle_error();
+    }
+
+    for (unsigned int i = 0; i < tokens_no; i++)
+    {
+        /* try_reserve refuses a provisional word, this batch's included. */
+        if (all_or_nothing && held_word == atomic_load(&db->words[tokens[i]]) &&
+            is_taken_before(tokens, results, i))
+        {
+            prev_words[i] = held_word;
+            results[i] = ACK;
+            reserved_no++;
+        }
+        else if (try_reserve(db, tokens[i], held_word, entry.owner, current_time, &prev_words[i]))
+        {
+            results[i] = ACK;
+            reserved_no++;
+        }
+        else
+        {
+            results[i] = TOKEN_NOT_AVAILABLE;
+        }
+    }
+
+    bool rolled_back = all_or_nothing && reserved_no != tokens_no;
+    /* Undone in reverse order, so a token listed twice gets its original
+     * word back. Either way the tokens are written once decided: persist_entry
+     * skipped the provisional words. */
+    for (unsigned int i = tokens_no; i-- > 0;)
+    {
+        if (results[i] != ACK)
+        {
+            continue;
+        }
+        if (rolled_back)
+        {
+            uint64_t expected = held_word;
+            if (atomic_compare_exchange_strong(&db->words[tokens[i]], &expected, prev_words[i]))
+            {
+                db_entry_t prev_entry = unpack_entry(prev_words[i]);
+                if (is_entry_free(&prev_entry, 0, current_time))
+                {
+                    mark_freed(db, tokens[i], current_time);
+                }
+                schedule_expiry(db, tokens[i]);
+            }
+            results[i] = ROLLED_BACK;
+        }
+        else if (all_or_nothing)
+        {
+            uint64_t expected = held_word;
+            if (atomic_compare_exchange_strong(&db->words[tokens[i]], &expected, new_word))
+            {
+                schedule_expiry(db, tokens[i]);
+            }
+        }
+        uint64_t rec_seq = persist_entry(db, tokens[i]);
+        seq = rec_seq > seq ? rec_seq : seq;
+        first_token = tokens[i] < first_token ? tokens[i] : first_token;
+        last_token = tokens[i] > last_token ? tokens[i] : last_token;
+    }
+    if (first_token <= last_token)
+    {
+        commit_changes(db, first_token, last_token, seq);
+    }
+    return rolled_back ? 0 : reserved_no;
+}
+
+/* Tries the tokens whose bits are clear in word and set in mask. Bits of
+ * tokens found taken are set on the way. */
+static bool try_reserve_in_word(tok_db_t *db, unsigned int word, uint64_t mask,
+        uint64_t new_word, pid_t owner, time_t current_time, uint32_t *token)
+{
+    uint64_t bits = ~atomic_load(&db->used_bits[word]) & mask;
+    uint64_t prev_word;
+
+    while (bits != 0)
+    {
+        uint32_t candidate = word * 64 + __builtin_ctzll(bits);
+        if (try_reserve(db, candidate, new_word, owner, current_time, &prev_word))
+        {
+            *token = candidate;
+            return true;
+        }
+        /* Taken under our feet, or a stale bit. */
+        mark_used(db, candidate);
+        bits &= bits - 1;
+    }
+    return false;
+}
+
+int db_reserve_any(tok_db_t *db, uint32_t token_min, uint32_t token_max,
+        db_entry_t entry, uint32_t *token)
+{
+    uint64_t new_word = pack_entry(entry);
+
+    if (token_max >= db->tokens_no)
+    {
+        token_max = db->tokens_no - 1;
+    }
+    if (token_min > token_max)
+    {
+        return TOKEN_NOT_AVAILABLE;
+    }
+    unsigned int first_word = token_min / 64;
+    unsigned int last_word = token_max / 64;
+    unsigned int words_no = last_word - first_word + 1;
+    errno = 0;
+    time_t current_time = time(NULL);
+    if (-1 == current_time)
+    {
+        handle_error();
+    }
+
+    /* Concurrent callers start on different words, so they do not all
+     * fight over the first free token. */
+    unsigned int start = atomic_fetch_add_explicit(&db->alloc_hint, 1,
+            memory_order_relaxed) % words_no;
+    for (unsigned int i = 0; i < words_no; i++)
+    {
+        unsigned int word = first_word + (start + i) % words_no;
+        uint64_t mask = UINT64_MAX;
+        if (word == first_word)
+        {
+            mask &= UINT64_MAX << (token_min % 64);
+        }
+        if (word == last_word)
+        {
+            mask &= UINT64_MAX >> (63 - token_max % 64);
+        }
+        if (try_reserve_in_word(db, word, mask, new_word, entry.owner, current_time, token))
+        {
+            uint64_t seq = persist_entry(db, *token);
+            commit_changes(db, *token, *token, seq);
+            return ACK;
+        }
+    }
+    return TOKEN_NOT_AVAILABLE;
+}
+
+int db_release(tok_db_t *db, uint32_t token, pid_t owner)
+{
+    uint64_t old_word;
+    db_entry_t old_entry;
+
+    if (token >= db->tokens_no)
+    {
+        return NOT_OWNER;
+    }
+    old_word = atomic_load(&db->words[token]);
+    do
+    {
+        old_entry = unpack_entry(old_word);
+        if (0 == owner || old_entry.owner != owner)
+        {
+            return NOT_OWNER;
+        }
+    } while (!atomic_compare_exchange_weak(&db->words[token], &old_word, 0));
+
+    uint64_t seq = persist_entry(db, token);
+    commit_changes(db, token, token, seq);
+    mark_freed(db, token, time(NULL));
+    /* Drops the timer, it has nothing left to expire. */
+    schedule_expiry(db, token);
+    atomic_fetch_add_explicit(&db->released_no, 1, memory_order_relaxed);
+    return ACK;
+}
+
+unsigned int db_renew_many(tok_db_t *db, const uint32_t *tokens, unsigned int tokens_no,
+        db_entry_t entry, uint8_t *results)
+{
+    unsigned int renewed_no = 0;
+
+    errno = 0;
+    time_t current_time = time(NULL);
+    if (-1 == current_time)
+    {
+        handle_error();
+    }
+
+    for (unsigned int i = 0; i < tokens_no; i++)
+    {
+        uint64_t old_word;
+        uint64_t new_word;
+        db_entry_t old_entry;
+
+        if (tokens[i] >= db->tokens_no)
+        {
+            results[i] = NOT_OWNER;
+            continue;
+        }
+        old_word = atomic_load(&db->words[tokens[i]]);
+        results[i] = ACK;
+        do
+        {
+            old_entry = unpack_entry(old_word);
+            /* A provisional word is not held yet. */
+            if (0 == entry.owner || old_entry.owner != entry.owner ||
+                is_entry_free(&old_entry, 0, current_time) ||
+                (uint32_t)old_word == PROVISIONAL_TIME)
+            {
+                results[i] = NOT_OWNER;
+                break;
+            }
+            /* Never shorten a lease. */
+            db_entry_t new_entry = {
+                .owner = entry.owner,
+                .aq_time = entry.aq_time > old_entry.aq_time ? entry.aq_time : old_entry.aq_time
+            };
+            new_word = pack_entry(new_entry);
+        } while (!atomic_compare_exchange_weak(&db->words[tokens[i]], &old_word, new_word));
+
+        if (ACK == results[i])
+        {
+            /* The old timer fires, finds the new aq_time and is set again. */
+            persist_entry(db, tokens[i]);
+            renewed_no++;
+        }
+    }
+    if (renewed_no > 0 && DB_FLUSH_PERIODIC == db->cfg.flush)
+    {
+        atomic_store(&db->dirty, true);
+    }
+    atomic_fetch_add_explicit(&db->renewed_no, renewed_no, memory_order_relaxed);
+    return renewed_no;
+}
+
+unsigned int db_count_free(tok_db_t *db)
+{
+    unsigned int used_no = 0;
+
+    /* Bits past the last token are never set. */
+    for (unsigned int i = 0; i < (db->tokens_no + 63) / 64; i++)
+    {
+        used_no += __builtin_popcountll(atomic_load_explicit(&db->used_bits[i],
+                    memory_order_relaxed));
+    }
+    return db->tokens_no - used_no;
+}
+
+/* Restores the max-heap order of heap from i down. */
+static void sift_down(uint32_t *heap, unsigned int heap_no, unsigned int i)
+{
+    for (;;)
+    {
+        unsigned int largest = i;
+        unsigned int left = 2 * i + 1;
+        if (left < heap_no && heap[left] > heap[largest])
+        {
+            largest = left;
+        }
+        if (left + 1 < heap_no && heap[left + 1] > heap[largest])
+        {
+            largest = left + 1;
+        }
+        if (largest == i)
+        {
+            return;
+        }
+        uint32_t tmp = heap[i];
+        heap[i] = heap[largest];
+        heap[largest] = tmp;
+        i = largest;
+    }
+}
+
+/* Keeps the heap_max lowest tokens seen in a max-heap, so the highest one
+ * is dropped first. */
+static void keep_lowest(uint32_t *heap, unsigned int *heap_no, unsigned int heap_max,
+        uint32_t token)
+{
+    if (*heap_no < heap_max)
+    {
+        unsigned int i = (*heap_no)++;
+        heap[i] = token;
+        while (i > 0 && heap[(i - 1) / 2] < heap[i])
+        {
+            uint32_t tmp = heap[i];
+            heap[i] = heap[(i - 1) / 2];
+            heap[(i - 1) / 2] = tmp;
+            i = (i - 1) / 2;
+        }
+        return;
+    }
+    if (heap_max > 0 && token < heap[0])
+    {
+        heap[0] = token;
+        sift_down(heap, *heap_no, 0);
+    }
+}
+
+unsigned int db_query_owner(tok_db_t *db, pid_t owner, uint32_t token_min,
+        uint32_t *tokens, unsigned int tokens_max, db_occupancy_t *occupancy)
+{
+    unsigned int tokens_no = 0;
+    uint32_t held_no;
+    int rc;
+
+    rc = pthread_mutex_lock(&db->expire_lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    /* What the expirer would do on its next tick. */
+    time_t current_time = time(NULL);
+    if (-1 == current_time)
+    {
+        handle_error();
+    }
+    drain_pending(db, current_time);
+    tw_advance(&db->wheel, current_time, expire_f, db);
+
+    for (uint32_t token = oi_first(&db->owners, owner, &held_no); token != OI_NIL;
+            token = oi_next(&db->owners, token))
+    {
+        if (token >= token_min)
+        {
+            keep_lowest(tokens, &tokens_no, tokens_max, token);
+        }
+    }
+    occupancy->held_no = held_no;
+    occupancy->used_no = db->owners.listed_no;
+    occupancy->owners_no = db->owners.owners_no;
+    occupancy->tokens_no = db->tokens_no;
+    rc = pthread_mutex_unlock(&db->expire_lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+
+    /* Heap sort, the highest goes last. */
+    for (unsigned int i = tokens_no; i > 1; i--)
+    {
+        uint32_t tmp = tokens[0];
+        tokens[0] = tokens[i - 1];
+        tokens[i - 1] = tmp;
+        sift_down(tokens, i - 1, 0);
+    }
+    return tokens_no;
+}
+
+int db_close(tok_db_t *db)
+{
+    return close_db(db, NULL);
+}
+
+int db_detach(tok_db_t *db, int *state_fd)
+{
+    return close_db(db, state_fd);
+}
+
+/* Exports the state to *state_fd first, unless state_fd is NULL. With
+ * DB_BACKEND_MEMORY the journal is then left to the process taking the
+ * image, instead of writing a snapshot that takes time with the tokens. */
+static int close_db(tok_db_t *db, int *state_fd)
+{
+    bool keep_journal = state_fd != NULL && DB_BACKEND_MEMORY == db->cfg.backend;
+    int rc;
+
+    if (db->cfg.reclaim)
+    {
+        /* Its thread takes expire_lock. */
+        pid_watch_stop(&db->watch);
+    }
+    rc = pthread_mutex_lock(&db->expire_lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    db->expire_closing = true;
+    rc = pthread_cond_signal(&db->expire_cond);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_mutex_unlock(&db->expire_lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_join(db->expirer, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    pthread_cond_destroy(&db->expire_cond);
+    pthread_mutex_destroy(&db->expire_lock);
+    if (state_fd != NULL)
+    {
+        *state_fd = export_state(db);
+    }
+    tw_destroy(&db->wheel);
+    if (db->cfg.reclaim)
+    {
+        oi_for_each_owner(&db->owners, unwatch_owner_f, db);
+        pid_watch_destroy(&db->watch);
+    }
+    oi_destroy(&db->owners);
+    free(db->pending_next);
+    free(db->pending);
+    free(db->used_bits);
+
+    if (uses_flusher(db))
+    {
+        rc = pthread_mutex_lock(&db->flush_lock);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+        db->closing = true;
+        rc = pthread_cond_signal(&db->flush_cond);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+        rc = pthread_mutex_unlock(&db->flush_lock);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+        rc = pthread_join(db->flusher, NULL);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+        pthread_cond_destroy(&db->flush_cond);
+        pthread_mutex_destroy(&db->flush_lock);
+    }
+    if (uses_journal(db))
+    {
+        rc = journal_close(&db->journal);
+        if (rc != 0)
+        {
+            handle_error_en(0);
+        }
+    }
+    if ((db->cfg.flush != DB_FLUSH_NONE || DB_BACKEND_MEMORY == db->cfg.backend) &&
+        !keep_journal)
+    {
+        flush_all(db);
+    }
+    if (uses_journal(db) && !keep_journal)
+    {
+        /* Everything in the journal is in the database now. */
+        rc = unlink(db->journal_path);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+    }
+
+    if (DB_BACKEND_MMAP == db->cfg.backend)
+    {
+        rc = munmap(db->map, db->map_len);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+    }
+    if (db->fd != -1)
+    {
+        rc = close(db->fd);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+    }
+    for (unsigned int i = 0; i < DB_STRIPES_NO; i++)
+    {
+        pthread_mutex_destroy(&db->stripes[i]);
+    }
+    free(db->words);
+    return 0;
+}
+
+void db_print_stats(tok_db_t *db, FILE *out)
+{
+    int rc = pthread_mutex_lock(&db->expire_lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    fprintf(out, "Expiry: %llu timers set; %llu expired; %llu released; %llu renewed;"
+            " %u tokens free; %u held by %u owners\n",
+            (unsigned long long)db->wheel.scheduled_no,
+            (unsigned long long)atomic_load(&db->expired_no),
+            (unsigned long long)atomic_load(&db->released_no),
+            (unsigned long long)atomic_load(&db->renewed_no),
+            db_count_free(db), db->owners.listed_no, db->owners.owners_no);
+    rc = pthread_mutex_unlock(&db->expire_lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    if (db->cfg.reclaim)
+    {
+        fprintf(out, "Reclaim: %llu owners watched; %llu exited; %llu tokens reclaimed;"
+                " %llu owners not watchable\n",
+                (unsigned long long)atomic_load(&db->watch.watched_no),
+                (unsigned long long)atomic_load(&db->watch.exited_no),
+                (unsigned long long)atomic_load(&db->reclaimed_no),
+                (unsigned long long)atomic_load(&db->watch.failed_no));
+    }
+    if (uses_journal(db))
+    {
+        journal_print_stats(&db->journal, out);
+    }
+    if (DB_BACKEND_MEMORY == db->cfg.backend)
+    {
+        fprintf(out, "Snapshots: %llu written; the last took %.3f s\n",
+                (unsigned long long)atomic_load(&db->snapshots_no),
+                atomic_load(&db->snapshot_ns) / 1e9);
+    }
+}
+
+int db_parse_backend(const char *name, DB_BACKEND *backend)
+{
+    if (0 == strcmp(name, "file"))
+    {
+        *backend = DB_BACKEND_FILE;
+    }
+    else if (0 == strcmp(name, "mmap"))
+    {
+        *backend = DB_BACKEND_MMAP;
+    }
+    else if (0 == strcmp(name, "memory"))
+    {
+        *backend = DB_BACKEND_MEMORY;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int db_parse_flush(const char *name, DB_FLUSH *flush)
+{
+    if (0 == strcmp(name, "each"))
+    {
+        *flush = DB_FLUSH_EACH;
+    }
+    else if (0 == strcmp(name, "periodic"))
+    {
+        *flush = DB_FLUSH_PERIODIC;
+    }
+    else if (0 == strcmp(name, "none"))
+    {
+        *flush = DB_FLUSH_NONE;
+    }
+    else if (0 == strcmp(name, "group"))
+    {
+        *flush = DB_FLUSH_GROUP;
+    }
+    else if (0 == strcmp(name, "dsync"))
+    {
+        *flush = DB_FLUSH_DSYNC;
+    }
+    else
+    {
+        return -1;
+    }
+    return 0;
+}
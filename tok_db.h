@@ -0,0 +1,545 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file tok_db.h
+*
+* \brief The token database kept in the "db" file. The file starts with a
+*        db_header_t followed by one db_entry_t for every token. It is
+*        created sparse and only its data extents are read back, so opening
+*        it costs in proportion to the tokens ever reserved, not to the
+*        size of the token space. Three storage backends are available: plain
+*        pread/pwrite on the file, a shared memory mapping of it, and memory
+*        only, the file being rewritten from time to time as a snapshot.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef TOK_DB_H
+#define TOK_DB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <time.h>
+#include <stdio.h>
+#include <limits.h>     /* For PATH_MAX */
+#include <pthread.h>
+#include <sys/types.h>  /* For pid_t */
+#include "constants.h"
+#include "journal.h"
+#include "timer_wheel.h"
+#include "owner_index.h"
+#include "pid_watch.h"
+
+#define DB_STRIPES_NO 64 /**< Locks serializing writes of the same token. */
+#define DB_STRIPE_TOK SHARD_BLOCK_TOK /**< Tokens in a row under one stripe,
+                                           which then never spans shards. */
+#define DB_BATCH_MAX 256 /**< Most tokens in one db_reserve_many call. */
+#define DB_EXPIRY_TICK_MS 1000 /**< Period of the expiry timer wheel. */
+#define DB_SNAPSHOT_SUFFIX ".snapshot" /**< Snapshot being written, renamed
+                                            over the database when done. */
+
+/*
+*******************************************************************************
+*   DB_BACKEND
+*******************************************************************************
+*
+*  \brief           <b> DB_BACKEND </b>\n
+*                   How the server reaches the "db" file.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef enum {
+    DB_BACKEND_FILE,    /**< pread/pwrite on the file descriptor. */
+    DB_BACKEND_MMAP,    /**< Check-and-set in a shared mapping of the file. */
+    DB_BACKEND_MEMORY   /**< Changes only go to the journal, written every
+                             flush_interval_ms by a background thread. Once
+                             the journal reaches JOURNAL_CHECKPOINT_BYTES
+                             the file is replaced by a snapshot of memory
+                             and the journal starts over. */
+} DB_BACKEND;
+
+/*
+*******************************************************************************
+*   DB_FLUSH
+*******************************************************************************
+*
+*  \brief           <b> DB_FLUSH </b>\n
+*                   When changes are forced to the disk.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef enum {
+    DB_FLUSH_EACH,      /**< Before every reservation is acknowledged. For
+                             DB_BACKEND_MEMORY, like DB_FLUSH_GROUP. */
+    DB_FLUSH_PERIODIC,  /**< By a background thread every flush_interval_ms. */
+    DB_FLUSH_NONE,      /**< Left to the kernel. */
+    DB_FLUSH_GROUP,     /**< Journaled, fdatasync shared by concurrent
+                             reservations before they are acknowledged. */
+    DB_FLUSH_DSYNC      /**< The file is opened with O_DSYNC, so every write,
+                             renewals too, is on the disk when it returns.
+                             Other backends flush like DB_FLUSH_EACH. */
+    /* With DB_BACKEND_MEMORY, DB_FLUSH_PERIODIC and DB_FLUSH_NONE both
+       acknowledge at once and leave the journal to the background thread. */
+} DB_FLUSH;
+
+/*
+*******************************************************************************
+*   db_entry_t
+*******************************************************************************
+*
+*  \brief           <b> db_entry_t </b>\n
+*                   On-disk record of one token.
+*
+*  \var             owner                             Pid of the owner, 0 if
+*                                                     the token was never
+*                                                     reserved.
+*
+*  \var             aq_time                           When it was reserved.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    pid_t owner;
+    time_t aq_time;
+} db_entry_t;
+
+/*
+*******************************************************************************
+*   db_header_t
+*******************************************************************************
+*
+*  \brief           <b> db_header_t </b>\n
+*                   Start of the "db" file.
+*
+*  \var             tokens_no                         Entries following the
+*                                                     header, DB_TOKENS_MIN
+*                                                     to DB_TOKENS_MAX.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    char magic[8];
+    uint32_t tokens_no;
+    uint32_t reserved;
+} db_header_t;
+
+/*
+*******************************************************************************
+*   db_config_t
+*******************************************************************************
+*
+*  \brief           <b> db_config_t </b>\n
+*                   Settings used by db_open.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    const char *path;       /**< NULL means DATABASE_NAME. */
+    DB_BACKEND backend;
+    DB_FLUSH flush;
+    unsigned int flush_interval_ms;
+    uint32_t tokens_no;     /**< 0 keeps the size of an existing file and
+                                 gives a new one DB_DEFAULT_TOK. */
+    bool reclaim;           /**< Owners are processes of this pid
+                                 namespace: free their tokens once they
+                                 exit, instead of after DB_ENTRY_TTL. */
+} db_config_t;
+
+/*
+*******************************************************************************
+*   db_occupancy_t
+*******************************************************************************
+*
+*  \brief           <b> db_occupancy_t </b>\n
+*                   What db_query_owner found.
+*
+*  \var             held_no                           Tokens held by the
+*                                                     owner asked about.
+*
+*  \var             used_no                           Tokens held by anyone.
+*
+*  \var             owners_no                         Owners holding any.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    uint32_t held_no;
+    uint32_t used_no;
+    uint32_t owners_no;
+    uint32_t tokens_no;
+} db_occupancy_t;
+
+/*
+*******************************************************************************
+*   tok_db_t
+*******************************************************************************
+*
+*  \brief           <b> tok_db_t </b>\n
+*                   An open token database. Treat the members as private.
+*                   The authoritative state of every token is a packed
+*                   owner/aq_time word in words, updated with compare-and-swap,
+*                   so reservations of different tokens never wait on each
+*                   other. The backend only keeps a copy of it.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    db_config_t cfg;
+    uint32_t tokens_no;
+    int fd;
+    void *map;              /**< Whole file, only for DB_BACKEND_MMAP. */
+    size_t map_len;
+    long page_size;
+    db_entry_t *entries;    /**< Entries inside map. */
+    _Atomic uint64_t *words; /**< One packed entry for every token. */
+    pthread_mutex_t stripes[DB_STRIPES_NO]; /**< DB_STRIPE_TOK tokens in a row each. */
+
+    /* Periodic flushing. */
+    pthread_t flusher;
+    pthread_mutex_t flush_lock;
+    pthread_cond_t flush_cond;
+    atomic_bool dirty;      /**< Written since the last periodic flush. */
+    bool closing;           /**< Protected by flush_lock. */
+
+    /* DB_FLUSH_GROUP and DB_BACKEND_MEMORY */
+    journal_t journal;
+    char journal_path[PATH_MAX];
+
+    /* DB_BACKEND_MEMORY */
+    char snapshot_path[PATH_MAX];
+    atomic_uint_fast64_t snapshots_no;
+    atomic_uint_fast64_t snapshot_ns;   /**< Time the last one took. */
+
+    /* Free token index. A clear bit means the token is probably free: every
+     * reservation sets its bit, and the expirer clears it again once the
+     * token is released or its DB_ENTRY_TTL passes. db_reserve_any repairs
+     * wrong bits. A new index is all free without being written. */
+    _Atomic uint64_t *used_bits;
+    atomic_uint alloc_hint;     /**< Word where the next search starts. */
+
+    /* Expiry. Workers push changed tokens on the pending stacks without
+     * locking; every tick the expirer moves them to the wheel, keyed by
+     * aq_time + DB_ENTRY_TTL, and frees the tokens whose timer fires. */
+    _Atomic uint32_t pending_heads[DB_STRIPES_NO]; /**< Keyed like stripes. */
+    _Atomic uint32_t *pending_next; /**< Next token on the same stack. */
+    atomic_bool *pending;       /**< The token is on a stack. */
+    timer_wheel_t wheel;        /**< Protected by expire_lock. */
+    owner_index_t owners;       /**< Tokens held by every owner, updated
+                                     wherever the wheel is. Protected by
+                                     expire_lock. */
+    pthread_t expirer;
+    pthread_mutex_t expire_lock;
+    pthread_cond_t expire_cond;
+    bool expire_closing;        /**< Protected by expire_lock. */
+    atomic_uint_fast64_t expired_no;
+    atomic_uint_fast64_t released_no;
+    atomic_uint_fast64_t renewed_no;
+
+    /* Reclaim. Every owner listed in owners is watched through a pidfd,
+     * kept as its tag; when it exits its tokens are freed at once. */
+    pid_watch_t watch;
+    atomic_uint_fast64_t reclaimed_no;
+} tok_db_t;
+
+/*
+*******************************************************************************
+*   db_open
+*******************************************************************************
+*
+*  \brief           <b> db_open </b>\n
+*                   Opens "db" in the working directory. A missing file or one
+*                   with a wrong size or header is recreated empty, with
+*                   cfg->tokens_no tokens; so is a file of another size than
+*                   cfg->tokens_no asks for.
+*                   Records left in "db.journal" by a previous run are
+*                   replayed on top of it, whatever the flush policy. With
+*                   DB_BACKEND_MEMORY "db" is the last snapshot; once it is
+*                   read, and a new snapshot written if records were
+*                   replayed, requests never touch it again.
+*
+*  \param[out]      tok_db_t *db           Database to initialize.
+*
+*  \param[in]       const db_config_t *cfg Backend and flush policy.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int db_open(tok_db_t *db, const db_config_t *cfg);
+
+/*
+*******************************************************************************
+*   db_attach
+*******************************************************************************
+*
+*  \brief           <b> db_attach </b>\n
+*                   Like db_open, but takes the tokens in use from the state
+*                   image made by db_detach in another process instead of
+*                   reading them from the file, and the number of tokens
+*                   too: cfg->tokens_no is ignored. The file is still opened,
+*                   for the writes to come.
+*
+*  \param[in]       int state_fd           The image. Closed by db_attach.
+*
+*  \return          0                      Success. Errors are fatal, a fd
+*                                          holding no image too.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int db_attach(tok_db_t *db, const db_config_t *cfg, int state_fd);
+
+/*
+*******************************************************************************
+*   db_reserve
+*******************************************************************************
+*
+*  \brief           <b> db_reserve </b>\n
+*                   Gives token to entry.owner unless another owner holds it
+*                   and its DB_ENTRY_TTL has not passed yet. Tokens past the
+*                   end of the database are never available.
+*
+*  \return          ACK                    The token was written.
+*
+*  \return          TOKEN_NOT_AVAILABLE    Held by someone else.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int db_reserve(tok_db_t *db, uint32_t token, db_entry_t entry);
+
+/*
+*******************************************************************************
+*   db_reserve_many
+*******************************************************************************
+*
+*  \brief           <b> db_reserve_many </b>\n
+*                   Reserves a batch of tokens for entry.owner. The flush
+*                   policy is applied once for the whole batch: one flush,
+*                   or one wait on the journal. With all_or_nothing, the
+*                   tokens are held provisionally until every one is taken,
+*                   and given back if one is not available; another batch
+*                   of entry.owner does not take them meanwhile.
+*
+*  \param[in]       const uint32_t *tokens Tokens to reserve, at most
+*                                          DB_BATCH_MAX.
+*
+*  \param[out]      uint8_t *results       For every token ACK,
+*                                          TOKEN_NOT_AVAILABLE, or
+*                                          ROLLED_BACK if it was free but the
+*                                          batch failed.
+*
+*  \return          Number of tokens reserved.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+unsigned int db_reserve_many(tok_db_t *db, const uint32_t *tokens, unsigned int tokens_no,
+        db_entry_t entry, bool all_or_nothing, uint8_t *results);
+
+/*
+*******************************************************************************
+*   db_reserve_any
+*******************************************************************************
+*
+*  \brief           <b> db_reserve_any </b>\n
+*                   Reserves for entry.owner any free token between
+*                   token_min and token_max, found through the free token
+*                   bitmap with one scan of its words.
+*
+*  \param[out]      uint32_t *token        The token reserved.
+*
+*  \return          ACK                    A token was reserved.
+*
+*  \return          TOKEN_NOT_AVAILABLE    Every token in the range is held.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int db_reserve_any(tok_db_t *db, uint32_t token_min, uint32_t token_max,
+        db_entry_t entry, uint32_t *token);
+
+/*
+*******************************************************************************
+*   db_release
+*******************************************************************************
+*
+*  \brief           <b> db_release </b>\n
+*                   Gives token back before its DB_ENTRY_TTL passes, if owner
+*                   holds it. The change is made durable like a reservation
+*                   and the token goes back to the free token bitmap at once.
+*
+*  \return          ACK                    The token is free now.
+*
+*  \return          NOT_OWNER              Not held by owner.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int db_release(tok_db_t *db, uint32_t token, pid_t owner);
+
+/*
+*******************************************************************************
+*   db_renew_many
+*******************************************************************************
+*
+*  \brief           <b> db_renew_many </b>\n
+*                   Moves the aq_time of the tokens held by entry.owner, whose
+*                   DB_ENTRY_TTL has not passed, to entry.aq_time. Renewals are
+*                   written to the backend and the journal but never waited
+*                   for: a crash can only lose renewals, making leases end at
+*                   their previous time.
+*
+*  \param[out]      uint8_t *results       For every token ACK or NOT_OWNER.
+*
+*  \return          Number of tokens renewed.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+unsigned int db_renew_many(tok_db_t *db, const uint32_t *tokens, unsigned int tokens_no,
+        db_entry_t entry, uint8_t *results);
+
+/*
+*******************************************************************************
+*   db_count_free
+*******************************************************************************
+*
+*  \brief           <b> db_count_free </b>\n
+*                   Counts the clear bits of the free token bitmap.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+unsigned int db_count_free(tok_db_t *db);
+
+/*
+*******************************************************************************
+*   db_query_owner
+*******************************************************************************
+*
+*  \brief           <b> db_query_owner </b>\n
+*                   Finds the tokens owner holds through the owner index,
+*                   after bringing it up to date with the changes and the
+*                   expiries the expirer did not index yet. Costs the tokens
+*                   owner holds, not the size of the database. Changes made
+*                   while it runs may or may not be seen.
+*
+*  \param[in]       pid_t owner            0 only fills occupancy.
+*
+*  \param[in]       uint32_t token_min     Lowest token to return, to
+*                                          page through many.
+*
+*  \param[out]      uint32_t *tokens       The lowest tokens_max tokens
+*                                          held from token_min on, in
+*                                          increasing order.
+*
+*  \param[out]      db_occupancy_t *occupancy  Counts of the whole database.
+*
+*  \return          Number of tokens written.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+unsigned int db_query_owner(tok_db_t *db, pid_t owner, uint32_t token_min,
+        uint32_t *tokens, unsigned int tokens_max, db_occupancy_t *occupancy);
+
+/*
+*******************************************************************************
+*   db_close
+*******************************************************************************
+*
+*  \brief           <b> db_close </b>\n
+*                   Stops the expirer and the flusher, flushes outstanding
+*                   changes and releases the file.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int db_close(tok_db_t *db);
+
+/*
+*******************************************************************************
+*   db_detach
+*******************************************************************************
+*
+*  \brief           <b> db_detach </b>\n
+*                   Like db_close, but first copies the tokens in use to a
+*                   state image in a memory file, for db_attach. Nothing
+*                   may use db any more, the image is taken once.
+*
+*  \param[out]      int *state_fd          The image.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int db_detach(tok_db_t *db, int *state_fd);
+
+/*
+*******************************************************************************
+*   db_print_stats
+*******************************************************************************
+*
+*  \brief           <b> db_print_stats </b>\n
+*                   Prints the expiry statistics and those of the flush
+*                   policy, if it keeps any.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void db_print_stats(tok_db_t *db, FILE *out);
+
+/*
+*******************************************************************************
+*   db_parse_backend / db_parse_flush
+*******************************************************************************
+*
+*  \brief           <b> db_parse_backend / db_parse_flush </b>\n
+*                   Convert command line names ("file", "mmap", "memory" and
+*                   "each", "periodic", "none", "group", "dsync") to the enums.
+*
+*  \return          0 on success, -1 if name is not known.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int db_parse_backend(const char *name, DB_BACKEND *backend);
+int db_parse_flush(const char *name, DB_FLUSH *flush);
+
+#endif /* TOK_DB_H */
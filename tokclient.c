@@ -0,0 +1,583 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file tokclient.c
+*
+* \brief Implements the client library declared in tokclient.h. A reply is
+*        matched to its request only by pid and req_id, so replies can come
+*        back in any order and from any shard.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdlib.h>         /* For exit() */
+#include <string.h>
+#include <endian.h>
+#include <fcntl.h>          /* For O_* constants */
+#include <sys/stat.h>       /* For mode constants */
+#include <unistd.h>         /* For getpid() */
+#include "utils.h"
+#include "tokclient.h"
+
+static mqd_t get_server_mq(const tok_session_t *session, uint32_t token);
+static uint64_t take_slot(tok_session_t *session, int req_type);
+static bool send_msg(tok_session_t *session, mqd_t server_mq, const void *msg, size_t len);
+static bool finish(tok_session_t *session, uint64_t req_id, int resp_type,
+        tok_completion_t *completion);
+static uint64_t submit(tok_session_t *session, int req_type, uint32_t token,
+        const void *msg, size_t len);
+static uint64_t submit_record(tok_session_t *session, int req_type, uint32_t token,
+        uint32_t token_max);
+static uint64_t submit_one(tok_session_t *session, int req_type, uint32_t token,
+        uint32_t token_max);
+static bool complete(tok_session_t *session, ssize_t len, tok_completion_t *completion);
+static bool complete_record(tok_session_t *session, tok_completion_t *completion);
+static int receive(tok_session_t *session, tok_completion_t *completion,
+        const struct timespec *deadline);
+static void say_hello(tok_session_t *session);
+
+static mqd_t get_server_mq(const tok_session_t *session, uint32_t token)
+{
+    if (0 == session->shards_no)
+    {
+        return session->server_mqs[0];
+    }
+    return session->server_mqs[get_token_shard(token, session->shards_no)];
+}
+
+/* Takes the slot of the next req_id, 0 with errno EAGAIN if it is taken. */
+static uint64_t take_slot(tok_session_t *session, int req_type)
+{
+    uint64_t req_id = session->next_req_id;
+    tok_inflight_t *slot = &session->inflight[req_id % TOK_INFLIGHT_MAX];
+
+    if (slot->req_id != 0)
+    {
+        errno = EAGAIN;
+        return 0;
+    }
+    slot->req_id = req_id;
+    slot->req_type = req_type;
+    session->inflight_no++;
+    session->next_req_id++;
+    return req_id;
+}
+
+/* False, sending nothing, while TOK_MSGS_MAX messages wait for a reply. */
+static bool send_msg(tok_session_t *session, mqd_t server_mq, const void *msg, size_t len)
+{
+    if (session->msgs_no >= TOK_MSGS_MAX)
+    {
+        return false;
+    }
+    int rc = mq_send(server_mq, msg, len, get_lane_prio(session->lane));
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    session->msgs_no++;
+    return true;
+}
+
+/* Frees the slot of req_id and fills the common part of completion. False
+ * if req_id is not in flight. */
+static bool finish(tok_session_t *session, uint64_t req_id, int resp_type,
+        tok_completion_t *completion)
+{
+    tok_inflight_t *slot = &session->inflight[req_id % TOK_INFLIGHT_MAX];
+
+    if (0 == req_id || slot->req_id != req_id)
+    {
+        return false;
+    }
+    completion->req_id = req_id;
+    completion->req_type = slot->req_type;
+    completion->resp_type = resp_type;
+    slot->req_id = 0;
+    session->inflight_no--;
+    return true;
+}
+
+/* Sends a request_msg_t family message, whose req_id the caller set to
+ * next_req_id, to the queue serving token. */
+static uint64_t submit(tok_session_t *session, int req_type, uint32_t token,
+        const void *msg, size_t len)
+{
+    if (session->inflight[session->next_req_id % TOK_INFLIGHT_MAX].req_id != 0 ||
+        !send_msg(session, get_server_mq(session, token), msg, len))
+    {
+        errno = EAGAIN;
+        return 0;
+    }
+    return take_slot(session, req_type);
+}
+
+/* Adds a request to the wire batch, sending the batch first if it is for
+ * another queue or full, and afterwards if it became full. */
+static uint64_t submit_record(tok_session_t *session, int req_type, uint32_t token,
+        uint32_t token_max)
+{
+    mqd_t server_mq = get_server_mq(session, token);
+    time_t req_time = time(NULL);
+
+    if (-1 == req_time)
+    {
+        handle_error();
+    }
+    if (session->batch_no > 0 &&
+        (session->batch_mq != server_mq || WIRE_BATCH_MAX == session->batch_no))
+    {
+        tok_flush(session);
+        if (session->batch_no > 0)
+        {
+            errno = EAGAIN;
+            return 0;
+        }
+    }
+    uint64_t req_id = take_slot(session, req_type);
+    if (0 == req_id)
+    {
+        return 0;
+    }
+    wire_request_t record = {
+        .req_type = req_type,
+        .lane = session->lane,
+        .token = htole32(token),
+        .token_max = htole32(token_max),
+        .req_time = htole64(req_time),
+        .req_id = htole64(req_id)
+    };
+    memcpy(session->batch + wire_request_len(session->batch_no), &record, sizeof(record));
+    session->batch_mq = server_mq;
+    session->batch_no++;
+    if (WIRE_BATCH_MAX == session->batch_no)
+    {
+        tok_flush(session);
+    }
+    return req_id;
+}
+
+/* A TOKEN, TOKEN_ANY or RELEASE request, in the format agreed on. */
+static uint64_t submit_one(tok_session_t *session, int req_type, uint32_t token,
+        uint32_t token_max)
+{
+    if (session->wire_version > 0)
+    {
+        return submit_record(session, req_type, token, token_max);
+    }
+    time_t req_time = time(NULL);
+    if (-1 == req_time)
+    {
+        handle_error();
+    }
+    if (TOKEN_ANY == req_type)
+    {
+        any_request_msg_t request = {0};
+        request.req_type = TOKEN_ANY;
+        request.pid = session->pid;
+        request.req_time = req_time;
+        request.pseudo_port = session->pseudo_port;
+        request.lane = session->lane;
+        request.token_min = token;
+        request.token_max = token_max;
+        request.req_id = session->next_req_id;
+        return submit(session, req_type, token, &request, sizeof(request));
+    }
+    request_msg_t request = {0};
+    request.req_type = req_type;
+    request.token_requested = token;
+    request.pid = session->pid;
+    request.pseudo_port = session->pseudo_port;
+    request.lane = session->lane;
+    request.req_time = req_time;
+    request.req_id = session->next_req_id;
+    return submit(session, req_type, token, &request, sizeof(request));
+}
+
+/* Fills completion from the request_msg_t family reply of len bytes in
+ * session->reply. False if it is malformed or matches no request in flight. */
+static bool complete(tok_session_t *session, ssize_t len, tok_completion_t *completion)
+{
+    const response_msg_t *response = &session->reply.response;
+    const bulk_response_msg_t *bulk = &session->reply.bulk;
+    const query_response_msg_t *query = &session->reply.query;
+
+    if ((size_t)len < sizeof(int))
+    {
+        return false;
+    }
+    memset(completion, 0, sizeof(*completion));
+    if (BULK_RESULT == response->resp_type)
+    {
+        if ((size_t)len < offsetof(bulk_response_msg_t, results) ||
+            bulk->tokens_no > BULK_MAX_TOK ||
+            (size_t)len != bulk_response_len(bulk->tokens_no) ||
+            bulk->pid != session->pid)
+        {
+            return false;
+        }
+        completion->tokens_no = bulk->tokens_no;
+        completion->reserved_no = bulk->reserved_no;
+        completion->results = bulk->results;
+        if (!finish(session, bulk->req_id, BULK_RESULT, completion))
+        {
+            return false;
+        }
+        session->msgs_no--;
+        return true;
+    }
+    if (QUERY_RESULT == response->resp_type)
+    {
+        if ((size_t)len < offsetof(query_response_msg_t, tokens) ||
+            query->tokens_no > QUERY_MAX_TOK ||
+            (size_t)len != query_response_len(query->tokens_no) ||
+            query->pid != session->pid)
+        {
+            return false;
+        }
+        completion->tokens_no = query->tokens_no;
+        completion->query = query;
+        if (!finish(session, query->req_id, QUERY_RESULT, completion))
+        {
+            return false;
+        }
+        session->msgs_no--;
+        return true;
+    }
+    if ((size_t)len != sizeof(*response) || response->pid != session->pid)
+    {
+        return false;
+    }
+    completion->token = response->token_requested;
+    if (!finish(session, response->req_id, response->resp_type, completion))
+    {
+        return false;
+    }
+    session->msgs_no--;
+    return true;
+}
+
+/* Takes the next record of the wire reply in session->reply. */
+static bool complete_record(tok_session_t *session, tok_completion_t *completion)
+{
+    wire_response_t record;
+
+    memcpy(&record, session->reply.buf + wire_response_len(session->replies_next),
+            sizeof(record));
+    session->replies_next++;
+    memset(completion, 0, sizeof(*completion));
+    completion->token = le32toh(record.token);
+    return finish(session, le64toh(record.req_id), record.resp_type, completion);
+}
+
+/* Reads replies until one completes a request in flight. A NULL deadline
+ * waits forever. */
+static int receive(tok_session_t *session, tok_completion_t *completion,
+        const struct timespec *deadline)
+{
+    wire_header_t header;
+    ssize_t len;
+
+    while (session->inflight_no > 0)
+    {
+        /* Sent as soon as a reply makes room for it. */
+        tok_flush(session);
+        if (session->replies_next < session->replies_no)
+        {
+            if (complete_record(session, completion))
+            {
+                return 1;
+            }
+            session->discarded++;
+            continue;
+        }
+        if (NULL == deadline)
+        {
+            len = mq_receive(session->reply_mq, session->reply.buf,
+                    sizeof(session->reply.buf), NULL);
+        }
+        else
+        {
+            len = mq_timedreceive(session->reply_mq, session->reply.buf,
+                    sizeof(session->reply.buf), NULL, deadline);
+        }
+        if (-1 == len)
+        {
+            if (ETIMEDOUT == errno)
+            {
+                return 0;
+            }
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            handle_error();
+        }
+        if (wire_get_header(session->reply.buf, len, sizeof(wire_response_t), &header))
+        {
+            if (header.pid == session->pid)
+            {
+                session->msgs_no--;
+                session->replies_no = header.count;
+                session->replies_next = 0;
+                continue;
+            }
+        }
+        else if (complete(session, len, completion))
+        {
+            return 1;
+        }
+        session->discarded++;
+    }
+    return 0;
+}
+
+/* Agrees on the wire format. A server without it does not answer HELLO. */
+static void say_hello(tok_session_t *session)
+{
+    request_msg_t request = {0};
+    tok_completion_t completion;
+
+    request.req_type = HELLO;
+    request.token_requested = WIRE_VERSION;
+    request.pid = session->pid;
+    request.pseudo_port = session->pseudo_port;
+    request.req_time = time(NULL);
+    request.req_id = session->next_req_id;
+    if (-1 == request.req_time)
+    {
+        handle_error();
+    }
+    uint64_t req_id = submit(session, HELLO, 0, &request, sizeof(request));
+    if (tok_wait(session, &completion, TOK_HELLO_TIMEOUT_MS) &&
+        ACK == completion.resp_type)
+    {
+        session->wire_version = completion.token;
+        return;
+    }
+    /* A late answer will be discarded. */
+    session->inflight[req_id % TOK_INFLIGHT_MAX].req_id = 0;
+    session->inflight_no--;
+    session->msgs_no--;
+}
+
+int tok_session_open(tok_session_t *session, uint8_t pseudo_port, unsigned int flags)
+{
+    struct mq_attr qattr = {0};
+    qattr.mq_maxmsg = MQ_MAXMSG;
+    qattr.mq_msgsize = MQ_MSGSIZE;
+    char server_mq_name[MAX_MQUEUE_NAME];
+    unsigned int queues_no;
+    int rc;
+
+    memset(session, 0, sizeof(*session));
+    session->pid = getpid();
+    session->pseudo_port = pseudo_port;
+    session->next_req_id = 1;
+    session->next_batch_id = 1;
+    session->shards_no = get_shards_no();
+    queues_no = session->shards_no > 0 ? session->shards_no : 1;
+
+    for (unsigned int i = 0; i < queues_no; i++)
+    {
+        /* The first token of shard i routes to it. */
+        uint32_t token = i * SHARD_BLOCK_TOK;
+        rc = get_request_mq_name(server_mq_name, sizeof(server_mq_name), token, session->shards_no);
+        if (rc < 0 || (unsigned int)rc > sizeof(server_mq_name))
+        {
+            handle_error();
+        }
+        session->server_mqs[i] = mq_open(server_mq_name, O_WRONLY);
+        if (-1 == session->server_mqs[i])
+        {
+            int err = errno;
+            while (i-- > 0)
+            {
+                mq_close(session->server_mqs[i]);
+            }
+            if (err != ENOENT)
+            {
+                handle_error_en(err);
+            }
+            errno = err;
+            return -1;
+        }
+    }
+
+    rc = get_client_mq_name(session->reply_mq_name, sizeof(session->reply_mq_name), pseudo_port);
+    if (rc < 0 || (unsigned int)rc > sizeof(session->reply_mq_name))
+    {
+        handle_error();
+    }
+    /* A fresh queue, without replies meant for a previous client. */
+    rc = mq_unlink(session->reply_mq_name);
+    if (-1 == rc && errno != ENOENT)
+    {
+        handle_error();
+    }
+    session->reply_mq = mq_open(session->reply_mq_name, O_RDONLY | O_CREAT, MQ_MODE, &qattr);
+    if (-1 == session->reply_mq)
+    {
+        handle_error();
+    }
+    if (!(flags & TOK_LEGACY_WIRE))
+    {
+        say_hello(session);
+    }
+    return 0;
+}
+
+void tok_session_close(tok_session_t *session)
+{
+    unsigned int queues_no = session->shards_no > 0 ? session->shards_no : 1;
+    int rc;
+
+    for (unsigned int i = 0; i < queues_no; i++)
+    {
+        rc = mq_close(session->server_mqs[i]);
+        if (-1 == rc)
+        {
+            handle_error();
+        }
+    }
+    rc = mq_close(session->reply_mq);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    rc = mq_unlink(session->reply_mq_name);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+}
+
+uint64_t tok_submit_token(tok_session_t *session, uint32_t token)
+{
+    return submit_one(session, TOKEN, token, 0);
+}
+
+uint64_t tok_submit_any(tok_session_t *session, uint32_t token_min, uint32_t token_max)
+{
+    return submit_one(session, TOKEN_ANY, token_min, token_max);
+}
+
+uint64_t tok_submit_release(tok_session_t *session, uint32_t token)
+{
+    return submit_one(session, RELEASE, token, 0);
+}
+
+uint64_t tok_submit_bulk(tok_session_t *session, int req_type, uint32_t first_token,
+        uint16_t tokens_no, uint8_t flags)
+{
+    bulk_request_msg_t request = {0};
+
+    tok_flush(session);
+    request.req_type = req_type;
+    request.pid = session->pid;
+    request.req_time = time(NULL);
+    request.pseudo_port = session->pseudo_port;
+    request.flags = flags | BULK_RANGE;
+    request.tokens_no = tokens_no;
+    request.lane = session->lane;
+    request.req_id = session->next_req_id;
+    request.tokens[0] = first_token;
+    if (-1 == request.req_time)
+    {
+        handle_error();
+    }
+    return submit(session, req_type, first_token, &request,
+            bulk_request_len(tokens_no, request.flags));
+}
+
+uint64_t tok_submit_query(tok_session_t *session, pid_t owner, uint32_t token_min)
+{
+    query_request_msg_t request = {0};
+
+    tok_flush(session);
+    request.req_type = QUERY;
+    request.pid = session->pid;
+    request.req_time = time(NULL);
+    request.pseudo_port = session->pseudo_port;
+    request.lane = session->lane;
+    request.owner = owner;
+    request.token_min = token_min;
+    request.req_id = session->next_req_id;
+    if (-1 == request.req_time)
+    {
+        handle_error();
+    }
+    /* Every queue answers for every shard. */
+    return submit(session, QUERY, 0, &request, sizeof(request));
+}
+
+int tok_session_set_lane(tok_session_t *session, LANE lane)
+{
+    /* The gathered requests keep the lane they were submitted in. */
+    tok_flush(session);
+    if (session->batch_no > 0)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+    session->lane = lane < LANES_NO ? lane : LANE_NORMAL;
+    return 0;
+}
+
+void tok_flush(tok_session_t *session)
+{
+    if (0 == session->batch_no)
+    {
+        return;
+    }
+    wire_put_header(session->batch, session->batch_no, session->pid,
+            session->pseudo_port, session->next_batch_id);
+    if (!send_msg(session, session->batch_mq, session->batch,
+                wire_request_len(session->batch_no)))
+    {
+        return;
+    }
+    session->next_batch_id++;
+    session->batch_no = 0;
+}
+
+int tok_poll(tok_session_t *session, tok_completion_t *completion)
+{
+    /* Long past, so only a reply already queued is taken. */
+    struct timespec deadline = {0};
+
+    tok_flush(session);
+    return receive(session, completion, &deadline);
+}
+
+int tok_wait(tok_session_t *session, tok_completion_t *completion, int timeout_ms)
+{
+    struct timespec deadline;
+
+    tok_flush(session);
+    if (timeout_ms < 0)
+    {
+        return receive(session, completion, NULL);
+    }
+    int rc = clock_gettime(CLOCK_REALTIME, &deadline);
+    if (-1 == rc)
+    {
+        handle_error();
+    }
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return receive(session, completion, &deadline);
+}
+
+unsigned int tok_inflight_no(const tok_session_t *session)
+{
+    return session->inflight_no;
+}
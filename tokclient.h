@@ -0,0 +1,302 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file tokclient.h
+*
+* \brief Client side of the token server, built as libtokclient.a. A session
+*        keeps its reply queue and the server's request queues open and
+*        lets a client have up to TOK_INFLIGHT_MAX requests in flight:
+*        requests are submitted without waiting, each tagged with a req_id
+*        the server echoes back, and their completions are collected later
+*        with tok_poll or tok_wait, in whatever order the server answered.
+*        When the server speaks the compact wire format (see wire_header_t)
+*        TOKEN, TOKEN_ANY and RELEASE requests are gathered and sent up to
+*        WIRE_BATCH_MAX in one message, and answered the same way. A
+*        session sends in one LANE, LANE_NORMAL unless set otherwise.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef TOKCLIENT_H
+#define TOKCLIENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <mqueue.h>
+#include <sys/types.h>  /* For pid_t */
+#include "constants.h"
+#include "common.h"
+
+#define TOK_INFLIGHT_MAX 64 /**< Requests of one session waiting for a reply. */
+#define TOK_MSGS_MAX MQ_MAXMSG     /**< Messages of one session waiting for a
+                                        reply. No more fit in its reply queue,
+                                        the server would block answering. */
+#define TOK_HELLO_TIMEOUT_MS 1000   /**< Before falling back to request_msg_t. */
+#define TOK_LEGACY_WIRE 0x01        /**< tok_session_open flag, skips HELLO. */
+
+/*
+*******************************************************************************
+*   tok_session_t
+*******************************************************************************
+*
+*  \brief           <b> tok_session_t </b>\n
+*                   One client's connection to the server. Treat the members
+*                   as private. Only one thread may use a session at a time.
+*
+*  \var             inflight                          req_type of the request
+*                                                     in flight with req_id,
+*                                                     at req_id %
+*                                                     TOK_INFLIGHT_MAX.
+*
+*  \var             discarded                         Replies matching no
+*                                                     request in flight.
+*
+*  \var             batch                             Wire requests not sent
+*                                                     yet, batch_no of them
+*                                                     for batch_mq.
+*
+*  \var             reply                             The last message
+*                                                     received. For a wire
+*                                                     one, the records from
+*                                                     replies_next on are not
+*                                                     taken yet.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    uint64_t req_id;        /**< 0 when the slot is free. */
+    int req_type;
+} tok_inflight_t;
+
+typedef struct {
+    pid_t pid;
+    uint8_t pseudo_port;
+    char reply_mq_name[MAX_MQUEUE_NAME];
+    mqd_t reply_mq;
+    mqd_t server_mqs[SHARDS_MAX];
+    unsigned int shards_no;
+    uint64_t next_req_id;
+    unsigned int inflight_no;
+    tok_inflight_t inflight[TOK_INFLIGHT_MAX];
+    uint64_t discarded;
+    unsigned int msgs_no;   /**< Sent and not answered, see TOK_MSGS_MAX. */
+    uint8_t wire_version;   /**< Agreed with HELLO, 0 for request_msg_t. */
+    uint8_t lane;           /**< From enum LANE, of every request sent. */
+    uint64_t next_batch_id;
+    mqd_t batch_mq;
+    uint16_t batch_no;
+    char batch[sizeof(wire_header_t) + WIRE_BATCH_MAX * sizeof(wire_request_t)];
+    uint16_t replies_no;
+    uint16_t replies_next;
+    union {
+        char buf[MQ_MSGSIZE + 1];
+        response_msg_t response;
+        bulk_response_msg_t bulk;
+        query_response_msg_t query;
+    } reply;                /**< The last reply received. */
+} tok_session_t;
+
+/*
+*******************************************************************************
+*   tok_completion_t
+*******************************************************************************
+*
+*  \brief           <b> tok_completion_t </b>\n
+*                   The reply to one submitted request.
+*
+*  \var             resp_type                         From RESP_TYPE,
+*                                                     BULK_RESULT for
+*                                                     TOKEN_BULK and RENEW,
+*                                                     QUERY_RESULT for
+*                                                     QUERY.
+*
+*  \var             token                             The token, for TOKEN,
+*                                                     TOKEN_ANY and RELEASE.
+*
+*  \var             results                           tokens_no results, for
+*                                                     TOKEN_BULK and RENEW.
+*                                                     Points into the session,
+*                                                     valid until its next
+*                                                     tok_poll or tok_wait.
+*
+*  \var             query                             The answer to QUERY,
+*                                                     valid as long as
+*                                                     results.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    uint64_t req_id;
+    int req_type;
+    int resp_type;
+    uint32_t token;
+    uint16_t tokens_no;
+    uint16_t reserved_no;
+    const bulk_result_t *results;
+    const query_response_msg_t *query;
+} tok_completion_t;
+
+/*
+*******************************************************************************
+*   tok_session_open / tok_session_close
+*******************************************************************************
+*
+*  \brief           <b> tok_session_open / tok_session_close </b>\n
+*                   Creates the reply queue of pseudo_port and opens the
+*                   request queues of the running server, one per shard,
+*                   then sends HELLO to agree on the wire format, waiting up
+*                   to TOK_HELLO_TIMEOUT_MS for the answer. Closing drops
+*                   the requests still in flight and removes the reply
+*                   queue.
+*
+*  \param[in]       unsigned int flags     TOK_LEGACY_WIRE or 0.
+*
+*  \return          0                      Success.
+*
+*  \return          -1                     errno ENOENT, no server is
+*                                          running. Other errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int tok_session_open(tok_session_t *session, uint8_t pseudo_port, unsigned int flags);
+void tok_session_close(tok_session_t *session);
+
+/*
+*******************************************************************************
+*   tok_session_set_lane
+*******************************************************************************
+*
+*  \brief           <b> tok_session_set_lane </b>\n
+*                   Sends the requests submitted from now on in lane, with
+*                   its mq priority. The requests gathered are sent first.
+*
+*  \return          0                      Success.
+*
+*  \return          -1                     errno EAGAIN, the gathered
+*                                          requests could not be sent:
+*                                          collect a completion first.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int tok_session_set_lane(tok_session_t *session, LANE lane);
+
+/*
+*******************************************************************************
+*   tok_submit_token / tok_submit_any / tok_submit_release / tok_submit_bulk
+*******************************************************************************
+*
+*  \brief           <b> tok_submit_* </b>\n
+*                   Send a TOKEN, TOKEN_ANY, RELEASE, or TOKEN_BULK / RENEW
+*                   request without waiting for the reply. Bulk requests
+*                   are for the tokens_no tokens from first_token. With the
+*                   wire format the others wait in the session until a
+*                   batch is full, tok_flush, tok_poll or tok_wait.
+*
+*  \param[in]       int req_type           TOKEN_BULK or RENEW.
+*
+*  \param[in]       uint8_t flags          BULK_ALL_OR_NOTHING or 0.
+*
+*  \return          The req_id of the request, never 0.
+*
+*  \return          0                      errno EAGAIN, the slot of the
+*                                          next req_id is still taken or
+*                                          TOK_MSGS_MAX messages wait for
+*                                          an answer: collect a completion
+*                                          first.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+uint64_t tok_submit_token(tok_session_t *session, uint32_t token);
+uint64_t tok_submit_any(tok_session_t *session, uint32_t token_min, uint32_t token_max);
+uint64_t tok_submit_release(tok_session_t *session, uint32_t token);
+uint64_t tok_submit_bulk(tok_session_t *session, int req_type, uint32_t first_token,
+        uint16_t tokens_no, uint8_t flags);
+
+/*
+*******************************************************************************
+*   tok_submit_query
+*******************************************************************************
+*
+*  \brief           <b> tok_submit_query </b>\n
+*                   Asks which tokens owner holds, from token_min on, and
+*                   how many are held overall. The answer lists at most
+*                   QUERY_MAX_TOK tokens: ask again from one past the last
+*                   one for the rest.
+*
+*  \param[in]       pid_t owner            Any pid, 0 only asks for the
+*                                          counts.
+*
+*  \return          Like tok_submit_token.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+uint64_t tok_submit_query(tok_session_t *session, pid_t owner, uint32_t token_min);
+
+/*
+*******************************************************************************
+*   tok_flush
+*******************************************************************************
+*
+*  \brief           <b> tok_flush </b>\n
+*                   Sends the requests gathered in the session, if any,
+*                   unless TOK_MSGS_MAX messages already wait for an answer;
+*                   tok_poll and tok_wait try again.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void tok_flush(tok_session_t *session);
+
+/*
+*******************************************************************************
+*   tok_poll / tok_wait
+*******************************************************************************
+*
+*  \brief           <b> tok_poll / tok_wait </b>\n
+*                   Flush, then collect the completion of one request in
+*                   flight. tok_poll only takes a reply already queued,
+*                   tok_wait waits for one.
+*
+*  \param[in]       int timeout_ms         Negative waits forever.
+*
+*  \return          1                      completion is filled.
+*
+*  \return          0                      No reply, or nothing in flight.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int tok_poll(tok_session_t *session, tok_completion_t *completion);
+int tok_wait(tok_session_t *session, tok_completion_t *completion, int timeout_ms);
+
+/*
+*******************************************************************************
+*   tok_inflight_no
+*******************************************************************************
+*
+*  \brief           <b> tok_inflight_no </b>\n
+*                   Requests submitted and not completed yet.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+unsigned int tok_inflight_no(const tok_session_t *session);
+
+#endif /* TOKCLIENT_H */
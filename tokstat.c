@@ -0,0 +1,270 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file tokstat.c
+*
+* \brief Prints the metrics of a running server. Attaches read only to the
+*        shared memory segment of metrics.h and, every interval, prints one
+*        line with the request and response rates, the requests in flight,
+*        the depth of MQ_REQ_NAME, the queue wait and service latency
+*        percentiles of that interval and the p99 of each lane.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>         /* For exit() */
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>         /* For kill() */
+#include <fcntl.h>          /* For O_* constants */
+#include <unistd.h>
+#include <mqueue.h>
+#include <limits.h>
+#include "utils.h"
+#include "constants.h"
+#include "common.h"
+#include "metrics.h"
+
+#define TOKSTAT_HEADER_EVERY 20 /**< Lines between two headers. */
+
+/*
+*******************************************************************************
+*   tokstat_snap_t
+*******************************************************************************
+*
+*  \brief           <b> tokstat_snap_t </b>\n
+*                   Everything read from the segment at one moment.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct {
+    uint64_t at_ns;
+    uint64_t counters[METRIC_COUNTERS_NO];
+    hist_t hists[METRIC_HISTS_NO];
+} tokstat_snap_t;
+
+static void take_snap(const metrics_t *metrics, tokstat_snap_t *snap);
+static void hist_delta(const hist_t *now, const hist_t *before, hist_t *out);
+static long get_queue_depth(mqd_t server_mq);
+static void print_header(void);
+static void print_line(const tokstat_snap_t *now, const tokstat_snap_t *before,
+        mqd_t server_mq);
+static bool is_alive(pid_t pid);
+static const metrics_t *attach_successor(const metrics_t *metrics);
+static unsigned int parse_count_arg(const char *arg, char opt);
+static void print_usage(const char *prog);
+
+static void take_snap(const metrics_t *metrics, tokstat_snap_t *snap)
+{
+    snap->at_ns = get_monotonic_ns();
+    for (unsigned int i = 0; i < METRIC_COUNTERS_NO; i++)
+    {
+        snap->counters[i] = metrics_sum(metrics, i);
+    }
+    for (unsigned int i = 0; i < METRIC_HISTS_NO; i++)
+    {
+        metrics_hist(metrics, i, &snap->hists[i]);
+    }
+}
+
+/* The values recorded between two snapshots. max stays the one since start. */
+static void hist_delta(const hist_t *now, const hist_t *before, hist_t *out)
+{
+    for (unsigned int i = 0; i < HIST_BUCKETS_NO; i++)
+    {
+        out->counts[i] = now->counts[i] - before->counts[i];
+    }
+    out->total = now->total - before->total;
+    out->sum = now->sum - before->sum;
+    out->max = atomic_load(&now->max);
+}
+
+static long get_queue_depth(mqd_t server_mq)
+{
+    struct mq_attr attr;
+
+    if ((mqd_t)-1 == server_mq || -1 == mq_getattr(server_mq, &attr))
+    {
+        return -1;
+    }
+    return attr.mq_curmsgs;
+}
+
+static void print_header(void)
+{
+    printf("%8s %8s %8s %8s %8s %8s %6s %6s %6s %6s %9s %9s %9s %9s %9s %9s %9s %9s %9s\n",
+            "recv/s", "done/s", "ack/s", "n_av/s", "rb/s", "n_own/s", "bad/s",
+            "tmo/s", "busy/s", "infl", "queue", "wait_p50", "wait_p99", "svc_p50",
+            "svc_p99", "svc_max", "int_p99", "nrm_p99", "bat_p99");
+}
+
+static void print_line(const tokstat_snap_t *now, const tokstat_snap_t *before,
+        mqd_t server_mq)
+{
+    static hist_t s_wait;
+    static hist_t s_service;
+    static hist_t s_lanes[LANES_NO];
+    double seconds = (now->at_ns - before->at_ns) / 1e9;
+    double rates[METRIC_COUNTERS_NO];
+    char queue[48];
+
+    for (unsigned int i = 0; i < METRIC_COUNTERS_NO; i++)
+    {
+        rates[i] = (now->counters[i] - before->counters[i]) / seconds;
+    }
+    hist_delta(&now->hists[METRIC_QUEUE_WAIT], &before->hists[METRIC_QUEUE_WAIT], &s_wait);
+    hist_delta(&now->hists[METRIC_SERVICE], &before->hists[METRIC_SERVICE], &s_service);
+    for (unsigned int i = 0; i < LANES_NO; i++)
+    {
+        hist_delta(&now->hists[METRIC_LANE_NORMAL + i], &before->hists[METRIC_LANE_NORMAL + i],
+                &s_lanes[i]);
+    }
+    long depth = get_queue_depth(server_mq);
+    if (depth < 0)
+    {
+        snprintf(queue, sizeof(queue), "-");
+    }
+    else
+    {
+        snprintf(queue, sizeof(queue), "%ld/%d", depth, MQ_MAXMSG);
+    }
+    /* Latencies are printed in microseconds. */
+    printf("%8.0f %8.0f %8.0f %8.0f %8.0f %8.0f %6.0f %6.0f %6.0f %6llu %9s %9.1f %9.1f %9.1f %9.1f %9.1f"
+            " %9.1f %9.1f %9.1f\n",
+            rates[METRIC_RECEIVED], rates[METRIC_DONE], rates[METRIC_ACK],
+            rates[METRIC_NOT_AVAILABLE], rates[METRIC_ROLLED_BACK],
+            rates[METRIC_NOT_OWNER], rates[METRIC_BAD_REQUESTS],
+            rates[METRIC_SEND_TIMEOUTS], rates[METRIC_BUSY],
+            (unsigned long long)(now->counters[METRIC_RECEIVED] - now->counters[METRIC_DONE]),
+            queue,
+            hist_percentile(&s_wait, 0.5) / 1e3, hist_percentile(&s_wait, 0.99) / 1e3,
+            hist_percentile(&s_service, 0.5) / 1e3, hist_percentile(&s_service, 0.99) / 1e3,
+            s_service.max / 1e3, hist_percentile(&s_lanes[LANE_INTERACTIVE], 0.99) / 1e3,
+            hist_percentile(&s_lanes[LANE_NORMAL], 0.99) / 1e3,
+            hist_percentile(&s_lanes[LANE_BATCH], 0.99) / 1e3);
+    fflush(stdout);
+}
+
+static bool is_alive(pid_t pid)
+{
+    return !(-1 == kill(pid, 0) && ESRCH == errno);
+}
+
+/* After a hot restart the old server exits and its successor serves under
+ * a segment of its own. Returns it, NULL if no other server is running. */
+static const metrics_t *attach_successor(const metrics_t *metrics)
+{
+    const metrics_t *successor = metrics_attach();
+
+    if (NULL == successor)
+    {
+        return NULL;
+    }
+    if (successor->server_pid == metrics->server_pid || !is_alive(successor->server_pid))
+    {
+        metrics_detach(successor);
+        return NULL;
+    }
+    return successor;
+}
+
+static unsigned int parse_count_arg(const char *arg, char opt)
+{
+    char *end = NULL;
+    errno = 0;
+    unsigned long val = strtoul(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || 0 == val || val > UINT_MAX)
+    {
+        fprintf(stderr, "Invalid value \"%s\" for -%c\n", arg, opt);
+        exit(1);
+    }
+    return (unsigned int)val;
+}
+
+static void print_usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-i seconds] [-n lines]\n"
+            "  -i  seconds between two lines (default 1)\n"
+            "  -n  stop after this many lines (default until the server exits,\n"
+            "      following a successor taking over with -u)\n",
+            prog);
+}
+
+int main(int argc, char *argv[])
+{
+    static tokstat_snap_t s_snaps[2];
+    unsigned int interval = 1;
+    unsigned int lines_no = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'i':
+                interval = parse_count_arg(optarg, opt);
+            break;
+            case 'n':
+                lines_no = parse_count_arg(optarg, opt);
+            break;
+            default:
+                print_usage(argv[0]);
+                exit(1);
+        }
+    }
+
+    const metrics_t *metrics = metrics_attach();
+    if (NULL == metrics)
+    {
+        fprintf(stderr, "No server metrics found in %s\n", METRICS_SHM_NAME);
+        exit(1);
+    }
+    /* Only for mq_getattr, opening it does not take any message. */
+    mqd_t server_mq = mq_open(MQ_REQ_NAME, O_RDONLY | O_NONBLOCK);
+
+    printf("Server pid %d, up %.0f s.\n", (int)metrics->server_pid,
+            (get_monotonic_ns() - metrics->start_ns) / 1e9);
+    take_snap(metrics, &s_snaps[0]);
+    for (unsigned int line = 0; 0 == lines_no || line < lines_no; line++)
+    {
+        tokstat_snap_t *before = &s_snaps[line % 2];
+        tokstat_snap_t *now = &s_snaps[(line + 1) % 2];
+
+        sleep(interval);
+        if (!is_alive(metrics->server_pid))
+        {
+            const metrics_t *successor = attach_successor(metrics);
+            if (NULL == successor)
+            {
+                printf("The server exited.\n");
+                break;
+            }
+            metrics_detach(metrics);
+            metrics = successor;
+            printf("Server pid %d took over.\n", (int)metrics->server_pid);
+            /* Its counters start from 0. */
+            take_snap(metrics, before);
+            sleep(interval);
+        }
+        if (0 == line % TOKSTAT_HEADER_EVERY)
+        {
+            print_header();
+        }
+        take_snap(metrics, now);
+        print_line(now, before, server_mq);
+    }
+
+    if (server_mq != (mqd_t)-1)
+    {
+        mq_close(server_mq);
+    }
+    metrics_detach(metrics);
+    return 0;
+}
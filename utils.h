@@ -8,6 +8,7 @@
 *
 * \version 1.0 6.01.2023 Mihnea SERBAN created
 * \version 1.1 23.01.2023 Mihnea SERBAN modified
+* \version 1.2 17.10.2026 Mihnea SERBAN modified
 *
 *//**************************** FILE HEADER *********************************/
 
@@ -32,4 +33,6 @@
 
 #define handle_error() do {handle_error_en(errno);} while(0)
 
+#define ARRAY_LEN(arr) (sizeof(arr) / sizeof((arr)[0]))
+
 #endif // UTILS_H
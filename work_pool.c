@@ -0,0 +1,357 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file work_pool.c
+*
+* \brief Implements the worker pool declared in work_pool.h. A round gives
+*        every lane with items as many turns as its weight, in the order
+*        of g_lane_order; a new round starts once the lanes with items have
+*        spent their credit.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+
+#include <stdlib.h>         /* For malloc() and exit() */
+#include <string.h>
+#include "work_pool.h"
+#include "utils.h"
+
+typedef struct {
+    work_pool_t *pool;
+    unsigned int index;
+} worker_arg_t;
+
+static work_lane_t *pick_lane(work_pool_t *pool);
+static void *worker_f(void *args);
+
+/* Called with the lock held and an item queued. */
+static work_lane_t *pick_lane(work_pool_t *pool)
+{
+    if (pool->starve_ns > 0 && !pool->starved_last)
+    {
+        uint64_t now = get_monotonic_ns();
+        for (unsigned int i = LANES_NO - 1; i > 0; i--)
+        {
+            work_lane_t *lane = &pool->lanes[g_lane_order[i]];
+            if (lane->count > 0 && now - lane->items[lane->head].received_ns > pool->starve_ns)
+            {
+                lane->starved++;
+                pool->starved_last = true;
+                return lane;
+            }
+        }
+    }
+    pool->starved_last = false;
+    for (;;)
+    {
+        for (unsigned int i = 0; i < LANES_NO; i++)
+        {
+            work_lane_t *lane = &pool->lanes[g_lane_order[i]];
+            if (lane->count > 0 && lane->credit > 0)
+            {
+                lane->credit--;
+                return lane;
+            }
+        }
+        /* Weights are above 0, the next round finds one. */
+        for (unsigned int i = 0; i < LANES_NO; i++)
+        {
+            pool->lanes[i].credit = pool->lanes[i].weight;
+        }
+    }
+}
+
+static void *worker_f(void *args)
+{
+    worker_arg_t *arg = args;
+    work_pool_t *pool = arg->pool;
+    worker_stats_t *stats = &pool->th_stats[arg->index];
+    work_item_t item;
+    int rc;
+
+    free(arg);
+    for (;;)
+    {
+        rc = pthread_mutex_lock(&pool->lock);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+        while (0 == pool->count && !pool->closing)
+        {
+            rc = pthread_cond_wait(&pool->not_empty, &pool->lock);
+            if (rc != 0)
+            {
+                handle_error_en(rc);
+            }
+        }
+        if (0 == pool->count)
+        {
+            /* Closing and nothing left to drain. */
+            rc = pthread_mutex_unlock(&pool->lock);
+            if (rc != 0)
+            {
+                handle_error_en(rc);
+            }
+            break;
+        }
+        work_lane_t *lane = pick_lane(pool);
+        item = lane->items[lane->head];
+        lane->head = (lane->head + 1) % pool->queue_len;
+        lane->count--;
+        pool->count--;
+        /* The submitters may wait for different lanes. */
+        rc = pthread_cond_broadcast(&pool->not_full);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+        rc = pthread_mutex_unlock(&pool->lock);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+
+        uint64_t start = get_monotonic_ns();
+        pool->handler(&item, pool->ctx);
+        stats->busy_ns += get_monotonic_ns() - start;
+        stats->jobs_done++;
+    }
+    return NULL;
+}
+
+int work_pool_init(work_pool_t *pool, unsigned int workers_no, unsigned int queue_len,
+        const unsigned int *weights, unsigned int starve_ms, work_handler_t handler,
+        void *ctx)
+{
+    int rc;
+
+    if (0 == workers_no || 0 == queue_len)
+    {
+        handle_error_en(EINVAL);
+    }
+    *pool = (work_pool_t){0};
+    pool->queue_len = queue_len;
+    pool->starve_ns = starve_ms * 1000000ull;
+    pool->workers_no = workers_no;
+    pool->handler = handler;
+    pool->ctx = ctx;
+    for (unsigned int i = 0; i < LANES_NO; i++)
+    {
+        if (0 == weights[i])
+        {
+            handle_error_en(EINVAL);
+        }
+        pool->lanes[i].weight = weights[i];
+        pool->lanes[i].credit = weights[i];
+        pool->lanes[i].items = calloc(queue_len, sizeof(*pool->lanes[i].items));
+        if (NULL == pool->lanes[i].items)
+        {
+            handle_error();
+        }
+    }
+    pool->th_ids = calloc(workers_no, sizeof(*pool->th_ids));
+    pool->th_stats = calloc(workers_no, sizeof(*pool->th_stats));
+    if (NULL == pool->th_ids || NULL == pool->th_stats)
+    {
+        handle_error();
+    }
+    rc = pthread_mutex_init(&pool->lock, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_cond_init(&pool->not_empty, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_cond_init(&pool->not_full, NULL);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    pool->start_ns = get_monotonic_ns();
+
+    for (unsigned int i = 0; i < workers_no; i++)
+    {
+        worker_arg_t *arg = malloc(sizeof(*arg));
+        if (NULL == arg)
+        {
+            handle_error();
+        }
+        arg->pool = pool;
+        arg->index = i;
+        rc = pthread_create(&pool->th_ids[i], NULL, worker_f, arg);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+    }
+    return 0;
+}
+
+int work_pool_submit(work_pool_t *pool, const work_item_t *item)
+{
+    work_lane_t *lane = &pool->lanes[item->lane < LANES_NO ? item->lane : LANE_NORMAL];
+    int rc;
+    int result = 0;
+
+    rc = pthread_mutex_lock(&pool->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    if (lane->count == pool->queue_len)
+    {
+        lane->full_waits++;
+    }
+    while (lane->count == pool->queue_len && !pool->closing)
+    {
+        rc = pthread_cond_wait(&pool->not_full, &pool->lock);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+    }
+    if (pool->closing)
+    {
+        result = -1;
+    }
+    else
+    {
+        lane->depth_sum += lane->count;
+        lane->items[(lane->head + lane->count) % pool->queue_len] = *item;
+        lane->count++;
+        pool->count++;
+        lane->submitted++;
+        if (lane->count > lane->max_depth)
+        {
+            lane->max_depth = lane->count;
+        }
+        rc = pthread_cond_signal(&pool->not_empty);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+    }
+    rc = pthread_mutex_unlock(&pool->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    return result;
+}
+
+unsigned int work_pool_depth(work_pool_t *pool)
+{
+    unsigned int depth;
+
+    int rc = pthread_mutex_lock(&pool->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    depth = pool->count;
+    rc = pthread_mutex_unlock(&pool->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    return depth;
+}
+
+int work_pool_shutdown(work_pool_t *pool)
+{
+    int rc;
+
+    rc = pthread_mutex_lock(&pool->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    pool->closing = true;
+    rc = pthread_cond_broadcast(&pool->not_empty);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_cond_broadcast(&pool->not_full);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    rc = pthread_mutex_unlock(&pool->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+
+    for (unsigned int i = 0; i < pool->workers_no; i++)
+    {
+        rc = pthread_join(pool->th_ids[i], NULL);
+        if (rc != 0)
+        {
+            handle_error_en(rc);
+        }
+    }
+    return 0;
+}
+
+void work_pool_destroy(work_pool_t *pool)
+{
+    pthread_cond_destroy(&pool->not_full);
+    pthread_cond_destroy(&pool->not_empty);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->th_stats);
+    free(pool->th_ids);
+    for (unsigned int i = 0; i < LANES_NO; i++)
+    {
+        free(pool->lanes[i].items);
+    }
+    *pool = (work_pool_t){0};
+}
+
+void work_pool_print_stats(work_pool_t *pool, FILE *out)
+{
+    work_lane_t lanes[LANES_NO];
+    unsigned int depth;
+    int rc;
+    uint64_t elapsed_ns = get_monotonic_ns() - pool->start_ns;
+
+    rc = pthread_mutex_lock(&pool->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+    memcpy(lanes, pool->lanes, sizeof(lanes));
+    depth = pool->count;
+    rc = pthread_mutex_unlock(&pool->lock);
+    if (rc != 0)
+    {
+        handle_error_en(rc);
+    }
+
+    fprintf(out, "Work queue: capacity %u per lane; depth %u\n", pool->queue_len, depth);
+    for (unsigned int i = 0; i < LANES_NO; i++)
+    {
+        const work_lane_t *lane = &lanes[g_lane_order[i]];
+        fprintf(out, "Lane %-11s: weight %u; depth %u; max depth %u; "
+                "mean depth at submit %.2f; submitted %llu; submits found it full %llu; "
+                "taken for starving %llu\n",
+                g_lane_names[g_lane_order[i]], lane->weight, lane->count, lane->max_depth,
+                lane->submitted ? (double)lane->depth_sum / lane->submitted : 0.0,
+                (unsigned long long)lane->submitted, (unsigned long long)lane->full_waits,
+                (unsigned long long)lane->starved);
+    }
+    for (unsigned int i = 0; i < pool->workers_no; i++)
+    {
+        const worker_stats_t *stats = &pool->th_stats[i];
+        fprintf(out, "Worker %2u: jobs %8llu; busy %5.1f%%\n", i,
+                (unsigned long long)stats->jobs_done,
+                elapsed_ns ? 100.0 * stats->busy_ns / elapsed_ns : 0.0);
+    }
+}
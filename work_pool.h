@@ -0,0 +1,304 @@
+/***************************** FILE HEADER *********************************/
+/*!
+* \file work_pool.h
+*
+* \brief Fixed pool of long-lived worker threads fed by bounded
+*        multi-producer multi-consumer work queues, one for each LANE. The
+*        workers take from the lanes by weighted round robin, and from a
+*        lower lane first once its oldest item waited past a limit.
+*
+* \author Mihnea SERBAN \n
+*
+* \version 1.0 17.10.2026 Mihnea SERBAN created
+*
+*//**************************** FILE HEADER *********************************/
+
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "common.h"
+
+/*
+*******************************************************************************
+*   work_item_t
+*******************************************************************************
+*
+*  \brief           <b> work_item_t </b>\n
+*                   One unit of work handed to the pool. It is copied into the
+*                   queue, so the caller may reuse its own instance right after
+*                   work_pool_submit returns.
+*
+*  \var             req_type                          Tells which member of
+*                                                     the union is valid, all
+*                                                     of them start with it.
+*
+*  \var             request                           A TOKEN or RELEASE
+*                                                     request.
+*
+*  \var             bulk                              A TOKEN_BULK or RENEW
+*                                                     request.
+*
+*  \var             any                               A TOKEN_ANY request.
+*
+*  \var             query                             A QUERY request.
+*
+*  \var             batch                             Requests received in
+*                                                     one wire message.
+*
+*  \var             received_ns                       When the request was
+*                                                     received, from
+*                                                     get_monotonic_ns.
+*
+*  \var             via_ring                          The request came over
+*                                                     the shared memory ring,
+*                                                     it is answered there.
+*
+*  \var             lane                              From enum LANE, the
+*                                                     queue it waits in.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct
+{
+    union
+    {
+        int req_type;
+        request_msg_t request;
+        bulk_request_msg_t bulk;
+        any_request_msg_t any;
+        query_request_msg_t query;
+        wire_batch_t batch;
+    };
+    uint64_t received_ns;
+    bool via_ring;
+    uint8_t lane;
+} work_item_t;
+
+typedef void (*work_handler_t)(const work_item_t *item, void *ctx);
+
+/*
+*******************************************************************************
+*   worker_stats_t
+*******************************************************************************
+*
+*  \brief           <b> worker_stats_t </b>\n
+*                   Counters kept by each worker. Only the owning worker writes
+*                   them.
+*
+*  \var             jobs_done                         Items handled.
+*
+*  \var             busy_ns                           Time spent inside the
+*                                                     handler.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct
+{
+    uint64_t jobs_done;
+    uint64_t busy_ns;
+} worker_stats_t;
+
+/*
+*******************************************************************************
+*   work_lane_t
+*******************************************************************************
+*
+*  \brief           <b> work_lane_t </b>\n
+*                   The queue of one lane, protected by the pool's lock.
+*
+*  \var             weight                            Items taken from it in
+*                                                     a round, while it has
+*                                                     any.
+*
+*  \var             credit                            Left of weight in the
+*                                                     current round.
+*
+*  \var             starved                           Items taken first
+*                                                     because they waited
+*                                                     past starve_ns.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct
+{
+    work_item_t *items;
+    unsigned int head;
+    unsigned int count;
+    unsigned int weight;
+    unsigned int credit;
+
+    /* Statistics. */
+    uint64_t submitted;
+    uint64_t depth_sum;
+    unsigned int max_depth;
+    uint64_t full_waits;
+    uint64_t starved;
+} work_lane_t;
+
+/*
+*******************************************************************************
+*   work_pool_t
+*******************************************************************************
+*
+*  \brief           <b> work_pool_t </b>\n
+*                   The pool. Treat the members as private, use the work_pool_*
+*                   functions instead.
+*
+*  \author          <Mihnea SERBAN>
+*
+*  \date            <17.10.2026>
+*******************************************************************************/
+typedef struct
+{
+    /* Bounded rings of pending items, queue_len in each lane. */
+    work_lane_t lanes[LANES_NO];
+    unsigned int queue_len;
+    unsigned int count;     /**< Over every lane. */
+    uint64_t starve_ns;
+    bool starved_last;      /**< The last item was taken for starving. */
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    bool closing;
+
+    /* Workers. */
+    unsigned int workers_no;
+    pthread_t *th_ids;
+    worker_stats_t *th_stats;
+    work_handler_t handler;
+    void *ctx;
+
+    uint64_t start_ns;
+} work_pool_t;
+
+/*
+*******************************************************************************
+*   work_pool_init
+*******************************************************************************
+*
+*  \brief           <b> work_pool_init </b>\n
+*                   Allocates the queues and starts workers_no threads that
+*                   call handler(item, ctx) for every submitted item.
+*
+*  \param[out]      work_pool_t *pool      Pool to initialize.
+*
+*  \param[in]       unsigned int workers_no Number of workers. Must be > 0.
+*
+*  \param[in]       unsigned int queue_len Capacity of the queue of each
+*                                          lane. Must be > 0.
+*
+*  \param[in]       const unsigned int *weights  LANES_NO weights, by LANE.
+*                                          Each must be > 0.
+*
+*  \param[in]       unsigned int starve_ms An item of the normal or batch
+*                                          lane waiting longer is taken
+*                                          before the others, every other
+*                                          time at most. 0 never.
+*
+*  \param[in]       work_handler_t handler Function run by the workers.
+*
+*  \param[in]       void *ctx              Passed unchanged to handler.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int work_pool_init(work_pool_t *pool, unsigned int workers_no, unsigned int queue_len,
+        const unsigned int *weights, unsigned int starve_ms, work_handler_t handler,
+        void *ctx);
+
+/*
+*******************************************************************************
+*   work_pool_submit
+*******************************************************************************
+*
+*  \brief           <b> work_pool_submit </b>\n
+*                   Copies item into the queue of its lane, LANE_NORMAL if
+*                   out of range. Blocks while that queue is full.
+*
+*  \return          0                      Success.
+*
+*  \return          -1                     The pool is shutting down.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int work_pool_submit(work_pool_t *pool, const work_item_t *item);
+
+/*
+*******************************************************************************
+*   work_pool_depth
+*******************************************************************************
+*
+*  \brief           <b> work_pool_depth </b>\n
+*                   Items waiting for a worker, over every lane.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+unsigned int work_pool_depth(work_pool_t *pool);
+
+/*
+*******************************************************************************
+*   work_pool_shutdown
+*******************************************************************************
+*
+*  \brief           <b> work_pool_shutdown </b>\n
+*                   Refuses new items, lets the workers drain the queue and
+*                   joins them.
+*
+*  \return          0                      Success. Errors are fatal.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+int work_pool_shutdown(work_pool_t *pool);
+
+/*
+*******************************************************************************
+*   work_pool_destroy
+*******************************************************************************
+*
+*  \brief           <b> work_pool_destroy </b>\n
+*                   Frees the pool's resources. Must be called after
+*                   work_pool_shutdown.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void work_pool_destroy(work_pool_t *pool);
+
+/*
+*******************************************************************************
+*   work_pool_print_stats
+*******************************************************************************
+*
+*  \brief           <b> work_pool_print_stats </b>\n
+*                   Prints the depth of each lane's queue and per-worker
+*                   utilization to out.
+*                   Per-worker figures are exact only after
+*                   work_pool_shutdown.
+*
+*  \author          Mihnea SERBAN
+*
+*  \date            17.10.2026
+*******************************************************************************/
+void work_pool_print_stats(work_pool_t *pool, FILE *out);
+
+#endif /* WORK_POOL_H */